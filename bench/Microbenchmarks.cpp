@@ -0,0 +1,453 @@
+// Times the intersection and sampling kernels of the renderer one at a time, on generated rays and primitives
+// shaped like the ones of the built-in scenes: rays start around the primitives and are aimed at the region
+// around them, from 15% (quads) to 60% (spheres) of them hit. Triangles are timed a mesh leaf of 8 at a
+// time. SIMD variants of a kernel are timed next to its scalar reference and cross-checked against it on
+// more inputs than the timing uses. Spheres and quads are also timed a BVH leaf of 8 at a time.
+//
+// Usage: Microbenchmarks [name filter]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+
+#include "3DMath/Random.h"
+#include "AABB.h"
+#include "Allocator.hpp"
+#include "Box.hpp"
+#include "ONB.hpp"
+#include "PrimitiveLeaves.hpp"
+#include "Quad.hpp"
+#include "ResourceCache.hpp"
+#include "Sphere.h"
+#include "Transformations.hpp"
+#include "TriangleMesh.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define MICROBENCH_SSE
+#endif
+
+// Box allocates its quads from the shape arena, the renderer defines these in main.cpp
+LinearAllocator g_shapeAllocator("Shape", HUGE_PAGE_SIZE);
+LinearAllocator g_materialAllocator("Material", HUGE_PAGE_SIZE);
+ResourceCache g_materialCache(g_materialAllocator);
+
+#define MICROBENCH_ITEMS        4096     // inputs every kernel cycles through, they stay in the L2 cache
+#define MICROBENCH_CHECK_ITEMS  1000000  // inputs the SIMD variants are cross-checked on, big ones a batch of MICROBENCH_ITEMS at a time
+#define MICROBENCH_MIN_SECONDS  0.25
+#define MICROBENCH_SEED         1
+#define MICROBENCH_TRIANGLE_EPS 1e-5f    // error the SIMD triangle test may have, relative for distances, absolute for barycentrics
+#define MICROBENCH_LEAF_EPS     1e-4f    // the same for the sphere and quad leaves
+
+// A ray aimed at the region around center, from up to 10 units away
+Ray RandomRayAt(const glm::vec3& center, float size)
+{
+    glm::vec3 origin = center + math::RandomOnUnitSphere<float>() * math::RandomReal(2.0f * size, 10.0f);
+    glm::vec3 target = center + math::RandomInUnitSphere<float>() * 1.5f * size;
+    return Ray(origin, target - origin);
+}
+glm::vec3 RandomPoint()
+{
+    return glm::vec3(math::RandomReal(-5.0f, 5.0f), math::RandomReal(-5.0f, 5.0f), math::RandomReal(-5.0f, 5.0f));
+}
+
+#ifdef MICROBENCH_SSE
+// Candidate for AABB::Hit: all three slabs at once, without the early outs. The lanes of the ray that
+// are NaN (0 * inf for rays in the plane of a slab) lose against tMin and tMax like in the scalar test.
+bool HitAABBSse(const AABB& box, const Ray& r, float tMin, float tMax)
+{
+    glm::vec3 min    = box.GetMin();
+    glm::vec3 max    = box.GetMax();
+    glm::vec3 origin = r.GetOrigin();
+    glm::vec3 invDir = r.GetInvDir();
+    __m128 o         = _mm_set_ps(0.0f, origin.z, origin.y, origin.x);
+    __m128 inv       = _mm_set_ps(0.0f, invDir.z, invDir.y, invDir.x);
+    __m128 t0        = _mm_mul_ps(_mm_sub_ps(_mm_set_ps(0.0f, min.z, min.y, min.x), o), inv);
+    __m128 t1        = _mm_mul_ps(_mm_sub_ps(_mm_set_ps(0.0f, max.z, max.y, max.x), o), inv);
+    // minps/maxps return their second operand if either one is NaN
+    __m128 nearT = _mm_max_ps(_mm_min_ps(t1, t0), _mm_set1_ps(tMin));
+    __m128 farT  = _mm_min_ps(_mm_max_ps(t1, t0), _mm_set1_ps(tMax));
+    // the w lane is 0 * 0 = 0, overwrite it so it doesn't take part
+    nearT = _mm_move_ss(_mm_shuffle_ps(nearT, nearT, _MM_SHUFFLE(2, 1, 0, 0)), nearT);
+    farT  = _mm_move_ss(_mm_shuffle_ps(farT, farT, _MM_SHUFFLE(2, 1, 0, 0)), farT);
+    nearT = _mm_max_ps(nearT, _mm_shuffle_ps(nearT, nearT, _MM_SHUFFLE(1, 0, 3, 2)));
+    nearT = _mm_max_ps(nearT, _mm_shuffle_ps(nearT, nearT, _MM_SHUFFLE(2, 3, 0, 1)));
+    farT  = _mm_min_ps(farT, _mm_shuffle_ps(farT, farT, _MM_SHUFFLE(1, 0, 3, 2)));
+    farT  = _mm_min_ps(farT, _mm_shuffle_ps(farT, farT, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_comigt_ss(farT, nearT);
+}
+#endif
+
+// Möller-Trumbore reference for the triangle blocks, on the first vertex and the two edges of every triangle
+struct EdgeTriangle
+{
+    glm::vec3 v0, e1, e2;
+};
+int HitTrianglesMollerTrumbore(const EdgeTriangle* triangles, uint32_t count, const Ray& r, float tMin, float& tMax)
+{
+    int closest = -1;
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const EdgeTriangle& triangle = triangles[i];
+        glm::vec3 p                  = glm::cross(r.GetDir(), triangle.e2);
+        float determinant            = glm::dot(triangle.e1, p);
+        if(std::abs(determinant) < 1e-12f)
+            continue;
+        float inverse = 1.0f / determinant;
+        glm::vec3 s   = r.GetOrigin() - triangle.v0;
+        float u       = glm::dot(s, p) * inverse;
+        if(u < 0.0f || u > 1.0f)
+            continue;
+        glm::vec3 q = glm::cross(s, triangle.e1);
+        float v     = glm::dot(r.GetDir(), q) * inverse;
+        if(v < 0.0f || u + v > 1.0f)
+            continue;
+        float t = glm::dot(triangle.e2, q) * inverse;
+        if(t < tMin || t > tMax)
+            continue;
+        tMax    = t;
+        closest = (int)i;
+    }
+    return closest;
+}
+
+class Microbenchmarks
+{
+public:
+    Microbenchmarks(const std::string& filter) : m_filter(filter) {}
+
+    // op(i) runs the kernel on input i < MICROBENCH_ITEMS and returns something that depends on its result
+    void Time(const std::string& name, const char* variant, const std::function<float(size_t)>& op)
+    {
+        if(name.find(m_filter) == std::string::npos)
+            return;
+        float checksum = 0.0f;
+        size_t ops     = 0;
+        auto start     = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed(0);
+        while(elapsed.count() < MICROBENCH_MIN_SECONDS)
+        {
+            for(size_t i = 0; i < MICROBENCH_ITEMS; ++i)
+                checksum += op(i);
+            ops     += MICROBENCH_ITEMS;
+            elapsed  = std::chrono::steady_clock::now() - start;
+        }
+        m_sink = checksum;
+
+        double ns = elapsed.count() * 1e9 / ops;
+        std::cout << std::left << std::setw(30) << name << std::setw(8) << variant << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << ns << " ns/op" << std::setw(12) << 1e3 / ns << " Mops/s" << std::endl;
+    }
+
+    // Runs both on count inputs and reports every input they disagree on, false if there was one
+    bool CrossCheck(const std::string& name, size_t count, const std::function<bool(size_t)>& matches)
+    {
+        if(name.find(m_filter) == std::string::npos)
+            return true;
+        size_t mismatches = 0;
+        for(size_t i = 0; i < count; ++i)
+            mismatches += !matches(i);
+        std::cout << std::left << std::setw(30) << name << (mismatches == 0 ? "SIMD matches scalar" : "SIMD MISMATCHES scalar")
+                  << " on " << count - mismatches << "/" << count << " inputs" << std::right << std::endl;
+        return mismatches == 0;
+    }
+
+    // The same for kernels whose inputs are too big to keep count of them: generate() refills the
+    // MICROBENCH_ITEMS timing inputs with new ones from the seeded stream before every batch
+    bool CrossCheck(const std::string& name, size_t count, const std::function<void()>& generate, const std::function<bool(size_t)>& matches)
+    {
+        if(name.find(m_filter) == std::string::npos)
+            return true;
+        size_t mismatches = 0;
+        for(size_t first = 0; first < count; first += MICROBENCH_ITEMS)
+        {
+            generate();
+            for(size_t i = 0; i < std::min<size_t>(count - first, MICROBENCH_ITEMS); ++i)
+                mismatches += !matches(i);
+        }
+        std::cout << std::left << std::setw(30) << name << (mismatches == 0 ? "SIMD matches scalar" : "SIMD MISMATCHES scalar")
+                  << " on " << count - mismatches << "/" << count << " inputs" << std::right << std::endl;
+        return mismatches == 0;
+    }
+
+private:
+    std::string m_filter;
+    volatile float m_sink = 0.0f;
+};
+
+int main(int argc, char** argv)
+{
+    Microbenchmarks bench(argc > 1 ? argv[1] : "");
+    math::SeedRandom(MICROBENCH_SEED);
+    bool ok = true;
+
+    // Axis aligned boxes like the BVH nodes, the rays are aimed at them
+    std::vector<AABB> boxes;
+    std::vector<Ray> boxRays;
+    for(size_t i = 0; i < MICROBENCH_CHECK_ITEMS; ++i)
+    {
+        glm::vec3 center = RandomPoint();
+        glm::vec3 extent(math::RandomReal(0.05f, 2.0f), math::RandomReal(0.05f, 2.0f), math::RandomReal(0.05f, 2.0f));
+        boxes.emplace_back(center - extent, center + extent);
+        // every 16th ray is parallel to a slab, the case that turns into NaN
+        Ray ray = RandomRayAt(center, glm::length(extent));
+        if(i % 16 == 0)
+        {
+            glm::vec3 dir = ray.GetDir();
+            dir[i / 16 % 3] = 0.0f;
+            ray             = Ray(ray.GetOrigin(), dir);
+        }
+        boxRays.push_back(ray);
+    }
+    bench.Time("AABB::Hit", "scalar", [&](size_t i)
+               { return (float)boxes[i].Hit(boxRays[i], 0.001f, 1e30f); });
+#ifdef MICROBENCH_SSE
+    bench.Time("AABB::Hit", "sse", [&](size_t i)
+               { return (float)HitAABBSse(boxes[i], boxRays[i], 0.001f, 1e30f); });
+    ok &= bench.CrossCheck("AABB::Hit", MICROBENCH_CHECK_ITEMS, [&](size_t i)
+                           { return boxes[i].Hit(boxRays[i], 0.001f, 1e30f) == HitAABBSse(boxes[i], boxRays[i], 0.001f, 1e30f); });
+#endif
+
+    // The primitives get the same kind of rays, the kernels return the distance of the hit or -1
+    std::vector<Sphere> spheres;
+    std::vector<Quad> quads;
+    std::vector<Box> solidBoxes;
+    std::vector<RotateY> rotatedBoxes;
+    std::vector<Ray> sphereRays, quadRays, solidBoxRays;
+    solidBoxes.reserve(MICROBENCH_ITEMS);  // the rotations point into it
+    for(size_t i = 0; i < MICROBENCH_ITEMS; ++i)
+    {
+        glm::vec3 center = RandomPoint();
+        float radius     = math::RandomReal(0.1f, 2.0f);
+        spheres.emplace_back(center, radius, nullptr);
+        sphereRays.push_back(RandomRayAt(center, radius));
+
+        glm::vec3 u = math::RandomOnUnitSphere<float>() * math::RandomReal(0.2f, 3.0f);
+        glm::vec3 v = glm::normalize(glm::cross(u, math::RandomOnUnitSphere<float>())) * math::RandomReal(0.2f, 3.0f);
+        quads.emplace_back(center - 0.5f * (u + v), u, v, nullptr);
+        quadRays.push_back(RandomRayAt(center, glm::length(u + v) * 0.5f));
+
+        glm::vec3 extent(math::RandomReal(0.1f, 2.0f), math::RandomReal(0.1f, 2.0f), math::RandomReal(0.1f, 2.0f));
+        solidBoxes.emplace_back(center - extent, center + extent, nullptr);
+        rotatedBoxes.emplace_back(&solidBoxes.back(), math::RandomReal(0.0f, 360.0f));
+        solidBoxRays.push_back(RandomRayAt(center, glm::length(extent)));
+    }
+    auto distance = [](const Hittable& object, const Ray& ray)
+    {
+        HitRecord rec;
+        return object.Hit(ray, 0.001f, std::numeric_limits<float>::infinity(), rec) ? rec.t : -1.0f;
+    };
+    bench.Time("Sphere::Hit", "scalar", [&](size_t i)
+               { return distance(spheres[i], sphereRays[i]); });
+    bench.Time("Quad::Hit", "scalar", [&](size_t i)
+               { return distance(quads[i], quadRays[i]); });
+    bench.Time("Box::Hit", "scalar", [&](size_t i)
+               { return distance(solidBoxes[i], solidBoxRays[i]); });
+    bench.Time("RotateY::Hit", "scalar", [&](size_t i)
+               { return distance(rotatedBoxes[i], solidBoxRays[i]); });
+
+    // Full blocks of small triangles scattered around a point like the leaves of a mesh BVH
+    std::vector<TriangleBlock> blocks(MICROBENCH_ITEMS);
+    std::vector<EdgeTriangle> edgeTriangles(MICROBENCH_ITEMS * MESH_BLOCK_WIDTH);
+    std::vector<Ray> triangleRays;
+    std::vector<ShearedRay> shearedRays;
+    auto generateBlocks = [&]
+    {
+        triangleRays.clear();
+        shearedRays.clear();
+        for(size_t i = 0; i < MICROBENCH_ITEMS; ++i)
+        {
+            glm::vec3 center = RandomPoint();
+            for(uint32_t lane = 0; lane < MESH_BLOCK_WIDTH; ++lane)
+            {
+                glm::vec3 a    = center + math::RandomInUnitSphere<float>() * 0.5f;
+                glm::vec3 v[3] = {a, a + math::RandomInUnitSphere<float>() * 0.5f, a + math::RandomInUnitSphere<float>() * 0.5f};
+                for(int vertex = 0; vertex < 3; ++vertex)
+                {
+                    for(int coordinate = 0; coordinate < 3; ++coordinate)
+                        blocks[i].vertices[vertex][coordinate][lane] = v[vertex][coordinate];
+                }
+                blocks[i].triangles[lane]                  = lane;
+                edgeTriangles[i * MESH_BLOCK_WIDTH + lane] = {v[0], v[1] - v[0], v[2] - v[0]};
+            }
+            triangleRays.push_back(RandomRayAt(center, 0.5f));
+            shearedRays.emplace_back(triangleRays.back());
+        }
+    };
+    generateBlocks();
+    struct TriangleHit
+    {
+        int lane;
+        float t;
+        glm::vec3 uvw;
+    };
+    auto blockHit = [&](size_t i, auto intersect)
+    {
+        TriangleHit hit = {-1, std::numeric_limits<float>::infinity(), glm::vec3(0)};
+        hit.lane        = intersect(shearedRays[i], blocks[i], MESH_BLOCK_WIDTH, 0.001f, hit.t, hit.uvw);
+        return hit;
+    };
+    auto blockDistance = [&](size_t i, auto intersect)
+    {
+        TriangleHit hit = blockHit(i, intersect);
+        return hit.lane >= 0 ? hit.t : -1.0f;
+    };
+    bench.Time("Triangle x8", "mt", [&](size_t i)
+               {
+        float t = std::numeric_limits<float>::infinity();
+        return HitTrianglesMollerTrumbore(&edgeTriangles[i * MESH_BLOCK_WIDTH], MESH_BLOCK_WIDTH, triangleRays[i], 0.001f, t) >= 0 ? t : -1.0f; });
+    bench.Time("Triangle x8", "scalar", [&](size_t i)
+               { return blockDistance(i, IntersectTriangleBlockScalar); });
+#ifdef __AVX2__
+    bench.Time("Triangle x8", "avx2", [&](size_t i)
+               { return blockDistance(i, IntersectTriangleBlockAvx2); });
+    // both are the watertight test, they hit the same lane and only the rounding of the distances and the
+    // barycentrics may differ
+    ok &= bench.CrossCheck("Triangle x8", MICROBENCH_CHECK_ITEMS, generateBlocks, [&](size_t i)
+                           {
+        TriangleHit scalar = blockHit(i, IntersectTriangleBlockScalar);
+        TriangleHit simd   = blockHit(i, IntersectTriangleBlockAvx2);
+        if(scalar.lane != simd.lane)
+            return false;
+        return scalar.lane < 0 || (std::abs(scalar.t - simd.t) <= MICROBENCH_TRIANGLE_EPS * scalar.t &&
+                                   glm::distance(scalar.uvw, simd.uvw) <= MICROBENCH_TRIANGLE_EPS); });
+#endif
+
+    // Leaves of 8 spheres or quads scattered around a point like the small spheres of the random scene,
+    // against 8 virtual Hit() calls
+    std::vector<Sphere> leafSpheres;
+    std::vector<Quad> leafQuads;
+    std::vector<SphereLeaf> sphereLeaves;
+    std::vector<QuadLeaf> quadLeaves;
+    std::vector<Ray> leafRays;
+    leafSpheres.reserve(MICROBENCH_ITEMS * PRIMITIVE_LEAF_WIDTH);  // the leaves point into them
+    leafQuads.reserve(MICROBENCH_ITEMS * PRIMITIVE_LEAF_WIDTH);
+    auto generateLeaves = [&]
+    {
+        leafSpheres.clear();
+        leafQuads.clear();
+        sphereLeaves.clear();
+        quadLeaves.clear();
+        leafRays.clear();
+        for(size_t i = 0; i < MICROBENCH_ITEMS; ++i)
+        {
+            glm::vec3 center       = RandomPoint();
+            SphereLeaf& sphereLeaf = sphereLeaves.emplace_back();
+            QuadLeaf& quadLeaf     = quadLeaves.emplace_back();
+            for(uint32_t lane = 0; lane < PRIMITIVE_LEAF_WIDTH; ++lane)
+            {
+                glm::vec3 position = center + math::RandomInUnitSphere<float>();
+                sphereLeaf.Add(&leafSpheres.emplace_back(position, math::RandomReal(0.1f, 0.3f), nullptr));
+                glm::vec3 u = math::RandomOnUnitSphere<float>() * math::RandomReal(0.2f, 0.6f);
+                glm::vec3 v = glm::normalize(glm::cross(u, math::RandomOnUnitSphere<float>())) * math::RandomReal(0.2f, 0.6f);
+                quadLeaf.Add(&leafQuads.emplace_back(position - 0.5f * (u + v), u, v, nullptr));
+            }
+            leafRays.push_back(RandomRayAt(center, 1.0f));
+        }
+    };
+    generateLeaves();
+    auto hitDistance = [&](const auto* primitives, size_t i)
+    {
+        HitRecord rec;
+        float t = std::numeric_limits<float>::infinity();
+        for(uint32_t lane = 0; lane < PRIMITIVE_LEAF_WIDTH; ++lane)
+        {
+            if(primitives[i * PRIMITIVE_LEAF_WIDTH + lane].Hit(leafRays[i], 0.001f, t, rec))
+                t = rec.t;
+        }
+        return t < std::numeric_limits<float>::infinity() ? t : -1.0f;
+    };
+    struct LeafHit
+    {
+        int lane;
+        float t;
+        glm::vec2 uv;  // of quads
+    };
+    auto sphereHit = [&](size_t i, auto intersect)
+    {
+        LeafHit hit = {-1, std::numeric_limits<float>::infinity(), glm::vec2(0)};
+        hit.lane    = (sphereLeaves[i].*intersect)(leafRays[i], 0.001f, hit.t);
+        return hit;
+    };
+    auto quadHit = [&](size_t i, auto intersect)
+    {
+        LeafHit hit = {-1, std::numeric_limits<float>::infinity(), glm::vec2(0)};
+        hit.lane    = (quadLeaves[i].*intersect)(leafRays[i], 0.001f, hit.t, hit.uv);
+        return hit;
+    };
+    auto leafDistance = [](const LeafHit& hit)
+    { return hit.lane >= 0 ? hit.t : -1.0f; };
+    bench.Time("Sphere x8", "hit", [&](size_t i)
+               { return hitDistance(leafSpheres.data(), i); });
+    bench.Time("Sphere x8", "scalar", [&](size_t i)
+               { return leafDistance(sphereHit(i, &SphereLeaf::IntersectScalar)); });
+#ifdef __AVX2__
+    bench.Time("Sphere x8", "avx2", [&](size_t i)
+               { return leafDistance(sphereHit(i, &SphereLeaf::IntersectAvx2)); });
+#endif
+    bench.Time("Quad x8", "hit", [&](size_t i)
+               { return hitDistance(leafQuads.data(), i); });
+    bench.Time("Quad x8", "scalar", [&](size_t i)
+               { return leafDistance(quadHit(i, &QuadLeaf::IntersectScalar)); });
+#ifdef __AVX2__
+    bench.Time("Quad x8", "avx2", [&](size_t i)
+               { return leafDistance(quadHit(i, &QuadLeaf::IntersectAvx2)); });
+    // the same lane, the first one of those at the same distance, and the same distance and uv up to rounding
+    auto matches = [](const LeafHit& scalar, const LeafHit& simd)
+    {
+        if(scalar.lane != simd.lane)
+            return false;
+        return scalar.lane < 0 ||
+               (std::abs(scalar.t - simd.t) <= MICROBENCH_LEAF_EPS * scalar.t && glm::distance(scalar.uv, simd.uv) <= MICROBENCH_LEAF_EPS);
+    };
+    ok &= bench.CrossCheck("Sphere x8", MICROBENCH_CHECK_ITEMS, generateLeaves, [&](size_t i)
+                           { return matches(sphereHit(i, &SphereLeaf::IntersectScalar), sphereHit(i, &SphereLeaf::IntersectAvx2)); });
+    // unlike the triangle test the quad test isn't watertight, the compiler may contract the scalar one
+    // into FMAs and a ray that hits within rounding of an edge can miss in the other variant
+    ok &= bench.CrossCheck("Quad x8", MICROBENCH_CHECK_ITEMS, generateLeaves, [&](size_t i)
+                           {
+        LeafHit scalar = quadHit(i, &QuadLeaf::IntersectScalar);
+        LeafHit simd   = quadHit(i, &QuadLeaf::IntersectAvx2);
+        if(scalar.lane == simd.lane)
+            return matches(scalar, simd);
+        const LeafHit& missed = scalar.t < simd.t ? scalar : simd;
+        glm::vec2 border      = glm::min(missed.uv, 1.0f - missed.uv);
+        return std::min(border.x, border.y) <= MICROBENCH_LEAF_EPS; });
+#endif
+
+    std::vector<glm::vec3> normals;
+    for(size_t i = 0; i < MICROBENCH_ITEMS; ++i)
+        normals.push_back(math::RandomOnUnitSphere<float>());
+    bench.Time("ONB", "scalar", [&](size_t i)
+               {
+        ONB uvw(normals[i]);
+        return uvw.Local(glm::vec3(0.3f, 0.4f, 0.5f)).x; });
+
+    // The generators draw from the thread's stream, the input index is unused
+    bench.Time("math::RandomReal", "scalar", [](size_t)
+               { return math::RandomReal<float>(); });
+    bench.Time("math::RandomNormalReal", "scalar", [](size_t)
+               { return math::RandomNormalReal<float>(); });
+    bench.Time("math::RandomInt", "scalar", [](size_t)
+               { return (float)math::RandomInt(0, 100); });
+    bench.Time("math::RandomInUnitSphere", "scalar", [](size_t)
+               { return math::RandomInUnitSphere<float>().x; });
+    bench.Time("math::RandomOnUnitSphere", "scalar", [](size_t)
+               { return math::RandomOnUnitSphere<float>().x; });
+    bench.Time("math::RandomInUnitDisk", "scalar", [](size_t)
+               { return math::RandomInUnitDisk<float>().x; });
+    bench.Time("math::RandomCosineHemisphere", "scalar", [](size_t)
+               { return math::RandomCosineHemisphere<float>().z; });
+
+    g_materialCache.Clear();
+    g_materialAllocator.Reset();
+    g_shapeAllocator.Reset();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+#ifndef HALF_H
+#define HALF_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace math
+{
+
+// IEEE 754 binary16 conversions, rounds to nearest even
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign     = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if(exponent == 0xFF)  // inf, NaN stays NaN
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+
+    int e = (int)exponent - 127 + 15;
+    if(e >= 0x1F)
+        return sign | 0x7C00;
+    if(e <= 0)
+    {
+        // subnormal half
+        if(e < -10)
+            return sign;
+        mantissa         |= 0x800000;
+        int shift         = 14 - e;
+        uint32_t half     = mantissa >> shift;
+        uint32_t rest     = mantissa & ((1u << shift) - 1);
+        uint32_t halfway  = 1u << (shift - 1);
+        if(rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return sign | half;
+    }
+
+    uint32_t half = ((uint32_t)e << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    if(rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;  // a carry into the exponent is still the correctly rounded result
+    return sign | half;
+}
+
+inline float HalfToFloat(uint16_t half)
+{
+    uint32_t sign     = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+    uint32_t bits;
+
+    if(exponent == 0)
+    {
+        if(mantissa == 0)
+            bits = sign;
+        else
+        {
+            // subnormal half, renormalize
+            exponent = 127 - 15 + 1;
+            while(!(mantissa & 0x400))
+            {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+        }
+    }
+    else if(exponent == 0x1F)
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    else
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+}  // namespace math
+#endif
@@ -0,0 +1,42 @@
+#ifndef OCTAHEDRAL_H
+#define OCTAHEDRAL_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "glm/glm.hpp"
+
+namespace math
+{
+
+// Unit vectors in 32 bits: the octahedron |x| + |y| + |z| = 1 unfolded onto a square, stored as two
+// 16-bit snorms (Cigolle et al.: A Survey of Efficient Representations for Independent Unit Vectors,
+// JCGT 2014).
+inline uint32_t EncodeOctahedral(const glm::vec3& v)
+{
+    auto snorm = [](float f) { return (uint32_t)(uint16_t)(int16_t)std::round(glm::clamp(f, -1.0f, 1.0f) * 32767.0f); };
+    float norm = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+    if(norm == 0.0f)
+        return 0;  // +z
+    glm::vec2 p = glm::vec2(v.x, v.y) / norm;
+    if(v.z < 0.0f)
+    {
+        // the lower half folds over the diagonals
+        p = glm::vec2((1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    return snorm(p.x) | (snorm(p.y) << 16);
+}
+
+inline glm::vec3 DecodeOctahedral(uint32_t packed)
+{
+    glm::vec2 p(std::max((int16_t)(packed & 0xFFFF) / 32767.0f, -1.0f), std::max((int16_t)(packed >> 16) / 32767.0f, -1.0f));
+    glm::vec3 v(p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y));
+    if(v.z < 0.0f)
+    {
+        v.x = (1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f);
+        v.y = (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return glm::normalize(v);
+}
+}  // namespace math
+#endif
@@ -1,19 +1,53 @@
 #ifndef RANDOM_H
 #define RANDOM_H
 
+#include <cstdint>
+#include <ctime>
+#include <functional>
 #include <random>
+#include <thread>
 #include "glm/glm.hpp"
 #include "glm/ext/scalar_constants.hpp"
 
 namespace math
 {
 
+// Every thread owns one generator and its own distributions, nothing is shared between threads.
+// Without an explicit seed a thread starts from the time and its thread id.
+inline std::mt19937_64& GetRandomGenerator()
+{
+    static thread_local std::mt19937_64 generator{static_cast<uint64_t>(time(0)) ^ std::hash<std::thread::id>()(std::this_thread::get_id())};
+    return generator;
+}
+
+// splitmix64 finalizer, turns related inputs (seed, pass, row) into unrelated generator seeds
+inline uint64_t MixSeed(uint64_t seed, uint64_t value)
+{
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull * (value + 1);
+    z          = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z          = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Bumped by SeedRandom() so distributions that carry state between calls know to reset it
+inline uint64_t& GetRandomSeedGeneration()
+{
+    static thread_local uint64_t generation = 0;
+    return generation;
+}
+
+// Makes the random numbers drawn by the calling thread from now on a pure function of seed
+inline void SeedRandom(uint64_t seed)
+{
+    GetRandomGenerator().seed(seed);
+    GetRandomSeedGeneration()++;
+}
+
 template<typename T>
 T RandomReal()
 {
-    static std::uniform_real_distribution<T> distribution(0.0, 1.0);
-    static thread_local std::mt19937_64 generator{static_cast<long unsigned int>(time(0))};
-    return T(distribution(generator));
+    static thread_local std::uniform_real_distribution<T> distribution(0.0, 1.0);
+    return T(distribution(GetRandomGenerator()));
 }
 template<typename T>
 T RandomReal(T min, T max)
@@ -24,15 +58,20 @@ T RandomReal(T min, T max)
 template<typename T>
 T RandomNormalReal()
 {
-    static std::normal_distribution<T> distribution;
-    static thread_local std::mt19937_64 generator{static_cast<long unsigned int>(time(0))};
-    return T(distribution(generator));
+    // normal_distribution caches its second value between calls, which must not leak across a reseed
+    static thread_local std::normal_distribution<T> distribution;
+    static thread_local uint64_t generation = 0;
+    if(generation != GetRandomSeedGeneration())
+    {
+        distribution.reset();
+        generation = GetRandomSeedGeneration();
+    }
+    return T(distribution(GetRandomGenerator()));
 }
 inline int RandomInt()
 {
-    static std::uniform_int_distribution<int> distribution;
-    static thread_local std::mt19937 generator{static_cast<long unsigned int>(time(0))};
-    return distribution(generator);
+    static thread_local std::uniform_int_distribution<int> distribution;
+    return distribution(GetRandomGenerator());
 }
 inline int RandomInt(int min, int max)
 {
@@ -2,6 +2,7 @@
 #define AABB_H
 
 #include "Ray.h"
+#include "Stats.hpp"
 
 class AABB
 {
@@ -16,6 +17,7 @@ public:
     // optimization from https://www.researchgate.net/publication/220494140_An_Efficient_and_Robust_Ray-Box_Intersection_Algorithm
     bool Hit(const Ray& r, float tMin, float tMax) const
     {
+        STATS_COUNT(aabbTests);
         auto invDir = r.GetInvDir();
         for(int i = 0; i < 3; ++i)
         {
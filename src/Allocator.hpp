@@ -1,47 +1,140 @@
 #pragma once
-#include <utility>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "System.hpp"
 
+// Bump allocator that grows by whole chunks, so returned pointers stay valid until Reset().
+// Objects with a non-trivial destructor are remembered and destroyed (in reverse order) by Reset().
 class LinearAllocator
 {
 public:
-    LinearAllocator(size_t size)
-    {
-        m_start = new char[size];
-        m_ptr   = m_start;
-        m_size  = size;
-    }
+    // pageFlags (PAGES_HUGE, PAGES_NUMA_INTERLEAVED) apply to every chunk, chunk sizes are rounded up to whole pages
+    LinearAllocator(const char* name, size_t chunkSize, uint32_t pageFlags = PAGES_DEFAULT)
+        : m_name(name), m_chunkSize(chunkSize), m_pageFlags(pageFlags) {}
     ~LinearAllocator()
     {
-        delete[](char*)m_start;
+        Reset();
+        for(auto& chunk : m_chunks)
+            FreePages(chunk.start, chunk.size);
     }
+    LinearAllocator(const LinearAllocator&)            = delete;
+    LinearAllocator& operator=(const LinearAllocator&) = delete;
 
     template<typename T, typename... Args>
     T* Allocate(Args&&... args)
     {
-        if((size_t)m_ptr + sizeof(T) > (size_t)m_start + m_size)
-        {
-            std::cout << "LinearAllocator out of memory" << std::endl;
-            assert(false);
-            return nullptr;
-        }
-
-        void* ptr = m_ptr;
-        m_ptr     = (void*)((char*)m_ptr + sizeof(T));
+        void* ptr = AllocateBytes(sizeof(T), alignof(T));
         T* result = new(ptr) T(std::forward<Args>(args)...);
+        if constexpr(!std::is_trivially_destructible_v<T>)
+            m_destructors.push_back({result, [](void* p)
+                                     { static_cast<T*>(p)->~T(); }});
         return result;
     }
 
+    // Uninitialized storage for count elements, alignment can be raised e.g. to CACHE_LINE_SIZE
+    template<typename T>
+    T* AllocateArray(size_t count, size_t alignment = alignof(T))
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "arrays don't get their destructors called");
+        return static_cast<T*>(AllocateBytes(sizeof(T) * count, std::max(alignment, alignof(T))));
+    }
+
+    void* AllocateBytes(size_t size, size_t alignment)
+    {
+        assert((alignment & (alignment - 1)) == 0 && "alignment must be a power of 2");
+
+        while(true)
+        {
+            if(m_current < m_chunks.size())
+            {
+                const Chunk& chunk = m_chunks[m_current];
+                uintptr_t aligned  = (m_ptr + alignment - 1) & ~(uintptr_t)(alignment - 1);
+                if(aligned + size <= (uintptr_t)chunk.start + chunk.size)
+                {
+                    m_used += aligned + size - m_ptr;
+                    m_ptr   = aligned + size;
+                    m_numAllocations++;
+                    return (void*)aligned;
+                }
+                m_current++;
+            }
+            // chunks kept from before a Reset() are reused if the allocation fits in them
+            if(m_current == m_chunks.size() || m_chunks[m_current].size < size + alignment)
+            {
+                size_t chunkSize = RoundUpToPages(std::max(m_chunkSize, size + alignment), m_pageFlags);
+                void* start      = AllocatePages(chunkSize, m_pageFlags);
+                m_chunks.insert(m_chunks.begin() + m_current, {start, chunkSize});
+                m_reserved += chunkSize;
+            }
+            m_ptr = (uintptr_t)m_chunks[m_current].start;
+        }
+    }
+
+    // Destroys every object allocated so far, the chunks are kept around for reuse
     void Reset()
     {
-        m_ptr = m_start;
+        for(auto it = m_destructors.rbegin(); it != m_destructors.rend(); ++it)
+            it->destroy(it->object);
+        m_destructors.clear();
+
+        m_current        = 0;
+        m_ptr            = m_chunks.empty() ? 0 : (uintptr_t)m_chunks[0].start;
+        m_used           = 0;
+        m_numAllocations = 0;
+    }
+
+    size_t GetBytesUsed() const { return m_used; }
+    size_t GetBytesReserved() const { return m_reserved; }
+
+    void PrintStats() const
+    {
+        std::cout << m_name << " allocator: " << m_used / 1024 << " KiB used in " << m_numAllocations << " allocations, "
+                  << m_reserved / 1024 << " KiB reserved in " << m_chunks.size() << " chunks, "
+                  << m_destructors.size() << " destructors pending" << std::endl;
     }
 
 private:
-    void* m_start;
-    void* m_ptr;
-    size_t m_size;
+    struct Chunk
+    {
+        void* start;
+        size_t size;
+    };
+    struct Destructor
+    {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    const char* m_name;
+    size_t m_chunkSize;
+    uint32_t m_pageFlags;
+
+    std::vector<Chunk> m_chunks;
+    size_t m_current = 0;
+    uintptr_t m_ptr  = 0;
+    std::vector<Destructor> m_destructors;
+
+    size_t m_used           = 0;
+    size_t m_reserved       = 0;
+    size_t m_numAllocations = 0;
 };
 
+#define SCRATCH_ALLOCATOR_CHUNK_SIZE 1024 * 64
+
+// Per-thread arena for path-local temporaries (PDFs, BSDF data...), no locking needed.
+// The render loop resets it after every sample so nothing allocated from it may outlive a sample.
+inline LinearAllocator& GetScratchAllocator()
+{
+    thread_local LinearAllocator scratch("Scratch", SCRATCH_ALLOCATOR_CHUNK_SIZE);
+    return scratch;
+}
+
 extern LinearAllocator g_shapeAllocator;
 extern LinearAllocator g_materialAllocator;
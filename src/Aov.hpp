@@ -0,0 +1,199 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+#include "Allocator.hpp"
+#include "Framebuffer.hpp"
+
+// Emissive materials past this many share no per-light AOV
+#define AOV_MAX_LIGHTS 8
+
+// Arbitrary output variables: extra images written next to the beauty image, for compositing
+enum class Aov
+{
+    Depth,     // distance to the first hit
+    Normal,    // world space normal of the first hit
+    Albedo,    // albedo of the first hit
+    Emission,  // light emitted by what the camera sees, the background included
+    Direct,    // light reaching the camera after one bounce
+    Indirect,  // light reaching the camera after more bounces
+    Lights,    // one image per emissive material and one for the background, summed over all bounces
+};
+inline const char* const g_aovNames[] = {"depth", "normal", "albedo", "emission", "direct", "indirect", "lights"};
+
+// The radiance of a camera path split up by where it came from. Emission, direct and indirect add up to
+// the whole radiance. The background and the lights do too, except for what paths cut off by the maximum
+// depth return.
+struct LightPaths
+{
+    enum Slot
+    {
+        None = -1,
+        Emission,
+        Direct,
+        Indirect,
+        Background,
+        FirstLight,
+        SlotCount = FirstLight + AOV_MAX_LIGHTS,
+    };
+
+    static int LightSlot(int lightIndex) { return lightIndex >= 0 && lightIndex < AOV_MAX_LIGHTS ? FirstLight + lightIndex : None; }
+
+    // radiance reaches the camera from something the path saw after the given number of bounces
+    void Add(const glm::vec3& radiance, int bounce, int source)
+    {
+        sums[bounce == 0 ? Emission : (bounce == 1 ? Direct : Indirect)] += radiance;
+        if(source != None)
+            sums[source] += radiance;
+    }
+
+    glm::vec3 sums[SlotCount] = {};
+};
+
+// Accumulation buffer of the requested AOVs, filled during the same traversal as the Framebuffer it belongs
+// to. Only the light AOVs are stored here, depth, normal and albedo are the Framebuffer's denoiser features.
+// The sums keep their own sample count: reprojection doesn't carry them over a camera move, the buffer is
+// cleared instead, and checkpoints don't store them.
+class AovBuffer
+{
+public:
+    AovBuffer(uint32_t width, uint32_t height, const std::vector<Aov>& aovs, uint32_t lightCount)
+        : m_width(width), m_height(height), m_stride((width + 15) & ~15u), m_aovs(aovs), m_lightCount(lightCount),
+          m_layers(MakeLayers(aovs, lightCount)), m_sums((size_t)m_stride * height * std::max<size_t>(m_layers.size(), 1)),
+          m_sampleCount((size_t)m_stride * height)
+    {
+    }
+
+    void Clear(WorkerPool& workers)
+    {
+        workers.ParallelFor(m_height, [this](size_t y)
+                            { ClearRow(y); });
+    }
+    void ClearRow(size_t y)
+    {
+        size_t row = y * m_stride;
+        std::fill_n(&m_sums[row * m_layers.size()], m_stride * m_layers.size(), glm::vec3(0));
+        std::fill_n(&m_sampleCount[row], m_stride, 0u);
+    }
+
+    // Snapshot of a buffer made with the same size and AOVs
+    void CopyFrom(const AovBuffer& other)
+    {
+        size_t count = (size_t)m_stride * m_height;
+        std::memcpy(m_sums.Data(), other.m_sums.Data(), count * m_layers.size() * sizeof(glm::vec3));
+        std::memcpy(m_sampleCount.Data(), other.m_sampleCount.Data(), count * sizeof(uint32_t));
+    }
+
+    // paths holds the sums of count camera paths, dropping negative and NaN components like Framebuffer::AddSamples
+    void AddSamples(uint32_t x, uint32_t y, const LightPaths& paths, uint32_t count)
+    {
+        size_t i        = y * m_stride + x;
+        glm::vec3* sums = &m_sums[i * m_layers.size()];
+        for(size_t layer = 0; layer < m_layers.size(); ++layer)
+        {
+            const glm::vec3& sum = paths.sums[m_layers[layer].slot];
+            sums[layer] += glm::vec3(sum.r > 0.0f ? sum.r : 0.0f, sum.g > 0.0f ? sum.g : 0.0f, sum.b > 0.0f ? sum.b : 0.0f);
+        }
+        m_sampleCount[i] += count;
+    }
+
+    // EXR channel names in the order ResolveRow() writes them, "layer.channel" for everything but the depth
+    std::vector<std::string> GetChannelNames() const
+    {
+        std::vector<std::string> names;
+        for(Aov aov : m_aovs)
+        {
+            if(aov == Aov::Depth)
+                names.push_back("Z");
+            else if(aov == Aov::Normal || aov == Aov::Albedo)
+                for(const char* channel : {".X", ".Y", ".Z"})
+                    names.push_back(std::string(g_aovNames[(int)aov]) + channel);
+        }
+        for(const Layer& layer : m_layers)
+            for(const char* channel : {".R", ".G", ".B"})
+                names.push_back(layer.name + channel);
+        return names;
+    }
+
+    // Writes every channel of row y to out, width values per channel. features is the Framebuffer that was
+    // traced along with the AOVs, its row featureRow is the same image row. Exposure only scales the light AOVs.
+    void ResolveRow(uint32_t y, const Framebuffer& features, uint32_t featureRow, float exposure, float* out) const
+    {
+        for(Aov feature : m_aovs)
+        {
+            if(feature != Aov::Depth && feature != Aov::Normal && feature != Aov::Albedo)
+                continue;
+            for(uint32_t x = 0; x < m_width; ++x)
+            {
+                if(feature == Aov::Depth)
+                    out[x] = features.GetDepth(x, featureRow);
+                else
+                {
+                    glm::vec3 value = feature == Aov::Normal ? features.GetNormal(x, featureRow) : features.GetAlbedo(x, featureRow);
+                    out[x]               = value.x;
+                    out[m_width + x]     = value.y;
+                    out[2 * m_width + x] = value.z;
+                }
+            }
+            out += (feature == Aov::Depth ? 1 : 3) * m_width;
+        }
+        for(size_t layer = 0; layer < m_layers.size(); ++layer)
+        {
+            for(uint32_t x = 0; x < m_width; ++x)
+            {
+                size_t i        = y * m_stride + x;
+                uint32_t count  = m_sampleCount[i];
+                glm::vec3 value = count == 0 ? glm::vec3(0) : m_sums[i * m_layers.size() + layer] * (exposure / count);
+                out[x]               = value.r;
+                out[m_width + x]     = value.g;
+                out[2 * m_width + x] = value.b;
+            }
+            out += 3 * m_width;
+        }
+    }
+
+    uint32_t GetWidth() const { return m_width; }
+    uint32_t GetHeight() const { return m_height; }
+    const std::vector<Aov>& GetAovs() const { return m_aovs; }
+    uint32_t GetLightCount() const { return m_lightCount; }
+
+private:
+    struct Layer
+    {
+        std::string name;
+        int slot;  // in LightPaths::sums
+    };
+
+    static std::vector<Layer> MakeLayers(const std::vector<Aov>& aovs, uint32_t lightCount)
+    {
+        std::vector<Layer> layers;
+        for(Aov aov : aovs)
+        {
+            if(aov == Aov::Emission)
+                layers.push_back({"emission", LightPaths::Emission});
+            else if(aov == Aov::Direct)
+                layers.push_back({"direct", LightPaths::Direct});
+            else if(aov == Aov::Indirect)
+                layers.push_back({"indirect", LightPaths::Indirect});
+            else if(aov == Aov::Lights)
+            {
+                layers.push_back({"background", LightPaths::Background});
+                for(uint32_t i = 0; i < std::min<uint32_t>(lightCount, AOV_MAX_LIGHTS); ++i)
+                    layers.push_back({"light" + std::to_string(i), LightPaths::FirstLight + (int)i});
+            }
+        }
+        return layers;
+    }
+
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_stride;
+    std::vector<Aov> m_aovs;
+    uint32_t m_lightCount;
+    std::vector<Layer> m_layers;     // the light AOVs
+    PageArray<glm::vec3> m_sums;     // pixel major, the layers of a pixel are next to each other
+    PageArray<uint32_t> m_sampleCount;
+};
@@ -1,19 +1,33 @@
 #ifndef BVH_H
 #define BVH_H
 
+#include <chrono>
 #include <iostream>
+#include <typeinfo>
 #include "Allocator.hpp"
 #include "Hittable.h"
 #include "HittableList.h"
+#include "PrimitiveLeaves.hpp"
+#include "Profiler.hpp"
+#include "Stats.hpp"
 #include "3DMath/Random.h"
 
 class BVHNode : public Hittable
 {
 public:
     BVHNode();
-    BVHNode(HittableList& list) : BVHNode(list.GetObjects(), 0, list.GetObjects().size()) {}
+    BVHNode(HittableList& list)
+    {
+        PROFILE_SCOPE("BVH build");
+        auto start = std::chrono::steady_clock::now();
+        *this      = BVHNode(list.GetObjects(), 0, list.GetObjects().size());
+        s_buildSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
     BVHNode(std::vector<Hittable*>& objects, size_t start, size_t end);
 
+    // A leaf for 2 to PRIMITIVE_LEAF_WIDTH spheres or quads, a node for anything else
+    static Hittable* Create(std::vector<Hittable*>& objects, size_t start, size_t end);
+
     virtual bool Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const override;
     virtual bool BoundingBox(AABB& outAABB) const override
     {
@@ -21,7 +35,15 @@ public:
         return true;
     }
 
+    // Time spent building hierarchies from lists so far, for the benchmark
+    static double GetBuildSeconds() { return s_buildSeconds; }
+
 private:
+    static inline double s_buildSeconds = 0.0;
+
+    template<typename Leaf, typename Primitive>
+    static Leaf* CreateLeaf(std::vector<Hittable*>& objects, size_t start, size_t end);
+
     Hittable* m_left;
     Hittable* m_right;
     AABB m_aabb;
@@ -29,11 +51,12 @@ private:
 
 inline bool BVHNode::Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const
 {
+    STATS_COUNT(bvhNodes);
     if(!m_aabb.Hit(r, tMin, tMax))
         return false;
 
     bool hitLeft  = m_left->Hit(r, tMin, tMax, outRecord);
-    bool hitRight = m_right->Hit(r, tMin, hitLeft ? outRecord.t : tMax, outRecord);
+    bool hitRight = m_right != m_left && m_right->Hit(r, tMin, hitLeft ? outRecord.t : tMax, outRecord);
 
     return hitLeft || hitRight;
 }
@@ -54,7 +77,11 @@ inline BVHNode::BVHNode(std::vector<Hittable*>& objects, size_t start, size_t en
     };
 
     size_t numObjects = end - start;
-    if(numObjects == 1)
+    if(Hittable* leaf = CreateLeaf<SphereLeaf, Sphere>(objects, start, end))
+        m_left = m_right = leaf;
+    else if(Hittable* leaf = CreateLeaf<QuadLeaf, Quad>(objects, start, end))
+        m_left = m_right = leaf;
+    else if(numObjects == 1)
         m_left = m_right = objects[start];
     else if(numObjects == 2)
     {
@@ -74,8 +101,8 @@ inline BVHNode::BVHNode(std::vector<Hittable*>& objects, size_t start, size_t en
         std::sort(objects.begin() + start, objects.begin() + end, comp);
 
         size_t mid = start + numObjects / 2;
-        m_left     = g_shapeAllocator.Allocate<BVHNode>(objects, start, mid);
-        m_right    = g_shapeAllocator.Allocate<BVHNode>(objects, mid, end);
+        m_left     = Create(objects, start, mid);
+        m_right    = Create(objects, mid, end);
     }
 
     AABB leftBox, rightBox;
@@ -85,4 +112,30 @@ inline BVHNode::BVHNode(std::vector<Hittable*>& objects, size_t start, size_t en
     m_aabb = SurroundingBox(leftBox, rightBox);
 }
 
+inline Hittable* BVHNode::Create(std::vector<Hittable*>& objects, size_t start, size_t end)
+{
+    if(Hittable* leaf = CreateLeaf<SphereLeaf, Sphere>(objects, start, end))
+        return leaf;
+    if(Hittable* leaf = CreateLeaf<QuadLeaf, Quad>(objects, start, end))
+        return leaf;
+    return g_shapeAllocator.Allocate<BVHNode>(objects, start, end);
+}
+
+// Null unless every object of the range is a Primitive and there are 2 to PRIMITIVE_LEAF_WIDTH of them
+template<typename Leaf, typename Primitive>
+Leaf* BVHNode::CreateLeaf(std::vector<Hittable*>& objects, size_t start, size_t end)
+{
+    if(end - start < 2 || end - start > PRIMITIVE_LEAF_WIDTH)
+        return nullptr;
+    for(size_t i = start; i < end; ++i)
+    {
+        if(typeid(*objects[i]) != typeid(Primitive))
+            return nullptr;
+    }
+    Leaf* leaf = g_shapeAllocator.Allocate<Leaf>();
+    for(size_t i = start; i < end; ++i)
+        leaf->Add(static_cast<const Primitive*>(objects[i]));
+    return leaf;
+}
+
 #endif
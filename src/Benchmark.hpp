@@ -0,0 +1,86 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Defaults of --benchmark, fixed so that reports of different builds are comparable
+#define BENCHMARK_SIZE       256  // pixels, width and height unless given on the command line
+#define BENCHMARK_SPP        16   // samples per pixel unless given on the command line
+#define BENCHMARK_SEED       1    // unless given on the command line
+#define BENCHMARK_WARMUP_SPP 1    // untimed samples per pixel traced before the repeats
+#define BENCHMARK_REPEATS    3
+
+struct BenchmarkResult
+{
+    std::string scene;
+    double buildSeconds    = 0.0;  // the whole scene, BVH included
+    double bvhBuildSeconds = 0.0;
+    size_t sceneBytes      = 0;    // used in the shape and material arenas
+    size_t peakMemoryBytes = 0;    // of the process while the scene was built and rendered, 0 if unknown
+    uint64_t rays          = 0;    // traced by one repeat, every repeat traces the same ones
+    std::vector<double> renderSeconds;
+
+    // Repeats only get slower through interference, the fastest one is the most repeatable
+    double GetBestSeconds() const { return *std::min_element(renderSeconds.begin(), renderSeconds.end()); }
+    double GetMedianSeconds() const
+    {
+        std::vector<double> sorted = renderSeconds;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[sorted.size() / 2];
+    }
+};
+
+struct BenchmarkSettings
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t samplesPerPixel;
+    int maxDepth;
+    uint64_t seed;
+    int threads;
+    int numaNodes;
+};
+
+// One object with the settings and a "scenes" array, rates are computed from the best repeat
+inline bool WriteBenchmarkJson(const std::string& filename, const BenchmarkSettings& settings, const std::vector<BenchmarkResult>& results)
+{
+    std::ofstream file(filename);
+    if(!file)
+        return false;
+    file << "{\n"
+         << "  \"width\": " << settings.width << ",\n"
+         << "  \"height\": " << settings.height << ",\n"
+         << "  \"spp\": " << settings.samplesPerPixel << ",\n"
+         << "  \"maxDepth\": " << settings.maxDepth << ",\n"
+         << "  \"seed\": " << settings.seed << ",\n"
+         << "  \"threads\": " << settings.threads << ",\n"
+         << "  \"numaNodes\": " << settings.numaNodes << ",\n"
+         << "  \"scenes\": [";
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchmarkResult& result = results[i];
+        double seconds                = result.GetBestSeconds();
+        double samples                = (double)settings.width * settings.height * settings.samplesPerPixel;
+        file << (i == 0 ? "\n" : ",\n")
+             << "    {\n"
+             << "      \"name\": \"" << result.scene << "\",\n"
+             << "      \"buildMs\": " << result.buildSeconds * 1000.0 << ",\n"
+             << "      \"bvhBuildMs\": " << result.bvhBuildSeconds * 1000.0 << ",\n"
+             << "      \"sceneBytes\": " << result.sceneBytes << ",\n"
+             << "      \"peakMemoryBytes\": " << result.peakMemoryBytes << ",\n"
+             << "      \"rays\": " << result.rays << ",\n"
+             << "      \"renderSeconds\": [";
+        for(size_t r = 0; r < result.renderSeconds.size(); ++r)
+            file << (r == 0 ? "" : ", ") << result.renderSeconds[r];
+        file << "],\n"
+             << "      \"bestSeconds\": " << seconds << ",\n"
+             << "      \"medianSeconds\": " << result.GetMedianSeconds() << ",\n"
+             << "      \"mraysPerSecond\": " << result.rays / seconds / 1e6 << ",\n"
+             << "      \"samplesPerSecond\": " << samples / seconds << "\n"
+             << "    }";
+    }
+    file << "\n  ]\n}\n";
+    return file.good();
+}
@@ -3,10 +3,10 @@
 
 #include "AABB.h"
 #include "Hittable.h"
-#include "HittableList.h"
-#include <vector>
 #include "Allocator.hpp"
+#include "PrimitiveLeaves.hpp"
 #include "Quad.hpp"
+#include "Stats.hpp"
 
 class Box : public Hittable
 {
@@ -17,16 +17,17 @@ public:
         glm::vec3 dy = glm::vec3(0, max.y - min.y, 0);
         glm::vec3 dz = glm::vec3(0, 0, max.z - min.z);
 
-        m_list.Add(g_shapeAllocator.Allocate<Quad>(min, dz, dy, mat));                              // left
-        m_list.Add(g_shapeAllocator.Allocate<Quad>(min, dx, dz, mat));                              // bottom
-        m_list.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(min.x, max.y, max.z), dx, -dz, mat));  // top
-        m_list.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(max.x, min.y, max.z), -dz, dy, mat));  // right
-        m_list.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(max.x, min.y, min.z), -dx, dy, mat));  // back
-        m_list.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(min.x, min.y, max.z), dx, dy, mat));   // front
+        m_quads.Add(g_shapeAllocator.Allocate<Quad>(min, dz, dy, mat));                              // left
+        m_quads.Add(g_shapeAllocator.Allocate<Quad>(min, dx, dz, mat));                              // bottom
+        m_quads.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(min.x, max.y, max.z), dx, -dz, mat));  // top
+        m_quads.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(max.x, min.y, max.z), -dz, dy, mat));  // right
+        m_quads.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(max.x, min.y, min.z), -dx, dy, mat));  // back
+        m_quads.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(min.x, min.y, max.z), dx, dy, mat));   // front
     }
     bool Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const override
     {
-        return m_list.Hit(r, tMin, tMax, outRecord);
+        STATS_COUNT(primitiveTests[PRIMITIVE_BOX]);
+        return m_quads.HitQuads(r, tMin, tMax, outRecord);
     }
     bool BoundingBox(AABB& outAABB) const override
     {
@@ -36,7 +37,7 @@ public:
 
 private:
     glm::vec3 m_min, m_max;
-    HittableList m_list;
+    QuadLeaf m_quads;  // the 6 sides
     Material* m_material;
 };
 
@@ -21,7 +21,9 @@ public:
         m_vertical   = focusDist * viewPortHeight * m_v;
         m_bottomLeft = m_origin - m_horizontal / 2.0f - m_vertical / 2.0f - focusDist * m_w;
 
-        m_lensRadius = aperture / 2;
+        m_lensRadius     = aperture / 2;
+        m_viewPortWidth  = viewPortWidth;
+        m_viewPortHeight = viewPortHeight;
     }
 
     Ray GetRay(float u, float v) const
@@ -32,6 +34,25 @@ public:
         return Ray(m_origin + offset, m_bottomLeft + u * m_horizontal + v * m_vertical - m_origin - offset);
     }
 
+    glm::vec3 GetOrigin() const { return m_origin; }
+
+    // Normalized direction of the ray through (u, v) from the center of the lens
+    glm::vec3 GetCenterDirection(float u, float v) const
+    {
+        return glm::normalize(m_bottomLeft + u * m_horizontal + v * m_vertical - m_origin);
+    }
+
+    // Inverse of GetCenterDirection(), false for points behind the camera
+    bool Project(const glm::vec3& point, glm::vec2& uv) const
+    {
+        glm::vec3 d = point - m_origin;
+        float z     = -glm::dot(d, m_w);
+        if(z <= 0.0f)
+            return false;
+        uv = glm::vec2(glm::dot(d, m_u) / (z * m_viewPortWidth), glm::dot(d, m_v) / (z * m_viewPortHeight)) + 0.5f;
+        return true;
+    }
+
 private:
     glm::vec3 m_origin;
     glm::vec3 m_horizontal;
@@ -39,6 +60,8 @@ private:
     glm::vec3 m_bottomLeft;
     glm::vec3 m_u, m_v, m_w;
     float m_lensRadius;
+    float m_viewPortWidth;
+    float m_viewPortHeight;
 };
 
 #endif
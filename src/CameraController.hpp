@@ -0,0 +1,65 @@
+#pragma once
+#include <algorithm>
+#include "glm/glm.hpp"
+#include "Camera.h"
+#include "Scenes.hpp"
+
+// Camera motion accumulated by the input handling between two passes
+struct CameraInput
+{
+    glm::vec3 move   = glm::vec3(0);  // right, up, forward, in units of the scene's camera distance
+    glm::vec2 rotate = glm::vec2(0);  // yaw and pitch in degrees
+
+    bool IsZero() const { return move == glm::vec3(0) && rotate == glm::vec2(0); }
+    void Add(const CameraInput& other)
+    {
+        move   += other.move;
+        rotate += other.rotate;
+    }
+};
+
+// First person fly camera starting from the scene's camera, the lens settings stay the scene's
+class CameraController
+{
+public:
+    CameraController(const Scene& scene, float aspectRatio)
+        : m_position(scene.camPos), m_vFOV(scene.vFOV), m_aspectRatio(aspectRatio), m_aperture(scene.aperture),
+          m_focusDist(scene.focusDist), m_scale(glm::length(scene.lookAt - scene.camPos))
+    {
+        glm::vec3 forward = glm::normalize(scene.lookAt - scene.camPos);
+        m_yaw             = glm::degrees(std::atan2(forward.x, forward.z));
+        m_pitch           = glm::degrees(std::asin(forward.y));
+    }
+
+    void Apply(const CameraInput& input)
+    {
+        m_yaw   += input.rotate.x;
+        m_pitch  = std::clamp(m_pitch + input.rotate.y, -89.0f, 89.0f);
+
+        glm::vec3 forward = GetForward();
+        glm::vec3 right   = glm::normalize(glm::cross(forward, glm::vec3(0, 1, 0)));
+        m_position       += m_scale * (input.move.x * right + input.move.y * glm::vec3(0, 1, 0) + input.move.z * forward);
+    }
+
+    Camera GetCamera() const
+    {
+        return Camera(m_position, m_position + GetForward(), glm::vec3(0, 1, 0), m_vFOV, m_aspectRatio, m_aperture, m_focusDist);
+    }
+
+private:
+    glm::vec3 GetForward() const
+    {
+        float yaw   = glm::radians(m_yaw);
+        float pitch = glm::radians(m_pitch);
+        return glm::vec3(std::cos(pitch) * std::sin(yaw), std::sin(pitch), std::cos(pitch) * std::cos(yaw));
+    }
+
+    glm::vec3 m_position;
+    float m_yaw;
+    float m_pitch;
+    float m_vFOV;
+    float m_aspectRatio;
+    float m_aperture;
+    float m_focusDist;
+    float m_scale;  // distance from the scene's camera to what it looks at, sets the movement speed
+};
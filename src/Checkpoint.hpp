@@ -0,0 +1,191 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include "3DMath/Random.h"
+#include "Framebuffer.hpp"
+#include "Profiler.hpp"
+#include "System.hpp"
+
+// Checkpoint files hold the raw accumulation buffer of a render so it can be resumed or merged with
+// renders from other machines. The layout is a CheckpointHeader followed by the red, green and blue
+// sums and the per-pixel sample counts, width * height values each, row by row.
+
+#define CHECKPOINT_MAGIC   "RTCKPT\0\0"
+#define CHECKPOINT_VERSION 1
+
+struct CheckpointInfo
+{
+    std::string scene;
+    uint32_t width           = 0;
+    uint32_t height          = 0;
+    int maxDepth             = 0;
+    uint32_t samplesPerPixel = 0;  // nominal total, individual pixels have their own count
+    // Every row of a pass reseeds from (seed, pass, row), so these two are all the RNG state there is:
+    // resuming continues the exact random sequence an uninterrupted render would have used
+    uint64_t seed   = 0;
+    uint32_t passes = 0;
+};
+
+struct CheckpointHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t passes;
+    uint64_t seed;
+    uint32_t samplesPerPixel;
+    int32_t maxDepth;
+    char scene[32];
+};
+static_assert(sizeof(CheckpointHeader) == 72, "the header is written as is");
+
+// Written to path.tmp through a file mapping and then renamed over path, so a crash while
+// checkpointing never destroys the previous checkpoint
+inline bool WriteCheckpoint(const std::string& path, const Framebuffer& framebuffer, const CheckpointInfo& info)
+{
+    PROFILE_SCOPE("WriteCheckpoint");
+    uint32_t width    = framebuffer.GetWidth();
+    uint32_t height   = framebuffer.GetHeight();
+    size_t pixelCount = (size_t)width * height;
+    std::string tmp   = path + ".tmp";
+    MappedFile file;
+    if(!file.Open(tmp, sizeof(CheckpointHeader) + pixelCount * 4 * sizeof(float)))
+    {
+        std::cerr << "ERROR: Couldn't create checkpoint " << tmp << std::endl;
+        return false;
+    }
+
+    CheckpointHeader header = {};
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version         = CHECKPOINT_VERSION;
+    header.width           = width;
+    header.height          = height;
+    header.passes          = info.passes;
+    header.seed            = info.seed;
+    header.samplesPerPixel = info.samplesPerPixel;
+    header.maxDepth        = info.maxDepth;
+    std::strncpy(header.scene, info.scene.c_str(), sizeof(header.scene) - 1);
+
+    char* data = static_cast<char*>(file.Data());
+    std::memcpy(data, &header, sizeof(header));
+    float* red       = reinterpret_cast<float*>(data + sizeof(header));
+    float* green     = red + pixelCount;
+    float* blue      = green + pixelCount;
+    uint32_t* counts = reinterpret_cast<uint32_t*>(blue + pixelCount);
+    for(uint32_t y = 0; y < height; ++y)
+    {
+        for(uint32_t x = 0; x < width; ++x)
+        {
+            size_t i      = (size_t)y * width + x;
+            glm::vec3 sum = framebuffer.GetSum(x, y);
+            red[i]        = sum.r;
+            green[i]      = sum.g;
+            blue[i]       = sum.b;
+            counts[i]     = framebuffer.GetSampleCount(x, y);
+        }
+    }
+
+    bool flushed = file.Flush();
+    file.Close();
+    std::error_code error;
+    std::filesystem::rename(tmp, path, error);
+    if(!flushed || error)
+    {
+        std::cerr << "ERROR: Couldn't write checkpoint " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Maps path and checks that the header is valid and the file is complete
+inline const CheckpointHeader* MapCheckpoint(const std::string& path, MappedFile& file)
+{
+    if(!file.Open(path, 0))
+    {
+        std::cerr << "ERROR: Couldn't open checkpoint " << path << std::endl;
+        return nullptr;
+    }
+    const CheckpointHeader* header = static_cast<const CheckpointHeader*>(file.Data());
+    if(file.Size() < sizeof(CheckpointHeader) || std::memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0 ||
+       header->version != CHECKPOINT_VERSION)
+    {
+        std::cerr << "ERROR: " << path << " isn't a checkpoint of this version" << std::endl;
+        return nullptr;
+    }
+    if(file.Size() != sizeof(CheckpointHeader) + (size_t)header->width * header->height * 4 * sizeof(float))
+    {
+        std::cerr << "ERROR: Checkpoint " << path << " is truncated" << std::endl;
+        return nullptr;
+    }
+    return header;
+}
+
+inline bool ReadCheckpointInfo(const std::string& path, CheckpointInfo& info)
+{
+    MappedFile file;
+    const CheckpointHeader* header = MapCheckpoint(path, file);
+    if(!header)
+        return false;
+    info.scene           = std::string(header->scene, strnlen(header->scene, sizeof(header->scene)));
+    info.width           = header->width;
+    info.height          = header->height;
+    info.maxDepth        = header->maxDepth;
+    info.samplesPerPixel = header->samplesPerPixel;
+    info.seed            = header->seed;
+    info.passes          = header->passes;
+    return true;
+}
+
+// Adds the samples of the checkpoint to framebuffer, which has to have the same size.
+// Merging several checkpoints this way weights every pixel by its sample count.
+inline bool AccumulateCheckpoint(const std::string& path, Framebuffer& framebuffer)
+{
+    MappedFile file;
+    const CheckpointHeader* header = MapCheckpoint(path, file);
+    if(!header)
+        return false;
+    if(header->width != framebuffer.GetWidth() || header->height != framebuffer.GetHeight())
+    {
+        std::cerr << "ERROR: Checkpoint " << path << " is " << header->width << "x" << header->height << ", expected "
+                  << framebuffer.GetWidth() << "x" << framebuffer.GetHeight() << std::endl;
+        return false;
+    }
+
+    size_t pixelCount      = (size_t)header->width * header->height;
+    const float* red       = reinterpret_cast<const float*>(header + 1);
+    const float* green     = red + pixelCount;
+    const float* blue      = green + pixelCount;
+    const uint32_t* counts = reinterpret_cast<const uint32_t*>(blue + pixelCount);
+    for(uint32_t y = 0; y < header->height; ++y)
+    {
+        for(uint32_t x = 0; x < header->width; ++x)
+        {
+            size_t i = (size_t)y * header->width + x;
+            framebuffer.AddSamples(x, y, glm::vec3(red[i], green[i], blue[i]), counts[i]);
+        }
+    }
+    return true;
+}
+
+// Combines the info of two checkpoints of the same render. The merged render continues from a seed
+// derived from both so it doesn't replay the random sequence of either input.
+inline bool MergeCheckpointInfo(CheckpointInfo& merged, const CheckpointInfo& other, const std::string& path)
+{
+    if(merged.scene != other.scene || merged.width != other.width || merged.height != other.height || merged.maxDepth != other.maxDepth)
+    {
+        std::cerr << "ERROR: Checkpoint " << path << " is from a different render (" << other.scene << " " << other.width << "x"
+                  << other.height << ", depth " << other.maxDepth << ")" << std::endl;
+        return false;
+    }
+    if(merged.seed == other.seed)
+        std::cerr << "WARNING: Checkpoint " << path << " used the same seed, its samples aren't independent" << std::endl;
+
+    merged.samplesPerPixel += other.samplesPerPixel;
+    merged.passes          += other.passes;
+    merged.seed             = math::MixSeed(merged.seed, other.seed);
+    return true;
+}
@@ -0,0 +1,417 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "glm/glm.hpp"
+#include "Framebuffer.hpp"
+#include "System.hpp"
+#include "WorkerPool.hpp"
+
+// Edge-avoiding a-trous wavelet filter: DENOISE_ITERATIONS passes of a 3x3 B3 spline kernel whose taps are
+// 1, 2, 4, ... pixels apart, so the footprint grows to 2^iterations - 1 pixels each way while every pass
+// only reads 9 pixels. A tap is weighted down the more its normal, depth, albedo and luminance differ from
+// the center's, which keeps the filter from blurring across edges. Luminance differences are measured in
+// standard deviations of the noise, estimated from the neighbourhood and filtered along with the color, so
+// noisy images are smoothed harder than converged ones.
+#define DENOISE_ITERATIONS      5
+#define DENOISE_VARIANCE_RADIUS 2      // of the window the noise is estimated in
+#define DENOISE_LUMINANCE_SIGMA 8.0f   // in standard deviations of the noise
+#define DENOISE_NORMAL_SIGMA    0.3f   // of the distance between the unit normals
+#define DENOISE_DEPTH_SIGMA     0.02f  // of the relative depth difference per pixel of tap distance
+#define DENOISE_ALBEDO_SIGMA    0.1f
+
+#ifdef FRAMEBUFFER_SIMD
+// The vector operations of the filter, 8 pixels wide where AVX2 is available and 4 wide otherwise
+struct DenoiserSimd
+{
+#ifdef __AVX2__
+    using Floats                    = __m256;
+    static constexpr uint32_t WIDTH = 8;
+
+    static Floats Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, Floats a) { _mm256_storeu_ps(p, a); }
+    static Floats Set(float f) { return _mm256_set1_ps(f); }
+    static Floats Add(Floats a, Floats b) { return _mm256_add_ps(a, b); }
+    static Floats Sub(Floats a, Floats b) { return _mm256_sub_ps(a, b); }
+    static Floats Mul(Floats a, Floats b) { return _mm256_mul_ps(a, b); }
+    static Floats Div(Floats a, Floats b) { return _mm256_div_ps(a, b); }
+    static Floats Max(Floats a, Floats b) { return _mm256_max_ps(a, b); }
+    static Floats Sqrt(Floats a) { return _mm256_sqrt_ps(a); }
+    static Floats And(Floats a, Floats b) { return _mm256_and_ps(a, b); }
+    static Floats GreaterThan(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static Floats Floor(Floats a) { return _mm256_floor_ps(a); }
+    // 2^i for whole numbers i in [-126, 127]
+    static Floats Exp2(Floats i) { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(i), _mm256_set1_epi32(127)), 23)); }
+#else
+    using Floats                    = __m128;
+    static constexpr uint32_t WIDTH = 4;
+
+    static Floats Load(const float* p) { return _mm_loadu_ps(p); }
+    static void Store(float* p, Floats a) { _mm_storeu_ps(p, a); }
+    static Floats Set(float f) { return _mm_set1_ps(f); }
+    static Floats Add(Floats a, Floats b) { return _mm_add_ps(a, b); }
+    static Floats Sub(Floats a, Floats b) { return _mm_sub_ps(a, b); }
+    static Floats Mul(Floats a, Floats b) { return _mm_mul_ps(a, b); }
+    static Floats Div(Floats a, Floats b) { return _mm_div_ps(a, b); }
+    static Floats Max(Floats a, Floats b) { return _mm_max_ps(a, b); }
+    static Floats Sqrt(Floats a) { return _mm_sqrt_ps(a); }
+    static Floats And(Floats a, Floats b) { return _mm_and_ps(a, b); }
+    static Floats GreaterThan(Floats a, Floats b) { return _mm_cmpgt_ps(a, b); }
+    static Floats Floor(Floats a)
+    {
+        // SSE2 only truncates, which rounds negative numbers up
+        Floats truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+        return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a), _mm_set1_ps(1.0f)));
+    }
+    static Floats Exp2(Floats i) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(i), _mm_set1_epi32(127)), 23)); }
+#endif
+    static Floats Abs(Floats a) { return And(a, Set(std::bit_cast<float>(0x7FFFFFFFu))); }
+
+    // exp(-x) for x >= 0 as 2^(-x * log2(e)): the whole part goes into the exponent bits, a polynomial does
+    // the fraction. Relative error around 1e-7, results below 2^-126 are flushed to 0.
+    static Floats ExpNegative(Floats x)
+    {
+        Floats t = Max(Mul(x, Set(-1.44269504f)), Set(-126.0f));
+        Floats i = Floor(t);
+        Floats f = Sub(t, i);
+
+        Floats p = Set(1.33335581e-3f);
+        p        = Add(Mul(p, f), Set(9.61812911e-3f));
+        p        = Add(Mul(p, f), Set(5.55041087e-2f));
+        p        = Add(Mul(p, f), Set(2.40226507e-1f));
+        p        = Add(Mul(p, f), Set(6.93147180e-1f));
+        p        = Add(Mul(p, f), Set(1.0f));
+        return And(Mul(p, Exp2(i)), GreaterThan(t, Set(-126.0f)));
+    }
+};
+#endif
+
+// Filters the average color of a framebuffer before tone mapping. What gets filtered is the color divided
+// by the albedo of the first hit, the light arriving at the surface, which stays smooth across texture
+// detail, and multiplying the albedo back in afterwards keeps the texture sharp.
+class Denoiser
+{
+public:
+    Denoiser(uint32_t width, uint32_t height)
+        : m_width(width), m_height(height), m_stride((width + 15) & ~15u), m_planeSize((size_t)m_stride * height + PLANE_PADDING),
+          m_planes(m_planeSize * PLANE_COUNT), m_output(width, height)
+    {
+    }
+
+    // Denoises and resolves framebuffer into out like Framebuffer::Resolve(), with the same tone mapping.
+    // Runs on the calling thread if workers is null.
+    void Resolve(const Framebuffer& framebuffer, WorkerPool* workers, PixelFormat format, uint32_t* out, const ResolveSettings& settings)
+    {
+        PROFILE_SCOPE("Denoise and resolve");
+        auto forEachRow = [&](const std::function<void(size_t)>& func)
+        {
+            if(workers)
+                workers->ParallelFor(m_height, func);
+            else
+                for(size_t y = 0; y < m_height; ++y)
+                    func(y);
+        };
+
+        forEachRow([&](size_t y)
+                   { LoadRow(framebuffer, y); });
+        forEachRow([&](size_t y)
+                   { EstimateVarianceRow(y); });
+        int source = COLOR;
+        for(int i = 0; i < DENOISE_ITERATIONS; ++i)
+        {
+            int target = source == COLOR ? FILTERED : COLOR;
+            forEachRow([&](size_t y)
+                       { FilterRow(y, 1u << i, source, target); });
+            source = target;
+        }
+        forEachRow([&](size_t y)
+                   {
+            StoreRow(framebuffer, y, source);
+            m_output.ResolveRow(y, format, out + y * m_width, settings); });
+    }
+
+private:
+    enum Plane
+    {
+        COLOR    = 0,  // red, green, blue and the variance of the luminance
+        FILTERED = 4,  // the same, ping-ponged with COLOR between the iterations
+        ALBEDO   = 8,
+        NORMAL   = 11,
+        DEPTH    = 14,
+        WEIGHT   = 15,  // 1 for pixels with samples, 0 for empty ones
+        PLANE_COUNT,
+    };
+    static constexpr int VARIANCE = 3;  // offset in the color planes
+
+    float* Row(int plane, size_t y) { return &m_planes[plane * m_planeSize + y * m_stride]; }
+
+    void LoadRow(const Framebuffer& framebuffer, size_t y)
+    {
+        float* color[3]  = {Row(COLOR, y), Row(COLOR + 1, y), Row(COLOR + 2, y)};
+        float* albedo[3] = {Row(ALBEDO, y), Row(ALBEDO + 1, y), Row(ALBEDO + 2, y)};
+        float* normal[3] = {Row(NORMAL, y), Row(NORMAL + 1, y), Row(NORMAL + 2, y)};
+        float* depth     = Row(DEPTH, y);
+        float* weight    = Row(WEIGHT, y);
+        for(uint32_t x = 0; x < m_width; ++x)
+        {
+            glm::vec3 a = glm::max(framebuffer.GetAlbedo(x, y), glm::vec3(MIN_ALBEDO));
+            glm::vec3 n = framebuffer.GetNormal(x, y);
+            glm::vec3 c = framebuffer.GetAverage(x, y) / a;
+            for(int i = 0; i < 3; ++i)
+            {
+                color[i][x]  = c[i];
+                albedo[i][x] = a[i];
+                normal[i][x] = n[i];
+            }
+            // a finite stand in for the background keeps the depth differences free of NaNs
+            depth[x]  = std::min(framebuffer.GetDepth(x, y), MAX_DEPTH);
+            weight[x] = framebuffer.GetSampleCount(x, y) > 0 ? 1.0f : 0.0f;
+        }
+        // the padding is read by the vectorized filter but never weighted in
+        for(int plane = 0; plane < PLANE_COUNT; ++plane)
+            std::fill(Row(plane, y) + m_width, Row(plane, y) + m_stride, 0.0f);
+    }
+
+    // The spread of the luminance around the pixel, standing in for the noise of its average
+    void EstimateVarianceRow(size_t y)
+    {
+        // sums, square sums and counts of every column of the window first, the window is then the sum of its columns
+        std::vector<float> columns(3 * m_width, 0.0f);
+        float* sum          = &columns[0];
+        float* squareSum    = &columns[m_width];
+        float* count        = &columns[2 * m_width];
+        const size_t firstY = y >= DENOISE_VARIANCE_RADIUS ? y - DENOISE_VARIANCE_RADIUS : 0;
+        const size_t endY   = std::min<size_t>(y + DENOISE_VARIANCE_RADIUS + 1, m_height);
+        for(size_t tapY = firstY; tapY < endY; ++tapY)
+        {
+            const float* red    = Row(COLOR, tapY);
+            const float* green  = Row(COLOR + 1, tapY);
+            const float* blue   = Row(COLOR + 2, tapY);
+            const float* weight = Row(WEIGHT, tapY);
+            for(uint32_t x = 0; x < m_width; ++x)
+            {
+                float luminance  = Luminance(red[x], green[x], blue[x]);
+                sum[x]          += weight[x] * luminance;
+                squareSum[x]    += weight[x] * luminance * luminance;
+                count[x]        += weight[x];
+            }
+        }
+
+        float* variance = Row(COLOR + VARIANCE, y);
+        for(uint32_t x = 0; x < m_width; ++x)
+        {
+            const uint32_t firstX = x >= DENOISE_VARIANCE_RADIUS ? x - DENOISE_VARIANCE_RADIUS : 0;
+            const uint32_t endX   = std::min<uint32_t>(x + DENOISE_VARIANCE_RADIUS + 1, m_width);
+            float windowSum       = 0.0f;
+            float windowSquareSum = 0.0f;
+            float windowCount     = 0.0f;
+            for(uint32_t column = firstX; column < endX; ++column)
+            {
+                windowSum       += sum[column];
+                windowSquareSum += squareSum[column];
+                windowCount     += count[column];
+            }
+            float mean  = windowSum / windowCount;
+            variance[x] = windowCount > 1.0f ? std::max(windowSquareSum / windowCount - mean * mean, 0.0f) : 0.0f;
+        }
+    }
+
+    void StoreRow(const Framebuffer& framebuffer, size_t y, int source)
+    {
+        const float* color[3]  = {Row(source, y), Row(source + 1, y), Row(source + 2, y)};
+        const float* albedo[3] = {Row(ALBEDO, y), Row(ALBEDO + 1, y), Row(ALBEDO + 2, y)};
+        m_output.ClearRow(y);
+        for(uint32_t x = 0; x < m_width; ++x)
+        {
+            if(framebuffer.GetSampleCount(x, y) == 0)
+                continue;
+            glm::vec3 c(color[0][x] * albedo[0][x], color[1][x] * albedo[1][x], color[2][x] * albedo[2][x]);
+            m_output.AddSamples(x, y, c, 1);
+        }
+    }
+
+    // The planes of one row
+    struct Rows
+    {
+        const float* color[4];  // with the variance
+        const float* albedo[3];
+        const float* normal[3];
+        const float* depth;
+        const float* weight;
+    };
+    Rows GetRows(size_t y, int colorPlane)
+    {
+        Rows rows;
+        for(int i = 0; i < 4; ++i)
+            rows.color[i] = Row(colorPlane + i, y);
+        for(int i = 0; i < 3; ++i)
+        {
+            rows.albedo[i] = Row(ALBEDO + i, y);
+            rows.normal[i] = Row(NORMAL + i, y);
+        }
+        rows.depth  = Row(DEPTH, y);
+        rows.weight = Row(WEIGHT, y);
+        return rows;
+    }
+
+    // One a-trous pass over row y with taps step pixels apart, from the source color planes to the target ones
+    void FilterRow(size_t y, uint32_t step, int source, int target)
+    {
+        // the rows of the kernel that are inside the image
+        Rows taps[KERNEL_SIZE];
+        float rowKernel[KERNEL_SIZE];
+        int rowCount = 0;
+        for(int ky = 0; ky < KERNEL_SIZE; ++ky)
+        {
+            int64_t tapY = (int64_t)y + (int64_t)(ky - KERNEL_RADIUS) * step;
+            if(tapY < 0 || tapY >= m_height)
+                continue;
+            taps[rowCount]      = GetRows(tapY, source);
+            rowKernel[rowCount] = KERNEL[ky];
+            ++rowCount;
+        }
+        const Rows center = GetRows(y, source);
+        float* out[4]     = {Row(target, y), Row(target + 1, y), Row(target + 2, y), Row(target + VARIANCE, y)};
+
+        uint32_t x = 0;
+#ifdef FRAMEBUFFER_SIMD
+        // a vector of pixels at a time where all their taps are inside the image, the scalar path does the borders
+        const uint32_t reach = KERNEL_RADIUS * step;
+        for(; x < reach && x < m_width; ++x)
+            FilterPixel(center, taps, rowKernel, rowCount, x, step, out);
+        for(; x + DenoiserSimd::WIDTH + reach <= m_width; x += DenoiserSimd::WIDTH)
+            FilterPixels(center, taps, rowKernel, rowCount, x, step, out);
+#endif
+        for(; x < m_width; ++x)
+            FilterPixel(center, taps, rowKernel, rowCount, x, step, out);
+    }
+
+    // Scalar reference for FilterPixels()
+    void FilterPixel(const Rows& center, const Rows* taps, const float* rowKernel, int rowCount, uint32_t x, uint32_t step,
+                     float* const* out) const
+    {
+        const float luminance  = Luminance(center.color[0][x], center.color[1][x], center.color[2][x]);
+        const float invColor   = 1.0f / (DENOISE_LUMINANCE_SIGMA * std::sqrt(center.color[VARIANCE][x]) + 1e-4f);
+        const float invDepth   = 1.0f / (DENOISE_DEPTH_SIGMA * step * std::max(center.depth[x], 1e-3f));
+        const float invNormal  = 1.0f / (DENOISE_NORMAL_SIGMA * DENOISE_NORMAL_SIGMA);
+        const float invAlbedo  = 1.0f / (DENOISE_ALBEDO_SIGMA * DENOISE_ALBEDO_SIGMA);
+        float sum[4]           = {};
+        float weightSum        = 0.0f;
+        for(int r = 0; r < rowCount; ++r)
+        {
+            const Rows& tap = taps[r];
+            for(int kx = 0; kx < KERNEL_SIZE; ++kx)
+            {
+                int64_t tapX = (int64_t)x + (int64_t)(kx - KERNEL_RADIUS) * step;
+                if(tapX < 0 || tapX >= m_width)
+                    continue;
+                float color[3] = {tap.color[0][tapX], tap.color[1][tapX], tap.color[2][tapX]};
+                float normalDifference = 0.0f;
+                float albedoDifference = 0.0f;
+                for(int i = 0; i < 3; ++i)
+                {
+                    float n           = tap.normal[i][tapX] - center.normal[i][x];
+                    float a           = tap.albedo[i][tapX] - center.albedo[i][x];
+                    normalDifference += n * n;
+                    albedoDifference += a * a;
+                }
+                float cost = std::abs(Luminance(color[0], color[1], color[2]) - luminance) * invColor + normalDifference * invNormal +
+                             std::abs(tap.depth[tapX] - center.depth[x]) * invDepth + albedoDifference * invAlbedo;
+                float weight  = rowKernel[r] * KERNEL[kx] * tap.weight[tapX] * std::exp(-cost);
+                sum[0]       += weight * color[0];
+                sum[1]       += weight * color[1];
+                sum[2]       += weight * color[2];
+                sum[3]       += weight * weight * tap.color[VARIANCE][tapX];
+                weightSum    += weight;
+            }
+        }
+        // empty pixels stay empty, the others weigh at least their own tap so the sum can't get tiny
+        float invWeightSum = center.weight[x] > 0.0f ? 1.0f / weightSum : 0.0f;
+        for(int i = 0; i < 3; ++i)
+            out[i][x] = sum[i] * invWeightSum;
+        out[VARIANCE][x] = sum[3] * invWeightSum * invWeightSum;
+    }
+
+#ifdef FRAMEBUFFER_SIMD
+    // FilterPixel() for the DenoiserSimd::WIDTH pixels from x on, all of their taps have to be inside the image
+    void FilterPixels(const Rows& center, const Rows* taps, const float* rowKernel, int rowCount, uint32_t x, uint32_t step,
+                      float* const* out) const
+    {
+        using S          = DenoiserSimd;
+        using Floats     = S::Floats;
+        auto luminance   = [](Floats r, Floats g, Floats b)
+        {
+            return S::Add(S::Add(S::Mul(r, S::Set(0.2126f)), S::Mul(g, S::Set(0.7152f))), S::Mul(b, S::Set(0.0722f)));
+        };
+        auto difference = [](Floats a, Floats b)
+        {
+            Floats d = S::Sub(a, b);
+            return S::Mul(d, d);
+        };
+
+        const Floats zero            = S::Set(0.0f);
+        const Floats invNormal       = S::Set(1.0f / (DENOISE_NORMAL_SIGMA * DENOISE_NORMAL_SIGMA));
+        const Floats invAlbedo       = S::Set(1.0f / (DENOISE_ALBEDO_SIGMA * DENOISE_ALBEDO_SIGMA));
+        const Floats centerNormal[3] = {S::Load(center.normal[0] + x), S::Load(center.normal[1] + x), S::Load(center.normal[2] + x)};
+        const Floats centerAlbedo[3] = {S::Load(center.albedo[0] + x), S::Load(center.albedo[1] + x), S::Load(center.albedo[2] + x)};
+        const Floats centerDepth     = S::Load(center.depth + x);
+        const Floats centerLuminance = luminance(S::Load(center.color[0] + x), S::Load(center.color[1] + x), S::Load(center.color[2] + x));
+        const Floats invColor        = S::Div(S::Set(1.0f), S::Add(S::Mul(S::Set(DENOISE_LUMINANCE_SIGMA), S::Sqrt(S::Load(center.color[VARIANCE] + x))),
+                                                                   S::Set(1e-4f)));
+        const Floats invDepth        = S::Div(S::Set(1.0f / (DENOISE_DEPTH_SIGMA * step)), S::Max(centerDepth, S::Set(1e-3f)));
+
+        Floats sum[4]    = {zero, zero, zero, zero};
+        Floats weightSum = zero;
+        for(int r = 0; r < rowCount; ++r)
+        {
+            const Rows& tap = taps[r];
+            for(int kx = 0; kx < KERNEL_SIZE; ++kx)
+            {
+                const size_t tapX = x + (kx - KERNEL_RADIUS) * (int64_t)step;
+                Floats color[3]   = {S::Load(tap.color[0] + tapX), S::Load(tap.color[1] + tapX), S::Load(tap.color[2] + tapX)};
+                Floats cost       = S::Mul(S::Abs(S::Sub(luminance(color[0], color[1], color[2]), centerLuminance)), invColor);
+                cost              = S::Add(cost, S::Mul(S::Abs(S::Sub(S::Load(tap.depth + tapX), centerDepth)), invDepth));
+                Floats normal     = zero;
+                Floats albedo     = zero;
+                for(int i = 0; i < 3; ++i)
+                {
+                    normal = S::Add(normal, difference(S::Load(tap.normal[i] + tapX), centerNormal[i]));
+                    albedo = S::Add(albedo, difference(S::Load(tap.albedo[i] + tapX), centerAlbedo[i]));
+                }
+                cost          = S::Add(cost, S::Add(S::Mul(normal, invNormal), S::Mul(albedo, invAlbedo)));
+                Floats weight = S::Mul(S::Set(rowKernel[r] * KERNEL[kx]), S::Mul(S::Load(tap.weight + tapX), S::ExpNegative(cost)));
+
+                for(int i = 0; i < 3; ++i)
+                    sum[i] = S::Add(sum[i], S::Mul(weight, color[i]));
+                sum[3]    = S::Add(sum[3], S::Mul(S::Mul(weight, weight), S::Load(tap.color[VARIANCE] + tapX)));
+                weightSum = S::Add(weightSum, weight);
+            }
+        }
+        Floats invWeightSum = S::And(S::Div(S::Set(1.0f), weightSum), S::GreaterThan(S::Load(center.weight + x), zero));
+        for(int i = 0; i < 3; ++i)
+            S::Store(out[i] + x, S::Mul(sum[i], invWeightSum));
+        S::Store(out[VARIANCE] + x, S::Mul(sum[3], S::Mul(invWeightSum, invWeightSum)));
+    }
+#endif
+
+    static float Luminance(float r, float g, float b) { return 0.2126f * r + 0.7152f * g + 0.0722f * b; }
+
+    // planes a whole number of pages apart would compete for the same cache sets
+    static constexpr size_t PLANE_PADDING = 64;
+    static constexpr float MIN_ALBEDO     = 0.01f;
+    static constexpr float MAX_DEPTH      = 1e6f;
+    // 5x5 taps filter about as well, 3x3 is almost 3 times cheaper
+    static constexpr int KERNEL_RADIUS         = 1;
+    static constexpr int KERNEL_SIZE           = 2 * KERNEL_RADIUS + 1;
+    static constexpr float KERNEL[KERNEL_SIZE] = {1.0f / 4, 1.0f / 2, 1.0f / 4};
+
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_stride;
+    size_t m_planeSize;
+    PageArray<float> m_planes;
+    Framebuffer m_output;  // the filtered color as a single sample per pixel, for the resolve
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Triple buffer that hands resolved frames from the render thread to the display thread without either
+// of them ever waiting for the other: the render thread resolves into the back buffer and publishes it,
+// the display thread swaps in the newest published frame whenever it presents.
+class DisplayBuffers
+{
+public:
+    explicit DisplayBuffers(size_t pixelCount)
+    {
+        for(auto& buffer : m_buffers)
+            buffer.assign(pixelCount, 0xFF000000);
+    }
+
+    // Render thread side
+    uint32_t* GetBackBuffer() { return m_buffers[m_back].data(); }
+    void Publish()
+    {
+        std::lock_guard lock(m_mutex);
+        std::swap(m_back, m_ready);
+        m_hasNewFrame = true;
+    }
+    // True while the last published frame hasn't been presented yet, resolving again would be wasted work
+    bool IsFramePending()
+    {
+        std::lock_guard lock(m_mutex);
+        return m_hasNewFrame;
+    }
+
+    // Display thread side, stays valid until the next call
+    const uint32_t* GetFrontBuffer()
+    {
+        std::lock_guard lock(m_mutex);
+        if(m_hasNewFrame)
+        {
+            std::swap(m_front, m_ready);
+            m_hasNewFrame = false;
+        }
+        return m_buffers[m_front].data();
+    }
+
+private:
+    std::vector<uint32_t> m_buffers[3];
+    int m_back         = 0;
+    int m_ready        = 1;
+    int m_front        = 2;
+    bool m_hasNewFrame = false;
+    std::mutex m_mutex;
+};
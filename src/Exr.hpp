@@ -0,0 +1,157 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+#include "3DMath/Half.h"
+
+enum class ExrPixelType
+{
+    Half  = 1,
+    Float = 2,
+};
+
+// Minimal OpenEXR writer: uncompressed scanline images with any number of half or float channels.
+// Uncompressed blocks all have the same size so the offset table can be written up front, which lets
+// the scanlines be streamed to disk one by one without ever holding the whole image.
+// Assumes a little endian host, like the file format.
+class ExrWriter
+{
+public:
+    ~ExrWriter()
+    {
+        if(m_file.is_open())
+            Close();
+    }
+
+    // channels can be given in any order, WriteScanline() takes its rows in that same order
+    bool Open(const std::string& filename, uint32_t width, uint32_t height, const std::vector<std::string>& channels, ExrPixelType type)
+    {
+        m_file.open(filename, std::ios::binary | std::ios::trunc);
+        if(!m_file)
+        {
+            std::cerr << "ERROR: Couldn't open " << filename << " for writing" << std::endl;
+            return false;
+        }
+        m_filename = filename;
+        m_width    = width;
+        m_height   = height;
+        m_type     = type;
+        m_nextY    = 0;
+
+        // the file stores the channels sorted by name
+        m_order.resize(channels.size());
+        std::iota(m_order.begin(), m_order.end(), 0);
+        std::sort(m_order.begin(), m_order.end(), [&](size_t a, size_t b)
+                  { return channels[a] < channels[b]; });
+
+        Write<uint32_t>(20000630);  // magic
+        Write<uint32_t>(2);         // version 2, single part scanline file
+
+        std::string channelList;
+        for(size_t c : m_order)
+        {
+            channelList += channels[c];
+            channelList += '\0';
+            AppendBytes(channelList, (int32_t)type);
+            AppendBytes(channelList, (uint8_t)0);  // pLinear
+            channelList.append(3, '\0');          // reserved
+            AppendBytes(channelList, (int32_t)1);  // x sampling
+            AppendBytes(channelList, (int32_t)1);  // y sampling
+        }
+        channelList += '\0';
+        WriteAttribute("channels", "chlist", channelList);
+
+        WriteAttribute("compression", "compression", std::string(1, '\0'));
+        std::string window;
+        AppendBytes(window, (int32_t)0);
+        AppendBytes(window, (int32_t)0);
+        AppendBytes(window, (int32_t)width - 1);
+        AppendBytes(window, (int32_t)height - 1);
+        WriteAttribute("dataWindow", "box2i", window);
+        WriteAttribute("displayWindow", "box2i", window);
+        WriteAttribute("lineOrder", "lineOrder", std::string(1, '\0'));  // increasing y
+        std::string value;
+        AppendBytes(value, 1.0f);
+        WriteAttribute("pixelAspectRatio", "float", value);
+        WriteAttribute("screenWindowWidth", "float", value);
+        value.clear();
+        AppendBytes(value, 0.0f);
+        AppendBytes(value, 0.0f);
+        WriteAttribute("screenWindowCenter", "v2f", value);
+        m_file.put('\0');  // end of header
+
+        uint64_t blockStart = (uint64_t)m_file.tellp() + (uint64_t)height * sizeof(uint64_t);
+        uint64_t blockSize  = 2 * sizeof(int32_t) + (uint64_t)width * channels.size() * BytesPerSample();
+        for(uint32_t y = 0; y < height; ++y)
+            Write<uint64_t>(blockStart + y * blockSize);
+
+        m_rowBuffer.resize(width * channels.size() * BytesPerSample());
+        return (bool)m_file;
+    }
+
+    // Scanlines have to come in increasing y order, rows[c] points at width samples of channel c
+    void WriteScanline(const float* const* rows)
+    {
+        char* out = m_rowBuffer.data();
+        for(size_t c : m_order)
+        {
+            for(uint32_t x = 0; x < m_width; ++x)
+            {
+                if(m_type == ExrPixelType::Half)
+                {
+                    uint16_t half = math::FloatToHalf(rows[c][x]);
+                    std::memcpy(out, &half, sizeof(half));
+                }
+                else
+                    std::memcpy(out, &rows[c][x], sizeof(float));
+                out += BytesPerSample();
+            }
+        }
+        Write<int32_t>(m_nextY++);
+        Write<int32_t>((int32_t)m_rowBuffer.size());
+        m_file.write(m_rowBuffer.data(), m_rowBuffer.size());
+    }
+
+    bool Close()
+    {
+        if(m_nextY != m_height)
+            std::cerr << "ERROR: " << m_filename << " closed after " << m_nextY << " of " << m_height << " scanlines" << std::endl;
+        m_file.close();
+        return m_nextY == m_height && !m_file.fail();
+    }
+
+private:
+    size_t BytesPerSample() const { return m_type == ExrPixelType::Half ? 2 : 4; }
+
+    template<typename T>
+    void Write(const T& value)
+    {
+        m_file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    template<typename T>
+    static void AppendBytes(std::string& out, const T& value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    void WriteAttribute(const char* name, const char* type, const std::string& value)
+    {
+        m_file.write(name, std::strlen(name) + 1);
+        m_file.write(type, std::strlen(type) + 1);
+        Write<int32_t>((int32_t)value.size());
+        m_file.write(value.data(), value.size());
+    }
+
+    std::ofstream m_file;
+    std::string m_filename;
+    uint32_t m_width  = 0;
+    uint32_t m_height = 0;
+    uint32_t m_nextY  = 0;
+    ExrPixelType m_type;
+    std::vector<size_t> m_order;
+    std::vector<char> m_rowBuffer;
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+// A pass visits the pixels of every 8x8 block in the order of an 8x8 Bayer matrix. A pass can be cut into
+// partial passes covering a range of ranks: ranks [0, 1) are one pixel per 8x8 block, [0, 4) one per 4x4,
+// [0, 16) one per 2x2 and [0, 64) every pixel, so an unfinished pass is a progressively refined image.
+#define PASS_BLOCK_SIZE 8
+#define PASS_RANKS      (PASS_BLOCK_SIZE * PASS_BLOCK_SIZE)
+
+#define MAX_SAMPLES_PER_FRAME 64
+
+inline uint32_t GetPassRank(uint32_t x, uint32_t y)
+{
+    static const std::array<uint8_t, PASS_RANKS> ranks = []
+    {
+        // recursive Bayer matrix, the lowest bits of the position pick the coarsest level
+        const uint8_t bayer2[2][2] = {{0, 2}, {3, 1}};
+        std::array<uint8_t, PASS_RANKS> table;
+        for(uint32_t by = 0; by < PASS_BLOCK_SIZE; ++by)
+            for(uint32_t bx = 0; bx < PASS_BLOCK_SIZE; ++bx)
+                table[by * PASS_BLOCK_SIZE + bx] = 16 * bayer2[by & 1][bx & 1] + 4 * bayer2[(by >> 1) & 1][(bx >> 1) & 1] + bayer2[by >> 2][bx >> 2];
+        return table;
+    }();
+    return ranks[(y % PASS_BLOCK_SIZE) * PASS_BLOCK_SIZE + x % PASS_BLOCK_SIZE];
+}
+
+// The work of one frame: samples per pixel for the pixels whose rank is in [firstRank, endRank)
+struct RenderPass
+{
+    uint32_t index     = 0;  // seeds the random numbers, unique for every pass
+    uint32_t samples   = 1;
+    uint32_t firstRank = 0;
+    uint32_t endRank   = PASS_RANKS;
+
+    bool IsComplete() const { return endRank == PASS_RANKS; }
+    bool Contains(uint32_t x, uint32_t y) const
+    {
+        uint32_t rank = GetPassRank(x, y);
+        return rank >= firstRank && rank < endRank;
+    }
+};
+
+// Sizes every frame so that tracing it takes about the target frame time: cheap scenes get several
+// samples per pixel per frame, expensive ones trace only part of a pass per frame so the display keeps
+// updating. The cost of a pixel sample is measured from the frames traced so far.
+class FrameScheduler
+{
+public:
+    FrameScheduler(uint32_t pixelCount, float targetMilliseconds, uint32_t maxSamples)
+        : m_pixelCount(pixelCount), m_target(targetMilliseconds), m_maxSamples(maxSamples)
+    {
+    }
+
+    // The index of the returned pass is left to the caller
+    RenderPass Next() const
+    {
+        RenderPass pass;
+        pass.firstRank = m_nextRank;
+
+        // until the first frame was measured only trace the coarsest level
+        double budget        = m_msPerPixelSample > 0.0 ? m_target / m_msPerPixelSample : 0.0;
+        double pixelsPerRank = (double)m_pixelCount / PASS_RANKS;
+        uint32_t rankBudget  = (uint32_t)std::clamp(budget / pixelsPerRank, 1.0, (double)PASS_RANKS);
+        if(m_nextRank == 0 && budget >= m_pixelCount)
+        {
+            pass.samples = (uint32_t)std::clamp(budget / m_pixelCount, 1.0, (double)m_maxSamples);
+            pass.endRank = PASS_RANKS;
+        }
+        else
+            pass.endRank = std::min(m_nextRank + rankBudget, (uint32_t)PASS_RANKS);
+        return pass;
+    }
+
+    void Finished(const RenderPass& pass, float milliseconds)
+    {
+        double pixelSamples = (double)m_pixelCount * (pass.endRank - pass.firstRank) / PASS_RANKS * pass.samples;
+        double cost         = milliseconds / std::max(pixelSamples, 1.0);
+        // smoothed, but quick enough to follow the camera into a more expensive part of the scene
+        m_msPerPixelSample = m_msPerPixelSample > 0.0 ? 0.7 * m_msPerPixelSample + 0.3 * cost : cost;
+
+        m_nextRank = pass.endRank % PASS_RANKS;
+        if(pass.IsComplete())
+            m_isImageCovered = true;
+    }
+
+    // True once every pixel has at least one sample since the last Reset()
+    bool IsImageCovered() const { return m_isImageCovered; }
+
+    // Starts over from the coarsest level, keeps the cost estimate
+    void Reset()
+    {
+        m_nextRank       = 0;
+        m_isImageCovered = false;
+    }
+
+private:
+    uint32_t m_pixelCount;
+    float m_target;
+    uint32_t m_maxSamples;
+    double m_msPerPixelSample = 0.0;
+    uint32_t m_nextRank       = 0;
+    bool m_isImageCovered     = false;
+};
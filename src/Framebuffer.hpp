@@ -0,0 +1,308 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include "glm/glm.hpp"
+#include "Profiler.hpp"
+#include "System.hpp"
+#include "WorkerPool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define FRAMEBUFFER_SIMD
+#endif
+
+enum class PixelFormat
+{
+    ARGB,  // 0xAARRGGBB words, what minifb displays
+    RGBA,  // R, G, B, A bytes in memory, what stb_image_write expects
+};
+
+enum class ToneMapping
+{
+    Clamp,
+    Reinhard,
+    Heatmap,  // false colours for the traversal costs of --heatmap, stored in the red channel
+};
+
+// Traversal cost that gets the hottest colour of the heatmap, the scale is logarithmic
+#define HEATMAP_MAX_COST 512.0f
+
+// Blue through cyan, green and yellow to red for t in [0, 1]
+inline glm::vec3 HeatmapColor(float t)
+{
+    static const glm::vec3 colors[] = {{0, 0, 1}, {0, 1, 1}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0}};
+    float position = glm::clamp(t, 0.0f, 1.0f) * 4.0f;
+    int index      = glm::min((int)position, 3);
+    return glm::mix(colors[index], colors[index + 1], position - index);
+}
+
+struct ResolveSettings
+{
+    float exposure          = 1.0f;
+    ToneMapping toneMapping = ToneMapping::Clamp;
+    bool denoise            = false;  // run the Denoiser before tone mapping, 8 bit outputs only
+};
+
+// HDR accumulation buffer written by the tracers. It only stores the running sum and the sample count
+// of every pixel, turning that into displayable 8 bit pixels is a separate Resolve() pass that only
+// has to run when the image is actually shown or saved.
+class Framebuffer
+{
+public:
+    // rows are padded to whole cache lines so workers on neighbouring rows never share one
+    Framebuffer(uint32_t width, uint32_t height)
+        : m_width(width), m_height(height), m_stride((width + 15) & ~15u),
+          m_red(m_stride * height), m_green(m_stride * height), m_blue(m_stride * height), m_sampleCount(m_stride * height),
+          m_depth(m_stride * height), m_albedo(m_stride * height), m_normal(m_stride * height)
+    {
+    }
+
+    // Also decides the NUMA placement of the rows, see WorkerPool
+    void Clear(WorkerPool& workers)
+    {
+        workers.ParallelFor(m_height, [this](size_t y)
+                            { ClearRow(y); });
+    }
+    void ClearRow(size_t y)
+    {
+        size_t row = y * m_stride;
+        std::fill_n(&m_red[row], m_stride, 0.0f);
+        std::fill_n(&m_green[row], m_stride, 0.0f);
+        std::fill_n(&m_blue[row], m_stride, 0.0f);
+        std::fill_n(&m_sampleCount[row], m_stride, 0u);
+        std::fill_n(&m_depth[row], m_stride, std::numeric_limits<float>::infinity());
+        std::fill_n(&m_albedo[row], m_stride, glm::vec4(0));
+        std::fill_n(&m_normal[row], m_stride, glm::vec3(0));
+    }
+
+    // Snapshot of a framebuffer of the same size, a plain copy of the planes
+    void CopyFrom(const Framebuffer& other)
+    {
+        size_t count = (size_t)m_stride * m_height;
+        std::memcpy(m_red.Data(), other.m_red.Data(), count * sizeof(float));
+        std::memcpy(m_green.Data(), other.m_green.Data(), count * sizeof(float));
+        std::memcpy(m_blue.Data(), other.m_blue.Data(), count * sizeof(float));
+        std::memcpy(m_sampleCount.Data(), other.m_sampleCount.Data(), count * sizeof(uint32_t));
+        std::memcpy(m_depth.Data(), other.m_depth.Data(), count * sizeof(float));
+        std::memcpy(m_albedo.Data(), other.m_albedo.Data(), count * sizeof(glm::vec4));
+        std::memcpy(m_normal.Data(), other.m_normal.Data(), count * sizeof(glm::vec3));
+    }
+
+    // sum is the sum of count samples, negative and NaN components are dropped
+    void AddSamples(uint32_t x, uint32_t y, const glm::vec3& sum, uint32_t count)
+    {
+        size_t i = y * m_stride + x;
+        // written so that NaN fails the comparison
+        m_red[i]   += sum.r > 0.0f ? sum.r : 0.0f;
+        m_green[i] += sum.g > 0.0f ? sum.g : 0.0f;
+        m_blue[i]  += sum.b > 0.0f ? sum.b : 0.0f;
+        m_sampleCount[i] += count;
+    }
+
+    glm::vec3 GetSum(uint32_t x, uint32_t y) const
+    {
+        size_t i = y * m_stride + x;
+        return glm::vec3(m_red[i], m_green[i], m_blue[i]);
+    }
+    uint32_t GetSampleCount(uint32_t x, uint32_t y) const { return m_sampleCount[y * m_stride + x]; }
+    glm::vec3 GetAverage(uint32_t x, uint32_t y) const
+    {
+        uint32_t count = GetSampleCount(x, y);
+        return count == 0 ? glm::vec3(0) : GetSum(x, y) / (float)count;
+    }
+
+    // Distance from the camera to what the pixel's latest camera ray hit, infinity for the background
+    void SetDepth(uint32_t x, uint32_t y, float depth) { m_depth[y * m_stride + x] = depth; }
+    float GetDepth(uint32_t x, uint32_t y) const { return m_depth[y * m_stride + x]; }
+
+    // Albedo and world space normal of what the pixel's camera rays hit, the guides of the Denoiser. They
+    // are summed like the color but keep their own sample count, checkpoints don't store them.
+    void AddFeatures(uint32_t x, uint32_t y, const glm::vec3& albedoSum, const glm::vec3& normalSum, uint32_t count)
+    {
+        size_t i     = y * m_stride + x;
+        m_albedo[i] += glm::vec4(albedoSum, (float)count);
+        m_normal[i] += normalSum;
+    }
+    // Zero until the pixel is traced
+    glm::vec3 GetAlbedo(uint32_t x, uint32_t y) const
+    {
+        const glm::vec4& albedo = m_albedo[y * m_stride + x];
+        return albedo.w > 0.0f ? glm::vec3(albedo) / albedo.w : glm::vec3(0);
+    }
+    glm::vec3 GetNormal(uint32_t x, uint32_t y) const
+    {
+        const glm::vec3& normal = m_normal[y * m_stride + x];
+        return normal == glm::vec3(0) ? normal : glm::normalize(normal);
+    }
+
+    uint32_t GetWidth() const { return m_width; }
+    uint32_t GetHeight() const { return m_height; }
+
+    // out has width * height words, in both formats
+    void Resolve(WorkerPool& workers, PixelFormat format, uint32_t* out, const ResolveSettings& settings = {}) const
+    {
+        PROFILE_SCOPE("Resolve");
+        workers.ParallelFor(m_height, [&](size_t y)
+                            { ResolveRow(y, format, out + y * m_width, settings); });
+    }
+
+    // For images that don't have a sample in every pixel yet: gives empty pixels the resolved color of the
+    // closest pixel with samples on the grid of the partial passes, trying 2x2 blocks first up to
+    // maxBlockSize x maxBlockSize ones. Run after Resolve() on the same out.
+    void FillUnsampledPixels(WorkerPool& workers, uint32_t* out, uint32_t maxBlockSize) const
+    {
+        workers.ParallelFor(m_height, [&](size_t y)
+                            {
+            for(uint32_t x = 0; x < m_width; ++x)
+            {
+                if(GetSampleCount(x, y) > 0)
+                    continue;
+                // only pixels with samples are read, those are never written here
+                for(uint32_t block = 2; block <= maxBlockSize; block *= 2)
+                {
+                    uint32_t sourceX = x & ~(block - 1);
+                    uint32_t sourceY = y & ~(block - 1);
+                    if(GetSampleCount(sourceX, sourceY) > 0)
+                    {
+                        out[y * m_width + x] = out[sourceY * m_width + sourceX];
+                        break;
+                    }
+                }
+            } });
+    }
+
+    // tone mapping, gamma 2 and 8 bit conversion of one row, 4 pixels at a time
+    void ResolveRow(size_t y, PixelFormat format, uint32_t* out, const ResolveSettings& settings) const
+    {
+        uint32_t x = 0;
+#ifdef FRAMEBUFFER_SIMD
+        // both formats are the same word with the red and blue bytes swapped
+        const int redShift  = format == PixelFormat::ARGB ? 16 : 0;
+        const int blueShift = format == PixelFormat::ARGB ? 0 : 16;
+
+        const float* red       = &m_red[y * m_stride];
+        const float* green     = &m_green[y * m_stride];
+        const float* blue      = &m_blue[y * m_stride];
+        const uint32_t* counts = &m_sampleCount[y * m_stride];
+        const __m128 zero      = _mm_setzero_ps();
+        const __m128 one       = _mm_set1_ps(1.0f);
+        const __m128 exposure  = _mm_set1_ps(settings.exposure);
+        const __m128 maxValue  = _mm_set1_ps(0.999f);
+        const __m128 scale     = _mm_set1_ps(256.0f);
+        const __m128i alpha    = _mm_set1_epi32(0xFF000000);
+        const bool reinhard    = settings.toneMapping == ToneMapping::Reinhard;
+        const bool heatmap     = settings.toneMapping == ToneMapping::Heatmap;  // a debug view, left to the scalar path
+
+        auto toByte = [&](__m128 c, __m128 weight)
+        {
+            c = _mm_mul_ps(c, weight);
+            if(reinhard)
+                c = _mm_div_ps(c, _mm_add_ps(one, c));
+            c = _mm_min_ps(_mm_sqrt_ps(_mm_max_ps(c, zero)), maxValue);
+            return _mm_cvttps_epi32(_mm_mul_ps(c, scale));
+        };
+        for(; !heatmap && x + 4 <= m_width; x += 4)
+        {
+            __m128 count  = _mm_cvtepi32_ps(_mm_load_si128((const __m128i*)(counts + x)));
+            __m128 weight = _mm_and_ps(_mm_div_ps(exposure, count), _mm_cmpgt_ps(count, zero));  // 0 for empty pixels
+
+            __m128i r = toByte(_mm_load_ps(red + x), weight);
+            __m128i g = toByte(_mm_load_ps(green + x), weight);
+            __m128i b = toByte(_mm_load_ps(blue + x), weight);
+
+            __m128i pixel = _mm_or_si128(alpha, _mm_slli_epi32(g, 8));
+            pixel         = _mm_or_si128(pixel, _mm_sll_epi32(r, _mm_cvtsi32_si128(redShift)));
+            pixel         = _mm_or_si128(pixel, _mm_sll_epi32(b, _mm_cvtsi32_si128(blueShift)));
+            _mm_storeu_si128((__m128i*)(out + x), pixel);
+        }
+#endif
+        for(; x < m_width; ++x)
+            out[x] = ResolvePixel(x, y, format, settings);
+    }
+
+    // Scalar reference for ResolveRow()
+    uint32_t ResolvePixel(uint32_t x, uint32_t y, PixelFormat format, const ResolveSettings& settings) const
+    {
+        uint32_t count  = GetSampleCount(x, y);
+        glm::vec3 color = GetSum(x, y) * (count == 0 ? 0.0f : settings.exposure / count);
+        if(settings.toneMapping == ToneMapping::Reinhard)
+            color = color / (1.0f + color);
+        else if(settings.toneMapping == ToneMapping::Heatmap)
+            color = count == 0 ? glm::vec3(0) : HeatmapColor(std::log2(1.0f + color.r) / std::log2(1.0f + HEATMAP_MAX_COST));
+        glm::vec3 gammaCorrectedColor(glm::sqrt(color));
+
+        uint32_t r = 256 * glm::clamp(gammaCorrectedColor.r, 0.0f, 0.999f);
+        uint32_t g = 256 * glm::clamp(gammaCorrectedColor.g, 0.0f, 0.999f);
+        uint32_t b = 256 * glm::clamp(gammaCorrectedColor.b, 0.0f, 0.999f);
+        if(format == PixelFormat::ARGB)
+            return 0xFF000000 | (r << 16) | (g << 8) | b;
+        return 0xFF000000 | (b << 16) | (g << 8) | r;
+    }
+
+private:
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_stride;
+    PageArray<float> m_red;
+    PageArray<float> m_green;
+    PageArray<float> m_blue;
+    PageArray<uint32_t> m_sampleCount;
+    PageArray<float> m_depth;
+    PageArray<glm::vec4> m_albedo;  // the sample count of the features in w
+    PageArray<glm::vec3> m_normal;
+};
+
+// Compares the resolve pass against what the tracers used to do inline for every pixel of every frame:
+// average, sqrt and write both the minifb and the stb buffer
+inline void BenchmarkResolve(const Framebuffer& framebuffer, int iterations)
+{
+    uint32_t width  = framebuffer.GetWidth();
+    uint32_t height = framebuffer.GetHeight();
+    std::vector<uint32_t> argb(width * height);
+    std::vector<uint8_t> rgba(width * height * 4);
+    ResolveSettings settings;
+
+    auto time = [&](auto&& func)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < iterations; ++i)
+            func();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / iterations;
+    };
+
+    double inlineTime = time([&]
+                             {
+        for(uint32_t y = 0; y < height; ++y)
+            for(uint32_t x = 0; x < width; ++x)
+            {
+                glm::vec3 gammaCorrectedColor(glm::sqrt(framebuffer.GetAverage(x, y)));
+                uint8_t r = 256 * glm::clamp(gammaCorrectedColor.r, 0.0f, 0.999f);
+                uint8_t g = 256 * glm::clamp(gammaCorrectedColor.g, 0.0f, 0.999f);
+                uint8_t b = 256 * glm::clamp(gammaCorrectedColor.b, 0.0f, 0.999f);
+                argb[y * width + x]     = 0xFF000000 | (r << 16) | (g << 8) | b;
+                uint8_t* pixel          = &rgba[(y * width + x) * 4];
+                pixel[0]                = r;
+                pixel[1]                = g;
+                pixel[2]                = b;
+                pixel[3]                = 0xFF;
+            } });
+    double resolveTime = time([&]
+                              {
+        for(uint32_t y = 0; y < height; ++y)
+            framebuffer.ResolveRow(y, PixelFormat::ARGB, &argb[y * width], settings); });
+
+    size_t mismatches = 0;
+    for(uint32_t y = 0; y < height; ++y)
+        for(uint32_t x = 0; x < width; ++x)
+            mismatches += argb[y * width + x] != framebuffer.ResolvePixel(x, y, PixelFormat::ARGB, settings);
+
+    std::cout << "Resolve " << width << "x" << height << " (single thread): inline path " << inlineTime << " ms, resolve pass "
+              << resolveTime << " ms (" << inlineTime / resolveTime << "x), " << mismatches << " pixels differ from the scalar reference" << std::endl;
+}
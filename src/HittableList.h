@@ -34,6 +34,7 @@ public:
     }
 
     auto& GetObjects() { return m_objects; }
+    bool IsEmpty() const { return m_objects.empty(); }
 
 private:
     std::vector<Hittable*> m_objects;
@@ -0,0 +1,239 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+#include "Aov.hpp"
+#include "Checkpoint.hpp"
+#include "Profiler.hpp"
+#include "Denoiser.hpp"
+#include "Exr.hpp"
+#include "Framebuffer.hpp"
+
+// Saves images on a background I/O thread. Save() only takes a copy of the accumulation buffer,
+// resolving, encoding and writing the file all happen on the writer thread, so the tracers keep
+// running while a PNG is being compressed. The output format follows the file extension:
+// .png gets the tone mapped (and optionally denoised) 8 bit image, .exr the linear HDR averages. AOVs are
+// extra layers of the EXR, next to a PNG they get an EXR of their own. Checkpoints go through the same queue.
+class ImageWriter
+{
+public:
+    ImageWriter()
+        : m_thread([this]
+                   { Run(); })
+    {
+    }
+
+    // Finishes every queued save before returning
+    ~ImageWriter()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_quit = true;
+        }
+        m_wakeUp.notify_one();
+        m_thread.join();
+    }
+    ImageWriter(const ImageWriter&)            = delete;
+    ImageWriter& operator=(const ImageWriter&) = delete;
+
+    // Has to be called between two render passes, the snapshot is taken before it returns. aovs is
+    // optional, it has to be traced along with framebuffer.
+    void Save(const Framebuffer& framebuffer, const AovBuffer* aovs, const ResolveSettings& settings, const std::string& filename)
+    {
+        PROFILE_SCOPE("ImageWriter::Save");
+        auto snapshot = std::make_unique<Framebuffer>(framebuffer.GetWidth(), framebuffer.GetHeight());
+        snapshot->CopyFrom(framebuffer);
+        Job job(std::move(snapshot), settings, filename);
+        if(aovs)
+        {
+            job.aovs = std::make_unique<AovBuffer>(aovs->GetWidth(), aovs->GetHeight(), aovs->GetAovs(), aovs->GetLightCount());
+            job.aovs->CopyFrom(*aovs);
+        }
+        {
+            std::lock_guard lock(m_mutex);
+            m_jobs.push_back(std::move(job));
+        }
+        m_wakeUp.notify_one();
+    }
+    void SaveCheckpoint(const Framebuffer& framebuffer, const CheckpointInfo& info, const std::string& filename)
+    {
+        auto snapshot = std::make_unique<Framebuffer>(framebuffer.GetWidth(), framebuffer.GetHeight());
+        snapshot->CopyFrom(framebuffer);
+        {
+            std::lock_guard lock(m_mutex);
+            m_jobs.emplace_back(std::move(snapshot), info, filename);
+        }
+        m_wakeUp.notify_one();
+    }
+
+    // Blocks until every queued save is on disk
+    void Flush()
+    {
+        std::unique_lock lock(m_mutex);
+        m_idle.wait(lock, [this]
+                    { return m_jobs.empty() && !m_busy; });
+    }
+
+    static std::filesystem::path GetImageDirectory()
+    {
+        return std::filesystem::current_path() / ".." / "images";
+    }
+
+    // ../images/<base><N>_<spp><ext> with the next free N. The directory is only scanned the first
+    // time a base name is used, after that the index is just incremented.
+    std::string NextFilename(const std::string& base, const std::string& ext, int numSamples)
+    {
+        std::filesystem::path p = GetImageDirectory();
+
+        std::lock_guard lock(m_mutex);
+        auto it = m_nextIndex.find(base + ext);
+        if(it == m_nextIndex.end())
+        {
+            int i = 0;
+            std::error_code error;
+            std::filesystem::create_directories(p, error);
+            for(const auto& entry : std::filesystem::directory_iterator(p, error))
+            {
+                if(entry.path().filename().string().find(base) == 0 && entry.path().extension().string() == ext)
+                    i++;
+            }
+            it = m_nextIndex.emplace(base + ext, i).first;
+        }
+
+        return (p / (base + std::to_string(it->second++) + "_" + std::to_string(numSamples) + ext)).string();
+    }
+
+private:
+    struct Job
+    {
+        Job(std::unique_ptr<Framebuffer> image, const ResolveSettings& resolve, const std::string& path)
+            : snapshot(std::move(image)), settings(resolve), filename(path)
+        {
+        }
+        // a checkpoint
+        Job(std::unique_ptr<Framebuffer> image, const CheckpointInfo& info, const std::string& path)
+            : snapshot(std::move(image)), filename(path), checkpointInfo(info), isCheckpoint(true)
+        {
+        }
+
+        std::unique_ptr<Framebuffer> snapshot;
+        ResolveSettings settings;
+        std::string filename;
+        CheckpointInfo checkpointInfo;
+        bool isCheckpoint = false;
+        std::unique_ptr<AovBuffer> aovs;
+    };
+
+    void Run()
+    {
+        PROFILE_THREAD_NAME("Image writer");
+        std::unique_lock lock(m_mutex);
+        while(true)
+        {
+            m_wakeUp.wait(lock, [this]
+                          { return m_quit || !m_jobs.empty(); });
+            if(m_jobs.empty())
+                break;  // only quit once the queue is drained
+
+            Job job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            m_busy = true;
+            lock.unlock();
+
+            bool ok = job.isCheckpoint ? WriteCheckpoint(job.filename, *job.snapshot, job.checkpointInfo) : Write(job);
+            std::cout << (ok ? "Wrote to: " : "ERROR: Couldn't write ") << job.filename << std::endl;
+
+            lock.lock();
+            m_busy = false;
+            if(m_jobs.empty())
+                m_idle.notify_all();
+        }
+        m_idle.notify_all();
+    }
+
+    static bool Write(const Job& job)
+    {
+        PROFILE_SCOPE("ImageWriter::Write");
+        const Framebuffer& image = *job.snapshot;
+        uint32_t width           = image.GetWidth();
+        uint32_t height          = image.GetHeight();
+
+        std::error_code error;
+        std::filesystem::path parent = std::filesystem::path(job.filename).parent_path();
+        if(!parent.empty())
+            std::filesystem::create_directories(parent, error);
+
+        if(std::filesystem::path(job.filename).extension() == ".exr")
+            return WriteExr(job.filename, image, job.aovs.get(), job.settings.exposure);
+
+        std::vector<uint32_t> pixels(width * height);
+        if(job.settings.denoise)
+            Denoiser(width, height).Resolve(image, nullptr, PixelFormat::RGBA, pixels.data(), job.settings);
+        else
+            for(uint32_t y = 0; y < height; ++y)
+                image.ResolveRow(y, PixelFormat::RGBA, &pixels[y * width], job.settings);
+        if(!stbi_write_png(job.filename.c_str(), width, height, 4, pixels.data(), width * 4))
+            return false;
+        if(job.aovs)
+        {
+            std::filesystem::path aovFilename = job.filename;
+            aovFilename.replace_filename(aovFilename.stem().string() + "_aov.exr");
+            bool ok = WriteExr(aovFilename.string(), image, job.aovs.get(), job.settings.exposure);
+            std::cout << (ok ? "Wrote to: " : "ERROR: Couldn't write ") << aovFilename.string() << std::endl;
+        }
+        return true;
+    }
+
+    // The linear HDR image in R, G and B, followed by the AOVs if there are any
+    static bool WriteExr(const std::string& filename, const Framebuffer& image, const AovBuffer* aovs, float exposure)
+    {
+        uint32_t width                 = image.GetWidth();
+        uint32_t height                = image.GetHeight();
+        std::vector<std::string> names = {"R", "G", "B"};
+        if(aovs)
+        {
+            std::vector<std::string> aovNames = aovs->GetChannelNames();
+            names.insert(names.end(), aovNames.begin(), aovNames.end());
+        }
+
+        ExrWriter exr;
+        if(!exr.Open(filename, width, height, names, ExrPixelType::Float))
+            return false;
+        std::vector<float> rows(width * names.size());
+        std::vector<const float*> channels(names.size());
+        for(size_t c = 0; c < names.size(); ++c)
+            channels[c] = &rows[c * width];
+        for(uint32_t y = 0; y < height; ++y)
+        {
+            for(uint32_t x = 0; x < width; ++x)
+            {
+                glm::vec3 color     = image.GetAverage(x, y) * exposure;
+                rows[x]             = color.r;
+                rows[width + x]     = color.g;
+                rows[2 * width + x] = color.b;
+            }
+            if(aovs)
+                aovs->ResolveRow(y, image, y, exposure, &rows[3 * width]);
+            exr.WriteScanline(channels.data());
+        }
+        return exr.Close();
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_idle;
+    std::deque<Job> m_jobs;
+    std::map<std::string, int> m_nextIndex;
+    bool m_busy = false;
+    bool m_quit = false;
+    std::thread m_thread;  // last, so everything above exists before the thread starts
+};
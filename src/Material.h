@@ -8,6 +8,7 @@
 #include "3DMath/Random.h"
 #include "Texture.h"
 #include "Allocator.hpp"
+#include "ResourceCache.hpp"
 
 class Material
 {
@@ -23,18 +24,24 @@ public:
     {
         return 0;
     }
+
+    // Which light the emission belongs to in the per-light AOVs, -1 if the material doesn't emit
+    virtual int GetLightIndex() const
+    {
+        return -1;
+    }
 };
 
 
 class Lambertian : public Material
 {
 public:
-    Lambertian(const glm::vec3& albedo) : m_texture(g_materialAllocator.Allocate<SolidColor>(albedo)) {}
+    Lambertian(const glm::vec3& albedo) : m_texture(g_materialCache.Get<SolidColor>(albedo)) {}
     Lambertian(Texture* t) : m_texture(t) {}
     virtual bool Scatter(const Ray& r, const HitRecord& rec, ScatterRecord& scatterRecOut) const override
     {
         scatterRecOut.attenuation = m_texture->Sample(rec.uv, rec.point);
-        scatterRecOut.pdf         = std::make_shared<CosinePDF>(rec.normal);
+        scatterRecOut.pdf         = GetScratchAllocator().Allocate<CosinePDF>(rec.normal);
 
         return true;
     }
@@ -51,7 +58,7 @@ private:
 class Metal : public Material
 {
 public:
-    Metal(const glm::vec3& albedo, float fuzziness) : m_albedo(g_materialAllocator.Allocate<SolidColor>(albedo)), m_fuzziness(fuzziness < 1 ? fuzziness : 1) {}
+    Metal(const glm::vec3& albedo, float fuzziness) : m_albedo(g_materialCache.Get<SolidColor>(albedo)), m_fuzziness(fuzziness < 1 ? fuzziness : 1) {}
 
     Metal(Texture* albedo, float fuzziness) : m_albedo(albedo), m_fuzziness(fuzziness < 1 ? fuzziness : 1) {}
 
@@ -116,8 +123,10 @@ private:
 class Emissive : public Material
 {
 public:
-    Emissive(Texture* t) : m_emissionTexture(t) {}
-    Emissive(const glm::vec3& color) : m_emissionTexture(g_materialAllocator.Allocate<SolidColor>(color)) {}
+    // lights are numbered in the order the scene creates them, the material cache makes equal ones a single light.
+    // BuildScene() restarts the numbering for every scene.
+    Emissive(Texture* t) : m_emissionTexture(t), m_lightIndex(s_lightCount++) {}
+    Emissive(const glm::vec3& color) : m_emissionTexture(g_materialCache.Get<SolidColor>(color)), m_lightIndex(s_lightCount++) {}
     virtual bool Scatter(const Ray& r, const HitRecord& rec, ScatterRecord& scatterRecOut) const override
     {
         return false;
@@ -130,19 +139,28 @@ public:
         return m_emissionTexture->Sample(uv, point);
     }
 
+    virtual int GetLightIndex() const override
+    {
+        return m_lightIndex;
+    }
+    static int GetLightCount() { return s_lightCount; }
+    static void ResetLightCount() { s_lightCount = 0; }
+
 private:
     Texture* m_emissionTexture;
+    int m_lightIndex;
+    static inline int s_lightCount = 0;
 };
 
 class Isotropic : public Material
 {
 public:
-    Isotropic(const glm::vec3& color) : m_texture(g_materialAllocator.Allocate<SolidColor>(color)) {}
+    Isotropic(const glm::vec3& color) : m_texture(g_materialCache.Get<SolidColor>(color)) {}
     Isotropic(Texture* t) : m_texture(t) {}
     virtual bool Scatter(const Ray& r, const HitRecord& rec, ScatterRecord& scatterRecOut) const override
     {
         scatterRecOut.attenuation = m_texture->Sample(rec.uv, rec.point);
-        scatterRecOut.pdf         = std::make_shared<SpherePDF>();
+        scatterRecOut.pdf         = GetScratchAllocator().Allocate<SpherePDF>();
         return true;
     }
 
@@ -0,0 +1,620 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "glm/glm.hpp"
+#include "Allocator.hpp"
+#include "Profiler.hpp"
+#include "System.hpp"
+#include "TriangleMesh.hpp"
+
+// Packed mesh files (.rmesh) hold a TriangleMesh the way it is in memory, BVH included: loading one maps
+// the file and the mesh renders from the arrays in place, without parsing, copying or building anything.
+// Pages are read from disk when a ray first touches them and concurrent renders of the same file share
+// them through the page cache. The layout is a MeshFileHeader followed by the positions, normals, UVs,
+// indices, BVH nodes and triangle blocks, each at a multiple of MESH_FILE_ALIGNMENT, in the byte order of
+// the machine that wrote it (little endian on every platform we build for). Compressed meshes
+// (MESH_FILE_COMPRESSED) store their quantized positions, octahedral normals and half UVs in place of the
+// positions, normals and UVs and have no blocks.
+//
+// Binary PLY and OBJ files are parsed into a MeshData and get their BVH built on load, ConvertMesh()
+// turns them into a packed file once.
+
+#define MESH_FILE_MAGIC     "RTMESH\0\0"
+#define MESH_FILE_VERSION    3
+#define MESH_FILE_ALIGNMENT  64
+#define MESH_FILE_COMPRESSED 1  // a flag
+
+struct MeshFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    uint32_t nodeCount;
+    uint32_t blockCount;
+    uint32_t flags;
+    float quantizationMin[3];  // of compressed meshes
+    float quantizationScale[3];
+    // byte offsets of the arrays from the start of the file, 0 if the mesh has no normals or UVs
+    uint64_t positions;
+    uint64_t normals;
+    uint64_t uvs;
+    uint64_t indices;
+    uint64_t nodes;
+    uint64_t blocks;
+};
+static_assert(sizeof(MeshFileHeader) == 104, "the header is written as is");
+
+// Written to path.tmp through a file mapping and then renamed over path, like a checkpoint
+inline bool WriteMeshFile(const std::string& path, const TriangleMesh& mesh)
+{
+    PROFILE_SCOPE("WriteMeshFile");
+    MeshArrays arrays     = mesh.GetArrays();
+    MeshFileHeader header = {};
+    std::memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+    header.version       = MESH_FILE_VERSION;
+    header.vertexCount   = arrays.vertexCount;
+    header.triangleCount = arrays.triangleCount;
+    header.nodeCount     = arrays.nodeCount;
+    header.blockCount    = arrays.blockCount;
+    header.flags         = arrays.quantizedPositions ? MESH_FILE_COMPRESSED : 0;
+    for(int i = 0; i < 3; ++i)
+    {
+        header.quantizationMin[i]   = arrays.quantizationMin[i];
+        header.quantizationScale[i] = arrays.quantizationScale[i];
+    }
+    // a compressed mesh has its own arrays in the positions, normals and UVs slots
+    bool compressed        = header.flags & MESH_FILE_COMPRESSED;
+    const void* positions  = compressed ? (const void*)arrays.quantizedPositions : arrays.positions;
+    const void* normals    = compressed ? (const void*)arrays.octahedralNormals : arrays.normals;
+    const void* uvs        = compressed ? (const void*)arrays.halfUVs : arrays.uvs;
+    uint64_t positionBytes = arrays.vertexCount * (compressed ? 4 * sizeof(uint16_t) : sizeof(glm::vec3));
+    uint64_t normalBytes   = arrays.vertexCount * (compressed ? sizeof(uint32_t) : sizeof(glm::vec3));
+    uint64_t uvBytes       = arrays.vertexCount * (compressed ? sizeof(uint32_t) : sizeof(glm::vec2));
+
+    uint64_t size = sizeof(MeshFileHeader);
+    auto place    = [&](const void* array, uint64_t bytes)
+    {
+        if(!array)
+            return (uint64_t)0;
+        uint64_t offset = (size + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+        size            = offset + bytes;
+        return offset;
+    };
+    header.positions = place(positions, positionBytes);
+    header.normals   = place(normals, normalBytes);
+    header.uvs       = place(uvs, uvBytes);
+    header.indices   = place(arrays.indices, 3 * (uint64_t)arrays.triangleCount * sizeof(uint32_t));
+    header.nodes     = place(arrays.nodes, arrays.nodeCount * sizeof(MeshNode));
+    header.blocks    = place(arrays.blocks, arrays.blockCount * sizeof(TriangleBlock));
+
+    std::string tmp = path + ".tmp";
+    MappedFile file;
+    if(!file.Open(tmp, size))
+    {
+        std::cerr << "ERROR: Couldn't create mesh file " << tmp << std::endl;
+        return false;
+    }
+    char* data = static_cast<char*>(file.Data());
+    std::memcpy(data, &header, sizeof(header));
+    auto copy = [&](uint64_t offset, const void* array, uint64_t bytes)
+    {
+        if(offset)
+            std::memcpy(data + offset, array, bytes);
+    };
+    copy(header.positions, positions, positionBytes);
+    copy(header.normals, normals, normalBytes);
+    copy(header.uvs, uvs, uvBytes);
+    copy(header.indices, arrays.indices, 3 * (uint64_t)arrays.triangleCount * sizeof(uint32_t));
+    copy(header.nodes, arrays.nodes, arrays.nodeCount * sizeof(MeshNode));
+    copy(header.blocks, arrays.blocks, arrays.blockCount * sizeof(TriangleBlock));
+
+    bool flushed = file.Flush();
+    file.Close();
+    std::error_code error;
+    std::filesystem::rename(tmp, path, error);
+    if(!flushed || error)
+    {
+        std::cerr << "ERROR: Couldn't write mesh file " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Checks that the header is valid and every array lies inside the file. The contents aren't checked,
+// that would read the whole file, a packed file is trusted like the build that wrote it.
+inline TriangleMesh* MapMeshFile(const std::string& path, Material* mat)
+{
+    PROFILE_SCOPE("MapMeshFile");
+    auto file = std::make_unique<MappedFile>();
+    if(!file->Open(path, 0))
+    {
+        std::cerr << "ERROR: Couldn't open mesh file " << path << std::endl;
+        return nullptr;
+    }
+    const char* data             = static_cast<const char*>(file->Data());
+    const MeshFileHeader* header = reinterpret_cast<const MeshFileHeader*>(data);
+    if(file->Size() < sizeof(MeshFileHeader) || std::memcmp(header->magic, MESH_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+       header->version != MESH_FILE_VERSION)
+    {
+        std::cerr << "ERROR: " << path << " isn't a mesh file of this version" << std::endl;
+        return nullptr;
+    }
+    bool triangles  = header->triangleCount > 0;
+    bool compressed = header->flags & MESH_FILE_COMPRESSED;
+    bool valid      = !triangles || (header->nodeCount > 0 && (compressed || header->blockCount > 0));
+    auto inside    = [&](uint64_t offset, uint64_t bytes, bool required)
+    {
+        if(offset == 0)
+            valid &= !required;
+        else
+            valid &= offset % MESH_FILE_ALIGNMENT == 0 && offset <= file->Size() && bytes <= file->Size() - offset;
+        return offset ? data + offset : nullptr;
+    };
+
+    MeshArrays arrays;
+    arrays.vertexCount   = header->vertexCount;
+    arrays.triangleCount = header->triangleCount;
+    arrays.nodeCount     = header->nodeCount;
+    arrays.blockCount    = header->blockCount;
+    if(compressed)
+    {
+        arrays.quantizedPositions = reinterpret_cast<const uint16_t*>(inside(header->positions, header->vertexCount * 4 * sizeof(uint16_t), true));
+        arrays.octahedralNormals  = reinterpret_cast<const uint32_t*>(inside(header->normals, header->vertexCount * sizeof(uint32_t), false));
+        arrays.halfUVs            = reinterpret_cast<const uint32_t*>(inside(header->uvs, header->vertexCount * sizeof(uint32_t), false));
+        arrays.quantizationMin    = glm::vec3(header->quantizationMin[0], header->quantizationMin[1], header->quantizationMin[2]);
+        arrays.quantizationScale  = glm::vec3(header->quantizationScale[0], header->quantizationScale[1], header->quantizationScale[2]);
+    }
+    else
+    {
+        arrays.positions = reinterpret_cast<const glm::vec3*>(inside(header->positions, header->vertexCount * sizeof(glm::vec3), true));
+        arrays.normals   = reinterpret_cast<const glm::vec3*>(inside(header->normals, header->vertexCount * sizeof(glm::vec3), false));
+        arrays.uvs       = reinterpret_cast<const glm::vec2*>(inside(header->uvs, header->vertexCount * sizeof(glm::vec2), false));
+    }
+    arrays.indices       = reinterpret_cast<const uint32_t*>(inside(header->indices, 3 * (uint64_t)header->triangleCount * sizeof(uint32_t), triangles));
+    arrays.nodes         = reinterpret_cast<const MeshNode*>(inside(header->nodes, header->nodeCount * sizeof(MeshNode), triangles));
+    arrays.blocks        = reinterpret_cast<const TriangleBlock*>(inside(header->blocks, header->blockCount * sizeof(TriangleBlock), triangles && !compressed));
+    if(!valid)
+    {
+        std::cerr << "ERROR: Mesh file " << path << " is truncated" << std::endl;
+        return nullptr;
+    }
+    return g_shapeAllocator.Allocate<TriangleMesh>(arrays, std::move(file), mat);
+}
+
+// Reads a binary (little or big endian) PLY file with a vertex element of float or double x, y, z and
+// optionally nx, ny, nz and u, v (or s, t) properties and a face element with a vertex_indices list.
+// Polygons are split into fans of triangles, other elements and properties are skipped.
+inline bool LoadPly(const std::string& path, MeshData& mesh)
+{
+    PROFILE_SCOPE("LoadPly");
+    MappedFile file;
+    if(!file.Open(path, 0))
+    {
+        std::cerr << "ERROR: Couldn't open " << path << std::endl;
+        return false;
+    }
+    const char* data = static_cast<const char*>(file.Data());
+    const char* end  = data + file.Size();
+    std::string_view text(data, file.Size());
+    size_t headerEnd = text.find("end_header");
+    size_t bodyStart = headerEnd == std::string_view::npos ? std::string_view::npos : text.find('\n', headerEnd);
+    if(text.substr(0, 3) != "ply" || bodyStart == std::string_view::npos)
+    {
+        std::cerr << "ERROR: " << path << " isn't a PLY file" << std::endl;
+        return false;
+    }
+
+    enum class Type
+    {
+        Int8,
+        UInt8,
+        Int16,
+        UInt16,
+        Int32,
+        UInt32,
+        Float32,
+        Float64,
+        Invalid
+    };
+    auto parseType = [](std::string_view name)
+    {
+        if(name == "char" || name == "int8")
+            return Type::Int8;
+        if(name == "uchar" || name == "uint8")
+            return Type::UInt8;
+        if(name == "short" || name == "int16")
+            return Type::Int16;
+        if(name == "ushort" || name == "uint16")
+            return Type::UInt16;
+        if(name == "int" || name == "int32")
+            return Type::Int32;
+        if(name == "uint" || name == "uint32")
+            return Type::UInt32;
+        if(name == "float" || name == "float32")
+            return Type::Float32;
+        if(name == "double" || name == "float64")
+            return Type::Float64;
+        return Type::Invalid;
+    };
+    static constexpr size_t s_typeSizes[] = {1, 1, 2, 2, 4, 4, 4, 8, 0};
+    struct Property
+    {
+        std::string name;
+        Type type;
+        Type countType = Type::Invalid;  // a list if valid
+    };
+    struct Element
+    {
+        std::string name;
+        uint64_t count;
+        std::vector<Property> properties;
+    };
+
+    // Header
+    std::vector<Element> elements;
+    bool bigEndian = false;
+    bool valid     = true;
+    for(size_t start = 0; start < bodyStart;)
+    {
+        size_t lineEnd = text.find('\n', start);
+        std::vector<std::string_view> words;
+        for(size_t i = start; i < lineEnd;)
+        {
+            while(i < lineEnd && (text[i] == ' ' || text[i] == '\r'))
+                ++i;
+            size_t wordEnd = i;
+            while(wordEnd < lineEnd && text[wordEnd] != ' ' && text[wordEnd] != '\r')
+                ++wordEnd;
+            if(wordEnd > i)
+                words.push_back(text.substr(i, wordEnd - i));
+            i = wordEnd;
+        }
+        start = lineEnd + 1;
+        if(words.empty())
+            continue;
+        if(words[0] == "format")
+        {
+            if(words.size() < 2 || words[1] == "ascii")
+            {
+                std::cerr << "ERROR: " << path << " is an ASCII PLY file, only binary ones are supported" << std::endl;
+                return false;
+            }
+            bigEndian = words[1] == "binary_big_endian";
+        }
+        else if(words[0] == "element" && words.size() == 3)
+        {
+            uint64_t count = 0;
+            valid &= std::from_chars(words[2].data(), words[2].data() + words[2].size(), count).ec == std::errc();
+            elements.push_back({std::string(words[1]), count, {}});
+        }
+        else if(words[0] == "property" && !elements.empty())
+        {
+            if(words.size() == 5 && words[1] == "list")
+            {
+                elements.back().properties.push_back({std::string(words[4]), parseType(words[3]), parseType(words[2])});
+                const Property& list  = elements.back().properties.back();
+                valid                &= list.type != Type::Invalid && list.countType != Type::Invalid;
+            }
+            else if(words.size() == 3)
+            {
+                elements.back().properties.push_back({std::string(words[2]), parseType(words[1])});
+                valid &= elements.back().properties.back().type != Type::Invalid;
+            }
+            else
+                valid = false;
+        }
+    }
+    if(!valid)
+    {
+        std::cerr << "ERROR: Malformed PLY header in " << path << std::endl;
+        return false;
+    }
+
+    // Body, read straight out of the mapping
+    const char* cursor = data + bodyStart + 1;
+    auto read          = [&](Type type) -> double
+    {
+        size_t size = s_typeSizes[(int)type];
+        if(size > (size_t)(end - cursor))
+        {
+            valid = false;
+            return 0.0;
+        }
+        unsigned char bytes[8];
+        std::memcpy(bytes, cursor, size);
+        cursor += size;
+        if(bigEndian)
+            std::reverse(bytes, bytes + size);
+        auto as = [&](auto value)
+        {
+            std::memcpy(&value, bytes, sizeof(value));
+            return (double)value;
+        };
+        switch(type)
+        {
+        case Type::Int8:
+            return as(int8_t());
+        case Type::UInt8:
+            return as(uint8_t());
+        case Type::Int16:
+            return as(int16_t());
+        case Type::UInt16:
+            return as(uint16_t());
+        case Type::Int32:
+            return as(int32_t());
+        case Type::UInt32:
+            return as(uint32_t());
+        case Type::Float32:
+            return as(float());
+        default:
+            return as(double());
+        }
+    };
+    bool hasNormals = false, hasUVs = false;
+    std::vector<uint32_t> polygon;
+    for(const Element& element : elements)
+    {
+        bool isVertex = element.name == "vertex";
+        bool isFace   = element.name == "face";
+        // the attribute of the mesh every property goes to, -1 for skipped ones
+        std::vector<int> targets;
+        for(const Property& property : element.properties)
+        {
+            static const char* const s_vertexNames[][2] = {{"x", "x"}, {"y", "y"}, {"z", "z"}, {"nx", "nx"}, {"ny", "ny"}, {"nz", "nz"}, {"u", "s"}, {"v", "t"}};
+            int target = -1;
+            for(int i = 0; isVertex && property.countType == Type::Invalid && i < 8; ++i)
+            {
+                if(property.name == s_vertexNames[i][0] || property.name == s_vertexNames[i][1])
+                    target = i;
+            }
+            if(isFace && property.countType != Type::Invalid && (property.name == "vertex_indices" || property.name == "vertex_index"))
+                target = 0;
+            targets.push_back(target);
+            hasNormals |= target == 3;
+            hasUVs     |= target == 6;
+        }
+        if(isVertex)
+        {
+            mesh.positions.reserve(element.count);
+            if(hasNormals)
+                mesh.normals.reserve(element.count);
+            if(hasUVs)
+                mesh.uvs.reserve(element.count);
+        }
+        if(isFace)
+            mesh.indices.reserve(element.count * 3);
+
+        for(uint64_t item = 0; item < element.count && valid; ++item)
+        {
+            float vertex[8] = {};
+            for(size_t p = 0; p < element.properties.size(); ++p)
+            {
+                const Property& property = element.properties[p];
+                if(property.countType == Type::Invalid)
+                {
+                    double value = read(property.type);
+                    if(targets[p] >= 0)
+                        vertex[targets[p]] = (float)value;
+                    continue;
+                }
+                uint64_t count = (uint64_t)read(property.countType);
+                polygon.clear();
+                for(uint64_t i = 0; i < count && valid; ++i)
+                    polygon.push_back((uint32_t)read(property.type));
+                for(size_t i = 2; targets[p] == 0 && i < polygon.size(); ++i)
+                    mesh.indices.insert(mesh.indices.end(), {polygon[0], polygon[i - 1], polygon[i]});
+            }
+            if(isVertex)
+            {
+                mesh.positions.emplace_back(vertex[0], vertex[1], vertex[2]);
+                if(hasNormals)
+                    mesh.normals.emplace_back(vertex[3], vertex[4], vertex[5]);
+                if(hasUVs)
+                    mesh.uvs.emplace_back(vertex[6], vertex[7]);
+            }
+        }
+    }
+    for(uint32_t index : mesh.indices)
+        valid &= index < mesh.positions.size();
+    if(!valid)
+    {
+        std::cerr << "ERROR: PLY file " << path << " is truncated or has indices out of range" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Reads the v, vt, vn and f lines of an OBJ file, everything else is ignored. Every distinct combination of
+// position, UV and normal index becomes one vertex and polygons are split into fans of triangles. Normals
+// and UVs are kept only if every face corner has them.
+inline bool LoadObj(const std::string& path, MeshData& mesh)
+{
+    PROFILE_SCOPE("LoadObj");
+    MappedFile file;
+    if(!file.Open(path, 0))
+    {
+        std::cerr << "ERROR: Couldn't open " << path << std::endl;
+        return false;
+    }
+    const char* cursor = static_cast<const char*>(file.Data());
+    const char* end    = cursor + file.Size();
+
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> uvs;
+    struct Corner
+    {
+        int64_t position, uv, normal;  // -1 if missing
+        bool operator==(const Corner&) const = default;
+    };
+    struct CornerHash
+    {
+        size_t operator()(const Corner& c) const
+        {
+            return std::hash<int64_t>()(c.position) ^ (std::hash<int64_t>()(c.uv) * 31) ^ (std::hash<int64_t>()(c.normal) * 131);
+        }
+    };
+    std::unordered_map<Corner, uint32_t, CornerHash> vertices;
+    std::vector<Corner> corners;  // of the vertices, in order
+    std::vector<uint32_t> polygon;
+    bool valid = true;
+
+    auto skipSpaces = [&]()
+    {
+        while(cursor < end && (*cursor == ' ' || *cursor == '\t'))
+            ++cursor;
+    };
+    auto atLineEnd = [&]()
+    {
+        skipSpaces();
+        return cursor >= end || *cursor == '\n' || *cursor == '\r';
+    };
+    auto readFloat = [&]()
+    {
+        skipSpaces();
+        float value = 0.0f;
+        auto result = std::from_chars(cursor, end, value);
+        valid      &= result.ec == std::errc();
+        cursor      = result.ptr;
+        return value;
+    };
+    // 1-based, or negative counting back from the last one so far, returns -1 for an empty index
+    auto readIndex = [&](size_t count) -> int64_t
+    {
+        int64_t value = 0;
+        auto result   = std::from_chars(cursor, end, value);
+        if(result.ec != std::errc())
+            return -1;
+        cursor        = result.ptr;
+        int64_t index = value < 0 ? (int64_t)count + value : value - 1;
+        valid        &= index >= 0 && index < (int64_t)count;
+        return index;
+    };
+
+    while(cursor < end && valid)
+    {
+        skipSpaces();
+        const char* lineStart = cursor;
+        while(cursor < end && *cursor != ' ' && *cursor != '\t' && *cursor != '\n' && *cursor != '\r')
+            ++cursor;
+        std::string_view keyword(lineStart, cursor - lineStart);
+        if(keyword == "v")
+        {
+            float x = readFloat(), y = readFloat(), z = readFloat();
+            positions.emplace_back(x, y, z);
+        }
+        else if(keyword == "vn")
+        {
+            float x = readFloat(), y = readFloat(), z = readFloat();
+            normals.emplace_back(x, y, z);
+        }
+        else if(keyword == "vt")
+        {
+            float u = readFloat(), v = atLineEnd() ? 0.0f : readFloat();
+            uvs.emplace_back(u, v);
+        }
+        else if(keyword == "f")
+        {
+            polygon.clear();
+            while(!atLineEnd())
+            {
+                Corner corner = {readIndex(positions.size()), -1, -1};
+                valid        &= corner.position >= 0;
+                if(cursor < end && *cursor == '/')
+                {
+                    ++cursor;
+                    corner.uv = readIndex(uvs.size());
+                    if(cursor < end && *cursor == '/')
+                    {
+                        ++cursor;
+                        corner.normal = readIndex(normals.size());
+                    }
+                }
+                if(!valid)
+                    break;
+                auto [it, inserted] = vertices.try_emplace(corner, (uint32_t)corners.size());
+                if(inserted)
+                    corners.push_back(corner);
+                polygon.push_back(it->second);
+            }
+            for(size_t i = 2; i < polygon.size(); ++i)
+                mesh.indices.insert(mesh.indices.end(), {polygon[0], polygon[i - 1], polygon[i]});
+        }
+        // the rest of the line, including comments and unknown keywords
+        while(cursor < end && *cursor != '\n')
+            ++cursor;
+        if(cursor < end)
+            ++cursor;
+    }
+    if(!valid)
+    {
+        std::cerr << "ERROR: Malformed OBJ file " << path << std::endl;
+        return false;
+    }
+
+    bool hasNormals = !corners.empty(), hasUVs = !corners.empty();
+    for(const Corner& corner : corners)
+    {
+        hasNormals &= corner.normal >= 0;
+        hasUVs     &= corner.uv >= 0;
+    }
+    mesh.positions.reserve(corners.size());
+    for(const Corner& corner : corners)
+    {
+        mesh.positions.push_back(positions[corner.position]);
+        if(hasNormals)
+            mesh.normals.push_back(normals[corner.normal]);
+        if(hasUVs)
+            mesh.uvs.push_back(uvs[corner.uv]);
+    }
+    return true;
+}
+
+// Loads a .rmesh, .ply or .obj file into the shape arena, returns null on errors. compressed applies to
+// .ply and .obj files, a .rmesh is kept the way it was written.
+inline TriangleMesh* LoadMesh(const std::string& path, Material* mat, bool compressed = false)
+{
+    auto start            = std::chrono::steady_clock::now();
+    std::string extension = std::filesystem::path(path).extension().string();
+    TriangleMesh* mesh    = nullptr;
+    if(extension == ".rmesh")
+        mesh = MapMeshFile(path, mat);
+    else if(extension == ".ply" || extension == ".obj")
+    {
+        MeshData data;
+        if(extension == ".ply" ? LoadPly(path, data) : LoadObj(path, data))
+            mesh = g_shapeAllocator.Allocate<TriangleMesh>(data, mat, compressed);
+    }
+    else
+        std::cerr << "ERROR: Unknown mesh format " << path << ", expected .rmesh, .ply or .obj" << std::endl;
+    if(mesh)
+        std::cout << "Loaded " << path << " in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                  << " ms" << std::endl;
+    return mesh;
+}
+
+// Parses a PLY or OBJ file, builds its BVH and writes it as a packed file to output
+inline bool ConvertMesh(const std::string& input, const std::string& output, bool compressed = false)
+{
+    std::string extension = std::filesystem::path(input).extension().string();
+    if(extension != ".ply" && extension != ".obj")
+    {
+        std::cerr << "ERROR: Only .ply and .obj files can be converted, not " << input << std::endl;
+        return false;
+    }
+    TriangleMesh* mesh = LoadMesh(input, nullptr, compressed);
+    if(!mesh || !WriteMeshFile(output, *mesh))
+        return false;
+    std::cout << "Wrote " << mesh->GetTriangleCount() << " triangles to " << output << std::endl;
+    return true;
+}
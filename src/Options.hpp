@@ -0,0 +1,303 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Aov.hpp"
+#include "Benchmark.hpp"
+#include "Framebuffer.hpp"
+#include "Quality.hpp"
+#include "Scenes.hpp"
+
+struct RenderOptions
+{
+    std::string scene        = "cornell";
+    std::string mesh;                  // .rmesh, .ply or .obj file shown by the mesh scene instead of its torus knot
+    std::string convertMesh;           // .ply or .obj file to write as a .rmesh instead of rendering
+    bool compressMesh        = false;  // quantized positions, octahedral normals and half UVs for the mesh
+    uint32_t width           = 600;
+    uint32_t height          = 600;
+    uint32_t samplesPerPixel = 0;      // total, 0 keeps accumulating until the window is closed
+    uint32_t samplesPerPass  = 1;
+    float frameTime          = 33.0f;  // milliseconds, windowed mode sizes its frames to this; 0 traces full passes
+    uint32_t historySamples  = 16;     // samples a pixel keeps when the camera moves
+    int maxDepth             = 50;
+    int numThreads           = 0;      // 0 uses every hardware thread
+    uint32_t tileRows        = 0;      // > 0 renders out of core in bands of this many rows
+    float autosaveInterval   = 0.0f;   // seconds between background saves, 0 disables them
+    float checkpointInterval = 300.0f;
+    std::string output;                // empty picks the next free ../images/image<N>_<spp>.png
+    std::string checkpoint;            // empty disables checkpointing
+    std::vector<std::string> resume;   // several checkpoints are merged
+    std::optional<uint64_t> seed;      // picked at random if not given
+    ResolveSettings resolve;
+    bool heatmap = false;              // show the traversal cost of the camera rays instead of the image
+    std::vector<Aov> aovs;             // written to the EXR output, or an _aov.exr next to a PNG
+    std::string profile;               // Chrome trace written at exit, empty keeps the default profile.json
+    bool benchmarkResolve = false;
+    std::string benchmark;             // JSON report, not empty runs the benchmark instead of rendering
+    uint32_t benchmarkRepeats = BENCHMARK_REPEATS;
+    std::string quality;               // directory of the references and baseline, not empty runs the quality check
+    bool qualityUpdate = false;        // replace the baseline with this run
+    bool scaling       = false;        // report the thread scaling of the scene instead of rendering
+#ifdef RAYTRACER_HEADLESS
+    bool headless = true;
+#else
+    bool headless = false;
+#endif
+};
+
+inline void PrintUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --scene <name|index>      scene to render (default cornell):";
+    for(const char* name : g_sceneNames)
+        std::cout << " " << name;
+    std::cout << "\n"
+              << "  --mesh <file>             render the mesh scene with a .rmesh, .ply or .obj mesh instead of its torus knot\n"
+              << "  --convert-mesh <file>     write a .ply or .obj mesh as a .rmesh that loads without parsing\n"
+              << "                            (to --output, default next to it)\n"
+              << "  --compress-mesh           store the mesh (or the converted .rmesh) compressed, about a third of the memory\n"
+              << "                            for slower intersection\n"
+              << "  --width <pixels>          image width (default 600)\n"
+              << "  --height <pixels>         image height (default 600)\n"
+              << "  --spp <n>                 samples per pixel to render, then stop (headless default 64)\n"
+              << "  --samples-per-pass <n>    samples per pixel of every pass when frames aren't budgeted (default 1)\n"
+              << "  --frame-time <ms>         windowed frame time budget, frames trace as many samples or pixels as fit\n"
+              << "                            (default 33, 0 traces a full pass of --samples-per-pass every frame)\n"
+              << "  --history-samples <n>     samples worth of history a pixel keeps through a camera move (default 16, 0 discards it)\n"
+              << "  --depth <n>               maximum path depth (default 50)\n"
+              << "  --threads <n>             number of render threads (default: all hardware threads)\n"
+              << "  --output <file.png|exr>   output image, .exr keeps the linear HDR values (default ../images/image<N>_<spp>.png)\n"
+              << "  --autosave <seconds>      periodically save the image in the background (to --output or ../images/autosave.png)\n"
+              << "  --tile-rows <n>           render out of core in bands of n rows, streamed to an EXR (implies --headless)\n"
+              << "  --seed <n>                seed of the sample sequence, equal seeds give identical renders\n"
+              << "  --checkpoint <file>       periodically save the HDR accumulation buffer to resume from later\n"
+              << "  --checkpoint-interval <s> seconds between checkpoints (default 300)\n"
+              << "  --resume <file>           continue a checkpointed render, repeat to merge renders from several machines\n"
+              << "  --exposure <f>            exposure multiplier applied before tone mapping (default 1)\n"
+              << "  --tonemap <clamp|reinhard> tone mapping operator (default clamp)\n"
+              << "  --denoise                 filter the noise out of the displayed image and saved PNGs\n"
+              << "  --heatmap                 show the BVH nodes and primitives each camera ray visits as a false colour image\n"
+              << "                            (needs a RAYTRACER_STATS build, --exposure scales the costs)\n"
+              << "  --profile <file.json>     where to write the timeline at exit (default profile.json, needs a RAYTRACER_PROFILE build)\n"
+              << "  --aov <list>              comma separated render passes saved as EXR layers along with the image:\n"
+              << "                           ";
+    for(const char* name : g_aovNames)
+        std::cout << " " << name;
+    std::cout << "\n"
+              << "  --headless                render without opening a window\n"
+              << "  --bench-resolve           after a headless render, time the resolve pass against the old inline path\n"
+              << "  --benchmark <file.json>   time every scene at fixed settings and write the rays per second to a JSON file\n"
+              << "                            (default " << BENCHMARK_SIZE << "x" << BENCHMARK_SIZE << ", " << BENCHMARK_SPP << " spp, seed " << BENCHMARK_SEED << ")\n"
+              << "  --benchmark-repeats <n>   timed renders per scene (default " << BENCHMARK_REPEATS << ")\n"
+              << "  --quality <dir>           render every scene and compare it against references in dir, made on the first run\n"
+              << "                            (default " << QUALITY_SIZE << "x" << QUALITY_SIZE << ", " << QUALITY_SPP << " spp, seed " << QUALITY_SEED << ", references at "
+              << QUALITY_REFERENCE_SPP << " spp), fails if an error grew over the baseline\n"
+              << "  --quality-update          make this --quality run the new baseline\n"
+              << "  --scaling                 render the scene with 1, 2, 4... up to --threads threads at the benchmark settings\n"
+              << "                            and report the speedup, per worker busy and idle times and the row skew\n"
+              << "  --help                    show this message" << std::endl;
+}
+
+// Returns false if the program should exit instead of rendering (--help or a bad argument)
+inline bool ParseOptions(int argc, char** argv, RenderOptions& options)
+{
+    bool hasSize = false;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto next       = [&]() -> std::string
+        {
+            if(i + 1 >= argc)
+                throw std::invalid_argument("missing value for " + arg);
+            return argv[++i];
+        };
+
+        try
+        {
+            if(arg == "--scene")
+                options.scene = next();
+            else if(arg == "--mesh")
+            {
+                options.mesh  = next();
+                options.scene = "mesh";
+            }
+            else if(arg == "--convert-mesh")
+                options.convertMesh = next();
+            else if(arg == "--compress-mesh")
+                options.compressMesh = true;
+            else if(arg == "--width")
+            {
+                options.width = std::stoul(next());
+                hasSize       = true;
+            }
+            else if(arg == "--height")
+            {
+                options.height = std::stoul(next());
+                hasSize        = true;
+            }
+            else if(arg == "--spp")
+                options.samplesPerPixel = std::stoul(next());
+            else if(arg == "--samples-per-pass")
+                options.samplesPerPass = std::stoul(next());
+            else if(arg == "--frame-time")
+                options.frameTime = std::stof(next());
+            else if(arg == "--history-samples")
+                options.historySamples = std::stoul(next());
+            else if(arg == "--depth")
+                options.maxDepth = std::stoi(next());
+            else if(arg == "--threads")
+                options.numThreads = std::stoi(next());
+            else if(arg == "--output")
+                options.output = next();
+            else if(arg == "--autosave")
+                options.autosaveInterval = std::stof(next());
+            else if(arg == "--tile-rows")
+                options.tileRows = std::stoul(next());
+            else if(arg == "--seed")
+                options.seed = std::stoull(next());
+            else if(arg == "--checkpoint")
+                options.checkpoint = next();
+            else if(arg == "--checkpoint-interval")
+                options.checkpointInterval = std::stof(next());
+            else if(arg == "--resume")
+                options.resume.push_back(next());
+            else if(arg == "--exposure")
+                options.resolve.exposure = std::stof(next());
+            else if(arg == "--tonemap")
+            {
+                std::string name = next();
+                if(name == "clamp")
+                    options.resolve.toneMapping = ToneMapping::Clamp;
+                else if(name == "reinhard")
+                    options.resolve.toneMapping = ToneMapping::Reinhard;
+                else
+                    throw std::invalid_argument("unknown tone mapping " + name);
+            }
+            else if(arg == "--denoise")
+                options.resolve.denoise = true;
+            else if(arg == "--heatmap")
+            {
+#ifdef RAYTRACER_STATS
+                options.heatmap             = true;
+                options.resolve.toneMapping = ToneMapping::Heatmap;
+#else
+                throw std::invalid_argument("--heatmap needs a build with RAYTRACER_STATS");
+#endif
+            }
+            else if(arg == "--profile")
+            {
+#ifdef RAYTRACER_PROFILE
+                options.profile = next();
+#else
+                throw std::invalid_argument("--profile needs a build with RAYTRACER_PROFILE");
+#endif
+            }
+            else if(arg == "--aov")
+            {
+                std::string list = next();
+                for(size_t start = 0; start <= list.size();)
+                {
+                    size_t end       = std::min(list.find(',', start), list.size());
+                    std::string name = list.substr(start, end - start);
+                    auto it          = std::find(std::begin(g_aovNames), std::end(g_aovNames), name);
+                    if(it == std::end(g_aovNames))
+                        throw std::invalid_argument("unknown AOV " + name);
+                    Aov aov = (Aov)(it - std::begin(g_aovNames));
+                    if(std::find(options.aovs.begin(), options.aovs.end(), aov) == options.aovs.end())
+                        options.aovs.push_back(aov);
+                    start = end + 1;
+                }
+            }
+            else if(arg == "--headless")
+                options.headless = true;
+            else if(arg == "--bench-resolve")
+                options.benchmarkResolve = true;
+            else if(arg == "--benchmark")
+                options.benchmark = next();
+            else if(arg == "--benchmark-repeats")
+                options.benchmarkRepeats = std::stoul(next());
+            else if(arg == "--quality")
+                options.quality = next();
+            else if(arg == "--quality-update")
+                options.qualityUpdate = true;
+            else if(arg == "--scaling")
+                options.scaling = true;
+            else if(arg == "--help" || arg == "-h")
+            {
+                PrintUsage(argv[0]);
+                return false;
+            }
+            else
+                throw std::invalid_argument("unknown option " + arg);
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            PrintUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if(options.width == 0 || options.height == 0 || options.samplesPerPass == 0)
+    {
+        std::cerr << "ERROR: resolution and samples per pass must be positive" << std::endl;
+        return false;
+    }
+    if(options.tileRows > 0)
+    {
+        // only one band is in memory, there is no full frame to show or checkpoint
+        if(!options.checkpoint.empty() || !options.resume.empty())
+        {
+            std::cerr << "ERROR: --tile-rows can't be combined with checkpoints" << std::endl;
+            return false;
+        }
+        if(!options.output.empty() && std::filesystem::path(options.output).extension() != ".exr")
+        {
+            std::cerr << "ERROR: --tile-rows only writes .exr files" << std::endl;
+            return false;
+        }
+        options.headless = true;
+    }
+    if(!options.benchmark.empty() || options.scaling)
+    {
+        if(options.tileRows > 0 || !options.resume.empty() || options.benchmarkRepeats == 0)
+        {
+            std::cerr << "ERROR: --benchmark and --scaling can't be combined with --tile-rows or --resume, --benchmark-repeats has to be positive" << std::endl;
+            return false;
+        }
+        if(!hasSize)
+            options.width = options.height = BENCHMARK_SIZE;
+        if(options.samplesPerPixel == 0)
+            options.samplesPerPixel = BENCHMARK_SPP;
+        if(!options.seed)
+            options.seed = BENCHMARK_SEED;
+        options.headless = true;
+    }
+    if(!options.quality.empty())
+    {
+        if(options.tileRows > 0 || !options.resume.empty() || !options.benchmark.empty())
+        {
+            std::cerr << "ERROR: --quality can't be combined with --tile-rows, --resume or --benchmark" << std::endl;
+            return false;
+        }
+        if(!hasSize)
+            options.width = options.height = QUALITY_SIZE;
+        if(options.samplesPerPixel == 0)
+            options.samplesPerPixel = QUALITY_SPP;
+        if(!options.seed)
+            options.seed = QUALITY_SEED;
+        options.headless = true;
+    }
+    if(options.headless && options.samplesPerPixel == 0)
+        options.samplesPerPixel = 64;
+    // keep checkpointing into the file a single render was resumed from
+    if(options.checkpoint.empty() && options.resume.size() == 1)
+        options.checkpoint = options.resume[0];
+    return true;
+}
@@ -0,0 +1,302 @@
+#pragma once
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include "glm/glm.hpp"
+#include "glm/gtx/norm.hpp"
+#include "AABB.h"
+#include "Hittable.h"
+#include "Quad.hpp"
+#include "Sphere.h"
+#include "Stats.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// BVH leaves of up to PRIMITIVE_LEAF_WIDTH spheres or quads kept as a structure of arrays: a ray is tested
+// against all of them at once (with AVX2, one by one otherwise) instead of through a BVH node and a
+// virtual Hit() per primitive. Only the closest hit is handed to its primitive for the hit record. The
+// lanes past the count are zero and masked out.
+
+#define PRIMITIVE_LEAF_WIDTH 8
+
+#ifdef __AVX2__
+// The lane with the smallest t of the hit lanes (the first one on ties), -1 if none hit. tMax becomes its t.
+inline int ClosestLaneAvx2(__m256 t, __m256 hit, float& tMax)
+{
+    int hitLanes = _mm256_movemask_ps(hit);
+    if(hitLanes == 0)
+        return -1;
+    __m256 nearest = _mm256_blendv_ps(_mm256_set1_ps(std::numeric_limits<float>::infinity()), t, hit);
+    __m256 minimum = _mm256_min_ps(nearest, _mm256_permute_ps(nearest, _MM_SHUFFLE(2, 3, 0, 1)));
+    minimum        = _mm256_min_ps(minimum, _mm256_permute_ps(minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+    minimum        = _mm256_min_ps(minimum, _mm256_permute2f128_ps(minimum, minimum, 1));
+    tMax           = _mm256_cvtss_f32(minimum);
+    return std::countr_zero((unsigned)(_mm256_movemask_ps(_mm256_cmp_ps(nearest, minimum, _CMP_EQ_OQ)) & hitLanes));
+}
+
+inline __m256 UsedLanesAvx2(uint32_t count)
+{
+    return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32((int)count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+}
+#endif
+
+class SphereLeaf : public Hittable
+{
+public:
+    // false if the leaf is full
+    bool Add(const Sphere* sphere)
+    {
+        if(m_count == PRIMITIVE_LEAF_WIDTH)
+            return false;
+        AABB box;
+        sphere->BoundingBox(box);
+        m_aabb = m_count == 0 ? box : SurroundingBox(m_aabb, box);
+        for(int i = 0; i < 3; ++i)
+            m_center[i][m_count] = sphere->m_center[i];
+        m_radius2[m_count]   = sphere->m_radius * sphere->m_radius;
+        m_spheres[m_count++] = sphere;
+        return true;
+    }
+    uint32_t GetCount() const { return m_count; }
+
+    virtual bool Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const override
+    {
+        STATS_COUNT(bvhNodes);
+        if(!m_aabb.Hit(r, tMin, tMax))
+            return false;
+        return HitSpheres(r, tMin, tMax, outRecord);
+    }
+    // Hit() without the bounding box test, for owners that already did it
+    bool HitSpheres(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const
+    {
+        STATS_ADD(primitiveTests[PRIMITIVE_SPHERE], m_count);
+        int lane = Intersect(r, tMin, tMax);
+        if(lane < 0)
+            return false;
+        m_spheres[lane]->SetHitRecord(r, tMax, outRecord);
+        return true;
+    }
+    virtual bool BoundingBox(AABB& outAABB) const override
+    {
+        outAABB = m_aabb;
+        return true;
+    }
+
+    // The lane of the closest sphere hit between tMin and tMax (which becomes its distance) or -1, the same
+    // test as Sphere::Hit()
+    int IntersectScalar(const Ray& r, float tMin, float& tMax) const
+    {
+        int closest  = -1;
+        float a      = glm::length2(r.GetDir());
+        // a later lane at the same distance doesn't replace an earlier one, like in ClosestLaneAvx2()
+        auto outside = [&](float root)
+        { return root < tMin || root > tMax || (closest >= 0 && root == tMax); };
+        for(uint32_t lane = 0; lane < m_count; ++lane)
+        {
+            glm::vec3 oc = r.GetOrigin() - glm::vec3(m_center[0][lane], m_center[1][lane], m_center[2][lane]);
+            float halfB  = glm::dot(r.GetDir(), oc);
+            glm::vec3 f  = oc - (halfB / a) * r.GetDir();
+            float delta  = a * (m_radius2[lane] - glm::length2(f));
+            if(delta < 0.0f)
+                continue;
+            float sqrtDelta = std::sqrt(delta);
+            float root      = (-halfB - sqrtDelta) / a;
+            if(outside(root))
+            {
+                root = (-halfB + sqrtDelta) / a;
+                if(outside(root))
+                    continue;
+            }
+            tMax    = root;
+            closest = (int)lane;
+        }
+        return closest;
+    }
+#ifdef __AVX2__
+    int IntersectAvx2(const Ray& r, float tMin, float& tMax) const
+    {
+        glm::vec3 origin = r.GetOrigin();
+        glm::vec3 dir    = r.GetDir();
+        __m256 ocX       = _mm256_sub_ps(_mm256_set1_ps(origin.x), _mm256_load_ps(m_center[0]));
+        __m256 ocY       = _mm256_sub_ps(_mm256_set1_ps(origin.y), _mm256_load_ps(m_center[1]));
+        __m256 ocZ       = _mm256_sub_ps(_mm256_set1_ps(origin.z), _mm256_load_ps(m_center[2]));
+        __m256 a         = _mm256_set1_ps(glm::length2(dir));
+        __m256 halfB     = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(dir.x), ocX), _mm256_mul_ps(_mm256_set1_ps(dir.y), ocY)),
+                                         _mm256_mul_ps(_mm256_set1_ps(dir.z), ocZ));
+        __m256 along     = _mm256_div_ps(halfB, a);
+        __m256 fX        = _mm256_sub_ps(ocX, _mm256_mul_ps(along, _mm256_set1_ps(dir.x)));
+        __m256 fY        = _mm256_sub_ps(ocY, _mm256_mul_ps(along, _mm256_set1_ps(dir.y)));
+        __m256 fZ        = _mm256_sub_ps(ocZ, _mm256_mul_ps(along, _mm256_set1_ps(dir.z)));
+        __m256 f2        = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fX, fX), _mm256_mul_ps(fY, fY)), _mm256_mul_ps(fZ, fZ));
+        __m256 delta     = _mm256_mul_ps(a, _mm256_sub_ps(_mm256_load_ps(m_radius2), f2));
+        __m256 hit       = _mm256_and_ps(UsedLanesAvx2(m_count), _mm256_cmp_ps(delta, _mm256_setzero_ps(), _CMP_GE_OQ));
+        __m256 sqrtDelta = _mm256_sqrt_ps(_mm256_max_ps(delta, _mm256_setzero_ps()));
+        __m256 nearRoot  = _mm256_div_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_setzero_ps(), halfB), sqrtDelta), a);
+        __m256 farRoot   = _mm256_div_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_setzero_ps(), halfB), sqrtDelta), a);
+        __m256 lower     = _mm256_set1_ps(tMin);
+        __m256 upper     = _mm256_set1_ps(tMax);
+        __m256 nearHit   = _mm256_and_ps(_mm256_cmp_ps(nearRoot, lower, _CMP_GE_OQ), _mm256_cmp_ps(nearRoot, upper, _CMP_LE_OQ));
+        __m256 farHit    = _mm256_and_ps(_mm256_cmp_ps(farRoot, lower, _CMP_GE_OQ), _mm256_cmp_ps(farRoot, upper, _CMP_LE_OQ));
+        hit              = _mm256_and_ps(hit, _mm256_or_ps(nearHit, farHit));
+        return ClosestLaneAvx2(_mm256_blendv_ps(farRoot, nearRoot, nearHit), hit, tMax);
+    }
+#endif
+    int Intersect(const Ray& r, float tMin, float& tMax) const
+    {
+#ifdef __AVX2__
+        return IntersectAvx2(r, tMin, tMax);
+#else
+        return IntersectScalar(r, tMin, tMax);
+#endif
+    }
+
+private:
+    alignas(32) float m_center[3][PRIMITIVE_LEAF_WIDTH] = {};
+    alignas(32) float m_radius2[PRIMITIVE_LEAF_WIDTH]   = {};
+    const Sphere* m_spheres[PRIMITIVE_LEAF_WIDTH]       = {};
+    uint32_t m_count                                    = 0;
+    AABB m_aabb;
+};
+
+// The quads are tested like Quad::Hit() does, except that the plane coordinates are dot products with
+// V x W and W x U instead of triple products with W
+class QuadLeaf : public Hittable
+{
+public:
+    // false if the leaf is full
+    bool Add(const Quad* quad)
+    {
+        if(m_count == PRIMITIVE_LEAF_WIDTH)
+            return false;
+        AABB box;
+        quad->BoundingBox(box);
+        m_aabb          = m_count == 0 ? box : SurroundingBox(m_aabb, box);
+        glm::vec3 uAxis = glm::cross(quad->m_V, quad->m_W);
+        glm::vec3 vAxis = glm::cross(quad->m_W, quad->m_U);
+        for(int i = 0; i < 3; ++i)
+        {
+            m_Q[i][m_count]      = quad->m_Q[i];
+            m_normal[i][m_count] = quad->m_normal[i];
+            m_uAxis[i][m_count]  = uAxis[i];
+            m_vAxis[i][m_count]  = vAxis[i];
+        }
+        m_quads[m_count++] = quad;
+        return true;
+    }
+    uint32_t GetCount() const { return m_count; }
+
+    virtual bool Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const override
+    {
+        STATS_COUNT(bvhNodes);
+        if(!m_aabb.Hit(r, tMin, tMax))
+            return false;
+        return HitQuads(r, tMin, tMax, outRecord);
+    }
+    // Hit() without the bounding box test, for owners that already did it
+    bool HitQuads(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const
+    {
+        STATS_ADD(primitiveTests[PRIMITIVE_QUAD], m_count);
+        glm::vec2 uv;
+        int lane = Intersect(r, tMin, tMax, uv);
+        if(lane < 0)
+            return false;
+        m_quads[lane]->SetHitRecord(r, tMax, uv, outRecord);
+        return true;
+    }
+    virtual bool BoundingBox(AABB& outAABB) const override
+    {
+        outAABB = m_aabb;
+        return true;
+    }
+
+    // The lane of the closest quad hit between tMin and tMax (which becomes its distance) or -1, uv are the
+    // coordinates of the hit on it
+    int IntersectScalar(const Ray& r, float tMin, float& tMax, glm::vec2& uv) const
+    {
+        int closest = -1;
+        for(uint32_t lane = 0; lane < m_count; ++lane)
+        {
+            glm::vec3 normal(m_normal[0][lane], m_normal[1][lane], m_normal[2][lane]);
+            glm::vec3 Q(m_Q[0][lane], m_Q[1][lane], m_Q[2][lane]);
+            float nDotDir = glm::dot(normal, r.GetDir());
+            if(std::abs(nDotDir) < 0.0001f)
+                continue;  // parallel to the plane
+            float t = glm::dot(Q - r.GetOrigin(), normal) / nDotDir;
+            if(t < tMin || t > tMax || (closest >= 0 && t == tMax))
+                continue;  // the first of the lanes at the same distance wins, like in ClosestLaneAvx2()
+            glm::vec3 QP = r.At(t) - Q;
+            float u      = glm::dot(QP, glm::vec3(m_uAxis[0][lane], m_uAxis[1][lane], m_uAxis[2][lane]));
+            float v      = glm::dot(QP, glm::vec3(m_vAxis[0][lane], m_vAxis[1][lane], m_vAxis[2][lane]));
+            if(u < 0 || u > 1 || v < 0 || v > 1)
+                continue;
+            tMax    = t;
+            uv      = glm::vec2(u, v);
+            closest = (int)lane;
+        }
+        return closest;
+    }
+#ifdef __AVX2__
+    int IntersectAvx2(const Ray& r, float tMin, float& tMax, glm::vec2& uv) const
+    {
+        auto dot = [](__m256 x0, __m256 y0, __m256 z0, __m256 x1, __m256 y1, __m256 z1)
+        { return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x0, x1), _mm256_mul_ps(y0, y1)), _mm256_mul_ps(z0, z1)); };
+        glm::vec3 origin = r.GetOrigin();
+        glm::vec3 dir    = r.GetDir();
+        __m256 originX   = _mm256_set1_ps(origin.x);
+        __m256 originY   = _mm256_set1_ps(origin.y);
+        __m256 originZ   = _mm256_set1_ps(origin.z);
+        __m256 dirX      = _mm256_set1_ps(dir.x);
+        __m256 dirY      = _mm256_set1_ps(dir.y);
+        __m256 dirZ      = _mm256_set1_ps(dir.z);
+        __m256 normalX   = _mm256_load_ps(m_normal[0]);
+        __m256 normalY   = _mm256_load_ps(m_normal[1]);
+        __m256 normalZ   = _mm256_load_ps(m_normal[2]);
+        __m256 QX        = _mm256_load_ps(m_Q[0]);
+        __m256 QY        = _mm256_load_ps(m_Q[1]);
+        __m256 QZ        = _mm256_load_ps(m_Q[2]);
+        __m256 nDotDir   = dot(normalX, normalY, normalZ, dirX, dirY, dirZ);
+        __m256 t         = _mm256_div_ps(dot(_mm256_sub_ps(QX, originX), _mm256_sub_ps(QY, originY), _mm256_sub_ps(QZ, originZ), normalX, normalY, normalZ), nDotDir);
+        __m256 QPX       = _mm256_sub_ps(_mm256_add_ps(originX, _mm256_mul_ps(t, dirX)), QX);
+        __m256 QPY       = _mm256_sub_ps(_mm256_add_ps(originY, _mm256_mul_ps(t, dirY)), QY);
+        __m256 QPZ       = _mm256_sub_ps(_mm256_add_ps(originZ, _mm256_mul_ps(t, dirZ)), QZ);
+        __m256 u         = dot(QPX, QPY, QPZ, _mm256_load_ps(m_uAxis[0]), _mm256_load_ps(m_uAxis[1]), _mm256_load_ps(m_uAxis[2]));
+        __m256 v         = dot(QPX, QPY, QPZ, _mm256_load_ps(m_vAxis[0]), _mm256_load_ps(m_vAxis[1]), _mm256_load_ps(m_vAxis[2]));
+
+        __m256 zero = _mm256_setzero_ps();
+        __m256 one  = _mm256_set1_ps(1.0f);
+        __m256 hit  = _mm256_and_ps(UsedLanesAvx2(m_count), _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), nDotDir), _mm256_set1_ps(0.0001f), _CMP_GE_OQ));
+        hit         = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(t, _mm256_set1_ps(tMin), _CMP_GE_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(tMax), _CMP_LE_OQ)));
+        hit         = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)));
+        hit         = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, one, _CMP_LE_OQ)));
+        int closest = ClosestLaneAvx2(t, hit, tMax);
+        if(closest >= 0)
+        {
+            alignas(32) float lanes[2][PRIMITIVE_LEAF_WIDTH];
+            _mm256_store_ps(lanes[0], u);
+            _mm256_store_ps(lanes[1], v);
+            uv = glm::vec2(lanes[0][closest], lanes[1][closest]);
+        }
+        return closest;
+    }
+#endif
+    int Intersect(const Ray& r, float tMin, float& tMax, glm::vec2& uv) const
+    {
+#ifdef __AVX2__
+        return IntersectAvx2(r, tMin, tMax, uv);
+#else
+        return IntersectScalar(r, tMin, tMax, uv);
+#endif
+    }
+
+private:
+    alignas(32) float m_Q[3][PRIMITIVE_LEAF_WIDTH]      = {};
+    alignas(32) float m_normal[3][PRIMITIVE_LEAF_WIDTH] = {};
+    alignas(32) float m_uAxis[3][PRIMITIVE_LEAF_WIDTH]  = {};  // V x W
+    alignas(32) float m_vAxis[3][PRIMITIVE_LEAF_WIDTH]  = {};  // W x U
+    const Quad* m_quads[PRIMITIVE_LEAF_WIDTH]           = {};
+    uint32_t m_count                                    = 0;
+    AABB m_aabb;
+};
@@ -0,0 +1,150 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timeline profiling, only compiled in when RAYTRACER_PROFILE is defined (the RAYTRACER_PROFILE CMake option).
+// PROFILE_SCOPE(name) records when the enclosing scope started and ended into a ring buffer of the calling
+// thread, which no other thread writes, so recording takes no lock. At exit every buffer is written out in
+// the Chrome trace format, for chrome://tracing or ui.perfetto.dev. Without RAYTRACER_PROFILE the PROFILE_
+// macros expand to nothing.
+
+#define PROFILE_RING_SIZE (1 << 16)  // zones every thread keeps, the oldest are overwritten
+#define PROFILE_NO_INDEX  -1
+
+#ifdef RAYTRACER_PROFILE
+
+struct ProfileZone
+{
+    const char* name;  // a string literal
+    int64_t index;     // shown as an argument of the zone, PROFILE_NO_INDEX for none
+    uint64_t start;    // nanoseconds since the profiler started
+    uint64_t end;
+};
+
+struct ProfileThread
+{
+    std::string name;
+    uint32_t id;
+    std::atomic<uint64_t> count          = 0;  // zones ever recorded, the last PROFILE_RING_SIZE of them are kept
+    std::unique_ptr<ProfileZone[]> zones = std::make_unique<ProfileZone[]>(PROFILE_RING_SIZE);
+};
+
+// Owns the ring buffers of every thread that ever recorded something, they outlive the threads
+class Profiler
+{
+public:
+    ~Profiler() { Write(); }
+
+    static uint64_t Now()
+    {
+        static const auto start = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    ProfileThread& GetThread()
+    {
+        thread_local ProfileThread* thread = [this]
+        {
+            std::lock_guard lock(m_mutex);
+            ProfileThread* created = m_threads.emplace_back(std::make_unique<ProfileThread>()).get();
+            created->id            = (uint32_t)m_threads.size();
+            created->name          = "Thread " + std::to_string(created->id);
+            return created;
+        }();
+        return *thread;
+    }
+
+    // Only the thread itself names itself, before the trace is written
+    void SetThreadName(const std::string& name) { GetThread().name = name; }
+    void SetOutput(const std::string& filename) { m_filename = filename; }
+
+    // Called at exit, when the threads that recorded are gone. Runs that recorded nothing, like --help or a
+    // bad command line, don't write a file.
+    void Write()
+    {
+        if(m_filename.empty())
+            return;
+        std::lock_guard lock(m_mutex);
+        bool recorded = false;
+        for(const auto& thread : m_threads)
+            recorded |= thread->count.load(std::memory_order_acquire) > 0;
+        if(!recorded)
+            return;
+        std::ofstream file(m_filename);
+        file << "{\"traceEvents\":[\n";
+        bool first = true;
+        for(const auto& thread : m_threads)
+        {
+            file << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << thread->id
+                 << ",\"args\":{\"name\":\"" << thread->name << "\"}}";
+            first          = false;
+            uint64_t count = thread->count.load(std::memory_order_acquire);
+            for(uint64_t i = count > PROFILE_RING_SIZE ? count - PROFILE_RING_SIZE : 0; i < count; ++i)
+            {
+                const ProfileZone& zone = thread->zones[i % PROFILE_RING_SIZE];
+                file << ",\n{\"ph\":\"X\",\"name\":\"" << zone.name << "\",\"pid\":1,\"tid\":" << thread->id << ",\"ts\":" << zone.start / 1000.0
+                     << ",\"dur\":" << (zone.end - zone.start) / 1000.0;
+                if(zone.index != PROFILE_NO_INDEX)
+                    file << ",\"args\":{\"index\":" << zone.index << "}";
+                file << "}";
+            }
+        }
+        file << "\n]}\n";
+        if(file.good())
+            std::cout << "Wrote the profile to: " << m_filename << std::endl;
+        else
+            std::cerr << "ERROR: Couldn't write the profile to " << m_filename << std::endl;
+        m_filename.clear();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<ProfileThread>> m_threads;
+    std::string m_filename = "profile.json";
+};
+inline Profiler g_profiler;
+
+class ProfileScope
+{
+public:
+    ProfileScope(const char* name, int64_t index = PROFILE_NO_INDEX)
+        : m_thread(g_profiler.GetThread()), m_name(name), m_index(index), m_start(Profiler::Now())
+    {
+    }
+    ~ProfileScope()
+    {
+        // only this thread writes the ring, the release makes the zone visible to Write() with the count
+        uint64_t count                            = m_thread.count.load(std::memory_order_relaxed);
+        m_thread.zones[count % PROFILE_RING_SIZE] = {m_name, m_index, m_start, Profiler::Now()};
+        m_thread.count.store(count + 1, std::memory_order_release);
+    }
+    ProfileScope(const ProfileScope&)            = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    ProfileThread& m_thread;
+    const char* m_name;
+    int64_t m_index;
+    uint64_t m_start;
+};
+
+#define PROFILE_CONCAT_(a, b)            a##b
+#define PROFILE_CONCAT(a, b)             PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name)              ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_SCOPE_INDEX(name, index) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, index)
+#define PROFILE_THREAD_NAME(name)        g_profiler.SetThreadName(name)
+
+#else
+
+#define PROFILE_SCOPE(name)              ((void)0)
+#define PROFILE_SCOPE_INDEX(name, index) ((void)0)
+#define PROFILE_THREAD_NAME(name)        ((void)0)
+
+#endif
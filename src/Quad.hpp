@@ -2,6 +2,7 @@
 
 #include "AABB.h"
 #include "Hittable.h"
+#include "Stats.hpp"
 #include "3DMath/Random.h"
 
 class Quad : public Hittable
@@ -17,6 +18,7 @@ public:
 
     virtual bool Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const override
     {
+        STATS_COUNT(primitiveTests[PRIMITIVE_QUAD]);
         float nDotDir = glm::dot(m_normal, r.GetDir());
         if(glm::abs(nDotDir) < 0.0001f)
             return false;  // Ray is parallel to the plane
@@ -32,11 +34,7 @@ public:
         if(u < 0 || u > 1 || v < 0 || v > 1)
             return false;
 
-        outRecord.t        = t;
-        outRecord.point    = P;
-        outRecord.material = m_material;
-        outRecord.uv       = glm::vec2(u, v);
-        outRecord.SetNormal(r, m_normal);
+        SetHitRecord(r, t, glm::vec2(u, v), outRecord);
         return true;
     }
 
@@ -67,9 +65,20 @@ public:
 
 
 private:
+    friend class QuadLeaf;  // copies the quads into its lanes and shades their hits
+
     glm::vec3 m_Q, m_U, m_V;
     glm::vec3 m_W;
     glm::vec3 m_normal;
     Material* m_material;
     float m_area;
+
+    void SetHitRecord(const Ray& r, float t, const glm::vec2& uv, HitRecord& outRecord) const
+    {
+        outRecord.t        = t;
+        outRecord.point    = r.At(t);
+        outRecord.material = m_material;
+        outRecord.uv       = uv;
+        outRecord.SetNormal(r, m_normal);
+    }
 };
@@ -0,0 +1,302 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+
+// Defaults of --quality. The test renders are compared against references traced with far more samples
+// and an unrelated seed, their remaining noise adds about QUALITY_SPP / QUALITY_REFERENCE_SPP to the relMSE.
+#define QUALITY_SIZE           128    // pixels, width and height unless given on the command line
+#define QUALITY_SPP            64     // samples per pixel of the test renders unless given on the command line
+#define QUALITY_SEED           1      // of the test renders unless given on the command line
+#define QUALITY_REFERENCE_SPP  1024
+#define QUALITY_REFERENCE_SEED 0x5EED
+#define QUALITY_TOLERANCE      0.1    // a metric may grow by this fraction over the baseline before the check fails
+
+struct ImageError
+{
+    double rmse   = 0.0;
+    double relMse = 0.0;  // squared error over the squared reference, so that dark and bright regions count alike
+    double flip   = 0.0;  // mean of the FLIP-style perceptual difference, 0 (identical) to 1
+};
+
+// One point of the error over time curve of a scene
+struct QualitySample
+{
+    std::string scene;
+    uint32_t samplesPerPixel = 0;
+    double seconds           = 0.0;  // spent tracing up to here
+    ImageError error;
+};
+
+namespace quality
+{
+// Separable convolution of a single channel image, clamping at the borders. kernel has an odd size.
+inline std::vector<float> Convolve(const std::vector<float>& image, uint32_t width, uint32_t height, const std::vector<float>& kernelX,
+                                   const std::vector<float>& kernelY)
+{
+    std::vector<float> rows(image.size()), out(image.size());
+    int radius = (int)kernelX.size() / 2;
+    for(uint32_t y = 0; y < height; ++y)
+    {
+        for(uint32_t x = 0; x < width; ++x)
+        {
+            float sum = 0.0f;
+            for(int k = -radius; k <= radius; ++k)
+                sum += kernelX[k + radius] * image[(size_t)y * width + std::clamp<int>(x + k, 0, width - 1)];
+            rows[(size_t)y * width + x] = sum;
+        }
+    }
+    for(uint32_t y = 0; y < height; ++y)
+    {
+        for(uint32_t x = 0; x < width; ++x)
+        {
+            float sum = 0.0f;
+            for(int k = -radius; k <= radius; ++k)
+                sum += kernelY[k + radius] * rows[(size_t)std::clamp<int>(y + k, 0, height - 1) * width + x];
+            out[(size_t)y * width + x] = sum;
+        }
+    }
+    return out;
+}
+
+// derivative 0, 1 or 2 of a Gaussian. The blur sums to 1, the positive and the negative weights of the
+// derivatives sum to 1 and -1 each, like the edge and point detectors of FLIP.
+inline std::vector<float> GaussianKernel(float sigma, int derivative)
+{
+    int radius = (int)std::ceil(3.0f * sigma);
+    std::vector<float> kernel(2 * radius + 1);
+    for(int i = -radius; i <= radius; ++i)
+    {
+        float g = std::exp(-(float)(i * i) / (2.0f * sigma * sigma));
+        if(derivative == 1)
+            g *= -(float)i;
+        else if(derivative == 2)
+            g *= (float)(i * i) / (sigma * sigma) - 1.0f;
+        kernel[i + radius] = g;
+    }
+    if(derivative == 2)
+    {
+        float mean = 0.0f;
+        for(float k : kernel)
+            mean += k / kernel.size();
+        for(float& k : kernel)
+            k -= mean;
+    }
+    float positive = 0.0f, negative = 0.0f;
+    for(float k : kernel)
+        (k > 0.0f ? positive : negative) += k;
+    for(float& k : kernel)
+        k = derivative == 0 ? k / positive : (k > 0.0f ? k / positive : -k / negative);
+    return kernel;
+}
+
+// Linear sRGB to CIE L*a*b* with a D65 white point
+inline glm::vec3 LinearToLab(const glm::vec3& rgb)
+{
+    glm::vec3 xyz(0.4124f * rgb.r + 0.3576f * rgb.g + 0.1805f * rgb.b, 0.2126f * rgb.r + 0.7152f * rgb.g + 0.0722f * rgb.b,
+                  0.0193f * rgb.r + 0.1192f * rgb.g + 0.9505f * rgb.b);
+    xyz /= glm::vec3(0.9505f, 1.0f, 1.0888f);
+    auto f = [](float t)
+    { return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.0f / 116.0f; };
+    glm::vec3 ft(f(xyz.x), f(xyz.y), f(xyz.z));
+    return glm::vec3(116.0f * ft.y - 16.0f, 500.0f * (ft.x - ft.y), 200.0f * (ft.y - ft.z));
+}
+
+// HyAB distance of two Hunt adjusted Lab colours, FLIP's colour difference
+inline float HyAB(const glm::vec3& lab0, const glm::vec3& lab1)
+{
+    glm::vec2 ab0 = glm::vec2(lab0.y, lab0.z) * 0.01f * lab0.x;
+    glm::vec2 ab1 = glm::vec2(lab1.y, lab1.z) * 0.01f * lab1.x;
+    return std::abs(lab0.x - lab1.x) + glm::length(ab0 - ab1);
+}
+}  // namespace quality
+
+// Compares two linear images of width * height pixels. The FLIP-style metric follows the structure of
+// NVIDIA's FLIP on the values the Clamp tone mapping displays: both images are low pass filtered, more
+// in the chroma channels than in luminance, compared as Hunt adjusted HyAB colour differences and the
+// difference is amplified where the edges and points of the two differ. The filters are fixed pixel
+// sizes instead of FLIP's contrast sensitivity functions of the viewing distance.
+inline ImageError CompareImages(const std::vector<glm::vec3>& image, const std::vector<glm::vec3>& reference, uint32_t width, uint32_t height)
+{
+    using namespace quality;
+    ImageError error;
+    size_t count = (size_t)width * height;
+    for(size_t i = 0; i < count; ++i)
+    {
+        glm::vec3 difference = image[i] - reference[i];
+        glm::vec3 squared    = difference * difference;
+        error.rmse          += squared.r + squared.g + squared.b;
+        glm::vec3 relative   = squared / (reference[i] * reference[i] + 0.01f);
+        error.relMse        += relative.r + relative.g + relative.b;
+    }
+    error.rmse    = std::sqrt(error.rmse / (3.0 * count));
+    error.relMse /= 3.0 * count;
+
+    // Opponent colour space: luminance and two chroma channels, filtered separately
+    std::vector<float> channels[2][3];
+    const std::vector<glm::vec3>* images[2] = {&image, &reference};
+    for(int j = 0; j < 2; ++j)
+    {
+        for(auto& channel : channels[j])
+            channel.resize(count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            glm::vec3 c       = glm::clamp((*images[j])[i], 0.0f, 1.0f);
+            channels[j][0][i] = 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+            channels[j][1][i] = c.r - c.g;
+            channels[j][2][i] = 0.5f * (c.r + c.g) - c.b;
+        }
+    }
+    const std::vector<float> luminanceBlur = GaussianKernel(0.5f, 0);
+    const std::vector<float> chromaBlur    = GaussianKernel(1.5f, 0);
+    const std::vector<float> edge          = GaussianKernel(1.5f, 1);
+    const std::vector<float> point         = GaussianKernel(1.5f, 2);
+    const std::vector<float> blur          = GaussianKernel(1.5f, 0);
+    std::vector<float> filtered[2][3], edges[2], points[2];
+    for(int j = 0; j < 2; ++j)
+    {
+        filtered[j][0] = Convolve(channels[j][0], width, height, luminanceBlur, luminanceBlur);
+        filtered[j][1] = Convolve(channels[j][1], width, height, chromaBlur, chromaBlur);
+        filtered[j][2] = Convolve(channels[j][2], width, height, chromaBlur, chromaBlur);
+
+        // FLIP detects features on the luminance normalized to [0, 1]
+        std::vector<float> gx = Convolve(channels[j][0], width, height, edge, blur);
+        std::vector<float> gy = Convolve(channels[j][0], width, height, blur, edge);
+        std::vector<float> px = Convolve(channels[j][0], width, height, point, blur);
+        std::vector<float> py = Convolve(channels[j][0], width, height, blur, point);
+        edges[j].resize(count);
+        points[j].resize(count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            edges[j][i]  = std::sqrt(gx[i] * gx[i] + gy[i] * gy[i]);
+            points[j][i] = std::sqrt(px[i] * px[i] + py[i] * py[i]);
+        }
+    }
+
+    // The colour difference is compressed and remapped so that the difference of pure green and pure blue is 1
+    const float maxDifference = std::pow(HyAB(LinearToLab(glm::vec3(0, 1, 0)), LinearToLab(glm::vec3(0, 0, 1))), 0.7f);
+    const float breakPoint    = 0.4f * maxDifference;
+    for(size_t i = 0; i < count; ++i)
+    {
+        glm::vec3 lab[2];
+        for(int j = 0; j < 2; ++j)
+        {
+            float y = filtered[j][0][i], rg = filtered[j][1][i], by = filtered[j][2][i];
+            // inverse of the opponent transform above
+            float g = y - (0.2126f + 0.5f * 0.0722f) * rg + 0.0722f * by;
+            lab[j]  = LinearToLab(glm::clamp(glm::vec3(g + rg, g, g + 0.5f * rg - by), 0.0f, 1.0f));
+        }
+        float difference = std::pow(HyAB(lab[0], lab[1]), 0.7f);
+        float color      = difference < breakPoint ? 0.95f * difference / breakPoint
+                                                   : 0.95f + 0.05f * (difference - breakPoint) / (maxDifference - breakPoint);
+        float feature    = std::max(std::abs(edges[0][i] - edges[1][i]), std::abs(points[0][i] - points[1][i]));
+        feature          = std::pow(std::min(feature / std::sqrt(2.0f), 1.0f), 0.5f);
+        error.flip      += std::pow(std::min(color, 1.0f), 1.0f - feature);
+    }
+    error.flip /= count;
+    return error;
+}
+
+// "scene,spp,seconds,rmse,relmse,flip" lines after a header, the report and baseline format of --quality
+inline bool WriteQualityCsv(const std::string& filename, const std::vector<QualitySample>& samples)
+{
+    std::ofstream file(filename);
+    if(!file)
+        return false;
+    file << "scene,spp,seconds,rmse,relmse,flip\n";
+    for(const QualitySample& sample : samples)
+        file << sample.scene << "," << sample.samplesPerPixel << "," << sample.seconds << "," << sample.error.rmse << ","
+             << sample.error.relMse << "," << sample.error.flip << "\n";
+    return file.good();
+}
+inline bool ReadQualityCsv(const std::string& filename, std::vector<QualitySample>& samples)
+{
+    std::ifstream file(filename);
+    std::string line;
+    if(!file || !std::getline(file, line))
+        return false;
+    while(std::getline(file, line))
+    {
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream stream(line);
+        QualitySample sample;
+        if(stream >> sample.scene >> sample.samplesPerPixel >> sample.seconds >> sample.error.rmse >> sample.error.relMse >> sample.error.flip)
+            samples.push_back(sample);
+    }
+    return true;
+}
+
+// Log-log plot of the relMSE over the tracing time of every scene, the baseline dashed. A change that
+// renders faster but noisier or biased shows up as a curve above its baseline.
+inline bool WriteQualitySvg(const std::string& filename, const std::vector<QualitySample>& samples, const std::vector<QualitySample>& baseline)
+{
+    static const char* const colors[] = {"#1f77b4", "#ff7f0e", "#2ca02c", "#d62728", "#9467bd", "#8c564b", "#e377c2", "#7f7f7f"};
+    const float width = 800, height = 500, left = 70, right = 150, top = 20, bottom = 50;
+
+    double minSeconds = 1e30, maxSeconds = 0, minError = 1e30, maxError = 0;
+    for(const auto* curves : {&samples, &baseline})
+    {
+        for(const QualitySample& sample : *curves)
+        {
+            if(sample.seconds <= 0.0 || sample.error.relMse <= 0.0)
+                continue;
+            minSeconds = std::min(minSeconds, sample.seconds);
+            maxSeconds = std::max(maxSeconds, sample.seconds);
+            minError   = std::min(minError, sample.error.relMse);
+            maxError   = std::max(maxError, sample.error.relMse);
+        }
+    }
+    if(maxSeconds == 0)
+        return false;
+    // whole decades on both axes
+    double x0 = std::floor(std::log10(minSeconds)), x1 = std::max(std::ceil(std::log10(maxSeconds)), x0 + 1);
+    double y0 = std::floor(std::log10(minError)), y1 = std::max(std::ceil(std::log10(maxError)), y0 + 1);
+    auto toX = [&](double seconds)
+    { return left + (std::log10(seconds) - x0) / (x1 - x0) * (width - left - right); };
+    auto toY = [&](double error)
+    { return height - bottom - (std::log10(error) - y0) / (y1 - y0) * (height - top - bottom); };
+
+    std::ofstream file(filename);
+    if(!file)
+        return false;
+    file << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << width << "\" height=\"" << height << "\" font-family=\"sans-serif\" font-size=\"12\">\n"
+         << "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n";
+    for(double d = x0; d <= x1; ++d)
+        file << "<line x1=\"" << toX(std::pow(10.0, d)) << "\" y1=\"" << top << "\" x2=\"" << toX(std::pow(10.0, d)) << "\" y2=\""
+             << height - bottom << "\" stroke=\"#ddd\"/><text x=\"" << toX(std::pow(10.0, d)) << "\" y=\"" << height - bottom + 16
+             << "\" text-anchor=\"middle\">1e" << d << "</text>\n";
+    for(double d = y0; d <= y1; ++d)
+        file << "<line x1=\"" << left << "\" y1=\"" << toY(std::pow(10.0, d)) << "\" x2=\"" << width - right << "\" y2=\""
+             << toY(std::pow(10.0, d)) << "\" stroke=\"#ddd\"/><text x=\"" << left - 6 << "\" y=\"" << toY(std::pow(10.0, d)) + 4
+             << "\" text-anchor=\"end\">1e" << d << "</text>\n";
+    file << "<text x=\"" << (left + width - right) / 2 << "\" y=\"" << height - 12 << "\" text-anchor=\"middle\">seconds</text>\n"
+         << "<text x=\"16\" y=\"" << (top + height - bottom) / 2 << "\" text-anchor=\"middle\" transform=\"rotate(-90 16 "
+         << (top + height - bottom) / 2 << ")\">relMSE</text>\n";
+
+    std::vector<std::string> scenes;
+    for(const QualitySample& sample : samples)
+        if(std::find(scenes.begin(), scenes.end(), sample.scene) == scenes.end())
+            scenes.push_back(sample.scene);
+    for(size_t s = 0; s < scenes.size(); ++s)
+    {
+        const char* color = colors[s % std::size(colors)];
+        for(const auto* curves : {&baseline, &samples})
+        {
+            file << "<polyline fill=\"none\" stroke=\"" << color << "\" stroke-width=\"2\"" << (curves == &baseline ? " stroke-dasharray=\"6 4\"" : "")
+                 << " points=\"";
+            for(const QualitySample& sample : *curves)
+                if(sample.scene == scenes[s] && sample.seconds > 0.0 && sample.error.relMse > 0.0)
+                    file << toX(sample.seconds) << "," << toY(sample.error.relMse) << " ";
+            file << "\"/>\n";
+        }
+        file << "<text x=\"" << width - right + 10 << "\" y=\"" << top + 12 + 18 * s << "\" fill=\"" << color << "\">" << scenes[s] << "</text>\n";
+    }
+    file << "<text x=\"" << width - right + 10 << "\" y=\"" << top + 12 + 18 * scenes.size() + 10 << "\" fill=\"#555\">dashed: baseline</text>\n"
+         << "</svg>\n";
+    return file.good();
+}
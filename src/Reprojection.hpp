@@ -0,0 +1,114 @@
+#pragma once
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include "Camera.h"
+#include "Framebuffer.hpp"
+#include "System.hpp"
+#include "WorkerPool.hpp"
+
+// Carries the accumulated samples over a camera move instead of throwing them away. Every pixel is
+// turned back into the point it saw using its stored depth, projected into the new camera and
+// scattered into the pixel it lands in, the closest point winning where several land in the same one.
+// Pixels nothing lands in (disocclusions, magnification) start over empty. The history of a pixel is
+// scaled down to at most maxHistorySamples samples so the new samples quickly take over from
+// reprojection errors like moving reflections.
+class Reprojector
+{
+public:
+    Reprojector(uint32_t width, uint32_t height)
+        : m_history(width, height), m_winners((size_t)width * height)
+    {
+    }
+
+    void Apply(Framebuffer& framebuffer, const Camera& oldCam, const Camera& newCam, WorkerPool& workers, uint32_t maxHistorySamples)
+    {
+        const uint32_t width  = framebuffer.GetWidth();
+        const uint32_t height = framebuffer.GetHeight();
+        m_history.CopyFrom(framebuffer);
+        workers.ParallelFor(height, [&](size_t y)
+                            {
+            framebuffer.ClearRow(y);
+            std::fill_n(&m_winners[y * width], width, std::numeric_limits<uint64_t>::max()); });
+        if(maxHistorySamples == 0)
+            return;
+
+        // Where the pixel lands in the new image and its distance to the new camera
+        auto land = [&](uint32_t x, uint32_t y, size_t& target, float& distance)
+        {
+            if(m_history.GetSampleCount(x, y) == 0)
+                return false;
+            float depth   = m_history.GetDepth(x, y);
+            glm::vec3 dir = oldCam.GetCenterDirection((x + 0.5f) / (width - 1), (height - 1 - y + 0.5f) / (height - 1));
+            glm::vec3 point;
+            if(std::isinf(depth))
+            {
+                // the background is infinitely far away, only rotations move it
+                point    = newCam.GetOrigin() + dir;
+                distance = std::numeric_limits<float>::infinity();
+            }
+            else
+            {
+                point    = oldCam.GetOrigin() + dir * depth;
+                distance = glm::distance(point, newCam.GetOrigin());
+            }
+
+            glm::vec2 uv;
+            if(!newCam.Project(point, uv))
+                return false;
+            float targetX = std::floor(uv.x * (width - 1));
+            float targetY = height - 1 - std::floor(uv.y * (height - 1));
+            if(!(targetX >= 0.0f && targetX < width && targetY >= 0.0f && targetY < height))
+                return false;
+            target = (size_t)targetY * width + (size_t)targetX;
+            return true;
+        };
+        // Non-negative floats order like their bits, the source index breaks ties so every target
+        // pixel has exactly one winner
+        auto key = [&](float distance, uint32_t x, uint32_t y)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &distance, sizeof(bits));
+            return ((uint64_t)bits << 32) | ((uint64_t)y * width + x);
+        };
+
+        workers.ParallelFor(height, [&](size_t y)
+                            {
+            for(uint32_t x = 0; x < width; ++x)
+            {
+                size_t target;
+                float distance;
+                if(!land(x, y, target, distance))
+                    continue;
+                uint64_t candidate = key(distance, x, y);
+                std::atomic_ref<uint64_t> winner(m_winners[target]);
+                uint64_t current = winner.load(std::memory_order_relaxed);
+                while(candidate < current && !winner.compare_exchange_weak(current, candidate, std::memory_order_relaxed))
+                {
+                }
+            } });
+
+        workers.ParallelFor(height, [&](size_t y)
+                            {
+            for(uint32_t x = 0; x < width; ++x)
+            {
+                size_t target;
+                float distance;
+                if(!land(x, y, target, distance) || m_winners[target] != key(distance, x, y))
+                    continue;
+                uint32_t count   = m_history.GetSampleCount(x, y);
+                uint32_t kept    = std::min(count, maxHistorySamples);
+                uint32_t targetX = target % width;
+                uint32_t targetY = target / width;
+                framebuffer.AddSamples(targetX, targetY, m_history.GetSum(x, y) * ((float)kept / count), kept);
+                framebuffer.SetDepth(targetX, targetY, distance);
+                framebuffer.AddFeatures(targetX, targetY, m_history.GetAlbedo(x, y) * (float)kept, m_history.GetNormal(x, y), kept);
+            } });
+    }
+
+private:
+    Framebuffer m_history;
+    PageArray<uint64_t> m_winners;  // per target pixel, the key of the closest pixel landing there
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <typeindex>
+#include <unordered_map>
+#include "glm/glm.hpp"
+#include "Allocator.hpp"
+
+// Hash-conses immutable scene resources (materials, textures): asking twice for the same type with equal
+// constructor arguments returns the instance created the first time instead of allocating a copy.
+// Only use it for objects that hold no per-instance mutable state.
+class ResourceCache
+{
+public:
+    ResourceCache(LinearAllocator& allocator) : m_allocator(allocator) {}
+
+    template<typename T, typename... Args>
+    T* Get(Args&&... args)
+    {
+        using Key = std::tuple<KeyType<Args>...>;
+
+        auto key    = std::make_shared<Key>(std::forward<Args>(args)...);
+        size_t hash = std::apply([](const auto&... values)
+                                 {
+                                     size_t seed = std::type_index(typeid(T)).hash_code();
+                                     (HashCombine(seed, values), ...);
+                                     return seed; },
+                                 *key);
+
+        auto& stats = m_stats[typeid(T)];
+        stats.name  = typeid(T).name();
+        stats.size  = sizeof(T);
+        stats.requests++;
+
+        auto range = m_entries.equal_range(hash);
+        for(auto it = range.first; it != range.second; ++it)
+        {
+            if(it->second.type == typeid(T) && *static_cast<const Key*>(it->second.key.get()) == *key)
+                return static_cast<T*>(it->second.object);
+        }
+
+        T* object = std::apply([this](const auto&... values)
+                               { return m_allocator.Allocate<T>(values...); },
+                               *key);
+        m_entries.emplace(hash, Entry{typeid(T), key, object});
+        stats.unique++;
+        return object;
+    }
+
+    void PrintReport() const
+    {
+        size_t requests = 0, unique = 0, savedBytes = 0;
+        std::cout << "Resource cache:" << std::endl;
+        for(const auto& [type, stats] : m_stats)
+        {
+            std::cout << "    " << stats.name << ": " << stats.requests << " requested, " << stats.unique << " unique" << std::endl;
+            requests   += stats.requests;
+            unique     += stats.unique;
+            savedBytes += (stats.requests - stats.unique) * stats.size;
+        }
+        std::cout << "    total: " << requests << " requested, " << unique << " unique, "
+                  << savedBytes << " bytes saved" << std::endl;
+    }
+
+    // Must be called before the backing allocator is reset, the cached pointers are dangling afterwards
+    void Clear()
+    {
+        m_entries.clear();
+        m_stats.clear();
+    }
+
+private:
+    // string literals are keyed by value, not by address
+    template<typename A>
+    using KeyType = std::conditional_t<std::is_convertible_v<std::decay_t<A>, std::string>, std::string, std::decay_t<A>>;
+
+    template<typename V>
+    static void HashCombine(size_t& seed, const V& value)
+    {
+        seed ^= std::hash<V>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+    template<int L, typename V>
+    static void HashCombine(size_t& seed, const glm::vec<L, V>& value)
+    {
+        for(int i = 0; i < L; ++i)
+            HashCombine(seed, value[i]);
+    }
+
+    struct Entry
+    {
+        std::type_index type;
+        std::shared_ptr<void> key;
+        void* object;
+    };
+    struct Stats
+    {
+        const char* name = "";
+        size_t size      = 0;
+        size_t requests  = 0;
+        size_t unique    = 0;
+    };
+
+    LinearAllocator& m_allocator;
+    std::unordered_multimap<size_t, Entry> m_entries;
+    std::map<std::type_index, Stats> m_stats;
+};
+
+extern ResourceCache g_materialCache;
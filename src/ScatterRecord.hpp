@@ -5,6 +5,6 @@
 struct ScatterRecord
 {
     Ray skipPDFRay;
-    std::shared_ptr<PDF> pdf;
+    PDF* pdf = nullptr;  // allocated from the scratch allocator
     glm::vec3 attenuation;
 };
@@ -0,0 +1,482 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include "glm/glm.hpp"
+#include "glm/gtx/norm.hpp"
+#include "glm/ext/scalar_constants.hpp"
+#include "3DMath/Random.h"
+#include "Allocator.hpp"
+#include "BVH.h"
+#include "Box.hpp"
+#include "HittableList.h"
+#include "Material.h"
+#include "Profiler.hpp"
+#include "Quad.hpp"
+#include "ResourceCache.hpp"
+#include "Sphere.h"
+#include "Texture.h"
+#include "Transformations.hpp"
+#include "MeshFile.hpp"
+#include "TriangleMesh.hpp"
+#include "Volumes.hpp"
+
+// Resolution of the torus knot of the mesh scene, a million triangles
+#define MESH_SCENE_SEGMENTS  2048
+#define MESH_SCENE_SIDES     256
+#define MESH_SCENE_FILE_SIZE 330.0f  // largest extent a mesh file is scaled to
+
+inline HittableList RandomScene()
+{
+    // Materials
+    auto* sphereMat = g_materialCache.Get<Lambertian>(glm::vec3(0.8f, 0.f, 0.2f));
+    auto* groundMat = g_materialCache.Get<Lambertian>(
+        g_materialCache.Get<CheckerTexture>(glm::vec3(0.f), glm::vec3(1.f)));
+    auto* sphereLeft = g_materialCache.Get<Dielectric>(1.5f);
+    auto* metalRight = g_materialCache.Get<Metal>(glm::vec3(0.8f, 0.6f, 0.2f), 1.f);
+    // world
+    HittableList world;
+
+    constexpr int gridSize = 11;
+    for(int a = -gridSize; a < gridSize; a++)
+    {
+        for(int b = -gridSize; b < gridSize; b++)
+        {
+            auto matChoice = math::RandomReal<float>();
+            glm::vec3 center(a + 0.9f * math::RandomReal<float>(), 0.2f,
+                             b + 0.9f * math::RandomReal<float>());
+            if(glm::length2(center - glm::vec3(4.f, 0.2f, 0.f)) > 0.9f * 0.9f)
+            {
+                Material* mat;
+                if(matChoice < 0.6f)
+                {
+                    // diffuse
+                    auto albedo = math::RandomInUnitSphere<float>() * math::RandomInUnitSphere<float>();  // random color
+                    mat         = g_materialCache.Get<Lambertian>(albedo);
+                }
+                else if(matChoice < 0.85f)
+                {
+                    // metal
+                    auto albedo = glm::vec3(math::RandomReal<float>(0.5f, 1.0f),
+                                            math::RandomReal<float>(0.5f, 1.0f),
+                                            math::RandomReal<float>(0.5f, 1.0f));
+                    auto fuzz   = math::RandomReal<float>(0.f, 0.5f);
+                    mat         = g_materialCache.Get<Metal>(albedo, fuzz);
+                }
+                else
+                {
+                    // glass
+                    mat = g_materialCache.Get<Dielectric>(1.5f);
+                }
+                world.Add(g_shapeAllocator.Allocate<Sphere>(center, 0.2f, mat));
+            }
+        }
+    }
+    auto* mat1 = g_materialCache.Get<Dielectric>(1.5f);
+    world.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(0, 1, 0), 1.f, mat1));
+
+    auto* mat2 = g_materialCache.Get<Lambertian>(glm::vec3(0.4f, 0.2f, 0.1f));
+    world.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(-4, 1, 0), 1.f, mat2));
+
+    auto* mat3 = g_materialCache.Get<Metal>(glm::vec3(0.7f, 0.6f, 0.5f), 0.f);
+    world.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(4, 1, 0), 1.f, mat3));
+    // Render into a PPM image
+    //
+
+    BVHNode worldBVH(world);
+
+    HittableList objects;
+    objects.Add(g_shapeAllocator.Allocate<BVHNode>(worldBVH));
+    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(0, -1000, 0), 1000.f,
+                                                  groundMat));  // "ground"
+
+    return objects;
+}
+
+inline HittableList Earth()
+{
+    auto* texture = g_materialCache.Get<ImageTexture>(AssetPath("earthmap.jpg"));
+    auto* mat     = g_materialCache.Get<Lambertian>(texture);
+    auto* globe   = g_shapeAllocator.Allocate<Sphere>(glm::vec3(0), 2.f, mat);
+
+    HittableList objects;
+    objects.Add(globe);
+    return objects;
+}
+inline HittableList EmissionScene()
+{
+    auto* texture = g_materialCache.Get<ImageTexture>(AssetPath("earthmap.jpg"));
+    auto* mat1    = g_materialCache.Get<Lambertian>(texture);
+    auto* mat2    = g_materialCache.Get<Emissive>(4.0f * glm::vec3(1, 1, 1));
+
+    auto* sphere1 = g_shapeAllocator.Allocate<Sphere>(glm::vec3(0, 2, 0), 2.0f, mat1);
+    auto* light   = g_shapeAllocator.Allocate<Quad>(glm::vec3(3, 1, -2), glm::vec3(2, 0, 0), glm::vec3(0, 2, 0), mat2);
+
+    HittableList objects;
+    objects.Add(sphere1);
+    objects.Add(light);
+
+    auto* groundMat = g_materialCache.Get<Lambertian>(
+        g_materialCache.Get<SolidColor>(glm::vec3(1, 1, 0)));
+    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(0, -1000, 0), 1000.f,
+                                                  groundMat));  // "ground"
+    // 10), -5, groundMat));
+    return objects;
+}
+inline HittableList CornellBox()
+{
+    HittableList objects;
+
+    auto* red   = g_materialCache.Get<Lambertian>(glm::vec3(.65, .05, .05));
+    auto* white = g_materialCache.Get<Lambertian>(glm::vec3(.73, .73, .73));
+    auto* green = g_materialCache.Get<Lambertian>(glm::vec3(.12, .45, .15));
+    auto* light = g_materialCache.Get<Emissive>(7.0f * glm::vec3(1));
+
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), glm::vec3(0, 0, 555), green));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(0, 555, 0), glm::vec3(0, 0, 555), red));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(555, 0, 0), glm::vec3(0, 0, 555), white));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(555, 555, 555), glm::vec3(-555, 0, 0), glm::vec3(0, 0, -555), white));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 555), glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), white));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(213, 554, 227), glm::vec3(130, 0, 0), glm::vec3(0, 0, 105), light));
+    // objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), white));
+
+    Hittable* box1 = g_shapeAllocator.Allocate<Box>(glm::vec3(0, 0, 0), glm::vec3(165, 330, 165), white);
+    box1           = g_shapeAllocator.Allocate<RotateY>(box1, 15);
+    box1           = g_shapeAllocator.Allocate<Translate>(box1, glm::vec3(265, 0, 295));
+    objects.Add(box1);
+
+    // Hittable* box2 = g_shapeAllocator.Allocate<Box>(glm::vec3(0, 0, 0), glm::vec3(165, 165, 165), white);
+    // box2           = g_shapeAllocator.Allocate<RotateY>(box2, -18);
+    // box2           = g_shapeAllocator.Allocate<Translate>(box2, glm::vec3(130, 0, 65));
+    // objects.Add(box2);
+    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(190, 90, 190), 90.f, g_materialCache.Get<Dielectric>(1.5f)));
+    return objects;
+}
+inline HittableList CornellBoxLights()
+{
+    HittableList objects;
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(113, 554, 127), glm::vec3(330, 0, 0), glm::vec3(0, 0, 305), nullptr));
+    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(190, 90, 190), 90.f, nullptr));
+    return objects;
+}
+
+
+inline HittableList SmokeCornellBox()
+{
+    HittableList objects;
+
+    auto* red   = g_materialCache.Get<Lambertian>(glm::vec3(.65, .05, .05));
+    auto* white = g_materialCache.Get<Lambertian>(glm::vec3(.73, .73, .73));
+    auto* green = g_materialCache.Get<Lambertian>(glm::vec3(.12, .45, .15));
+    auto* light = g_materialCache.Get<Emissive>(7.0f * glm::vec3(1));
+
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), glm::vec3(0, 0, 555), green));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(0, 555, 0), glm::vec3(0, 0, 555), red));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(555, 0, 0), glm::vec3(0, 0, 555), white));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(555, 555, 555), glm::vec3(-555, 0, 0), glm::vec3(0, 0, -555), white));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 555), glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), white));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(113, 554, 127), glm::vec3(330, 0, 0), glm::vec3(0, 0, 305), light));
+    // objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), white));
+
+    Hittable* box1 = g_shapeAllocator.Allocate<Box>(glm::vec3(0, 0, 0), glm::vec3(165, 330, 165), white);
+    box1           = g_shapeAllocator.Allocate<RotateY>(box1, 15);
+    box1           = g_shapeAllocator.Allocate<Translate>(box1, glm::vec3(265, 0, 295));
+    objects.Add(g_shapeAllocator.Allocate<ConstantMedium>(box1, 0.002f, glm::vec3(0, 0, 0)));
+
+    Hittable* box2 = g_shapeAllocator.Allocate<Box>(glm::vec3(0, 0, 0), glm::vec3(165, 165, 165), white);
+    box2           = g_shapeAllocator.Allocate<RotateY>(box2, -18);
+    box2           = g_shapeAllocator.Allocate<Translate>(box2, glm::vec3(130, 0, 65));
+    objects.Add(g_shapeAllocator.Allocate<ConstantMedium>(box2, 0.002f, glm::vec3(1, 1, 1)));
+    // objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(190, 90, 400), 90.f,
+    //                                               g_materialAllocator.Allocate<Dielectric>(1.5f)));
+    // objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(400, 90, 300), 85.f,
+    //                                               g_materialAllocator.Allocate<Metal>(glm::vec3(0.8f, 0.8f, 0.8f), 0.1f)));
+
+    return objects;
+}
+inline HittableList Perlin()
+{
+    auto* texture = g_materialCache.Get<PerlinNoise>(6);
+    auto* mat     = g_materialCache.Get<Lambertian>(texture);
+    auto* globe   = g_shapeAllocator.Allocate<Sphere>(glm::vec3(0), 2.f, mat);
+
+    HittableList objects;
+    objects.Add(globe);
+    return objects;
+}
+
+
+inline HittableList FinalScene()
+{
+    HittableList boxes1;
+    auto* ground = g_materialCache.Get<Lambertian>(glm::vec3(0.48, 0.83, 0.53));
+
+    constexpr int boxesPerSide = 20;
+    for(int i = 0; i < boxesPerSide; ++i)
+    {
+        for(int j = 0; j < boxesPerSide; ++j)
+        {
+            float w  = 100.0f;
+            float x0 = -1000.0f + i * w;
+            float z0 = -1000.0f + j * w;
+            float y0 = 0.0f;
+            float x1 = x0 + w;
+            float y1 = math::RandomReal<float>(1, 101);
+            float z1 = z0 + w;
+
+            boxes1.Add(g_shapeAllocator.Allocate<Box>(glm::vec3(x0, y0, z0), glm::vec3(x1, y1, z1), ground));
+        }
+    }
+
+    HittableList objects;
+    objects.Add(g_shapeAllocator.Allocate<BVHNode>(boxes1));
+
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(123, 554, 147), glm::vec3(300, 0, 0), glm::vec3(0, 0, 265),
+                                                g_materialCache.Get<Emissive>(glm::vec3(7.0f))));
+
+    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(260, 150, 45), 50, g_materialCache.Get<Dielectric>(1.5f)));
+    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(0, 150, 145), 50, g_materialCache.Get<Metal>(glm::vec3(0.8, 0.8, 0.9), 1.0)));
+
+    auto* boundary = g_shapeAllocator.Allocate<Sphere>(glm::vec3(360, 150, 145), 70, g_materialCache.Get<Dielectric>(1.5f));
+    objects.Add(boundary);
+    objects.Add(g_shapeAllocator.Allocate<ConstantMedium>(boundary, 0.2f, glm::vec3(0.2, 0.4, 0.9)));
+    auto* boundary2 = g_shapeAllocator.Allocate<Sphere>(glm::vec3(0), 5000, g_materialCache.Get<Dielectric>(1.5f));
+    objects.Add(g_shapeAllocator.Allocate<ConstantMedium>(boundary2, 0.0001f, glm::vec3(1)));
+
+    auto* emat = g_materialCache.Get<Lambertian>(g_materialCache.Get<ImageTexture>(AssetPath("earthmap.jpg")));
+    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(400, 200, 400), 100, emat));
+
+    auto* pertext = g_materialCache.Get<PerlinNoise>(2);
+    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(220, 280, 300), 80, g_materialCache.Get<Lambertian>(pertext)));
+
+    HittableList boxes2;
+    auto* white = g_materialCache.Get<Lambertian>(glm::vec3(0.73, 0.73, 0.73));
+    int ns      = 1000;
+    for(int j = 0; j < ns; j++)
+    {
+        float x = math::RandomReal<float>(0, 165);
+        float y = math::RandomReal<float>(0, 165);
+        float z = math::RandomReal<float>(0, 165);
+        boxes2.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(x, y, z), 10, white));
+    }
+
+    objects.Add(g_shapeAllocator.Allocate<Translate>(g_shapeAllocator.Allocate<RotateY>(g_shapeAllocator.Allocate<BVHNode>(boxes2), 15), glm::vec3(-100, 270, 395)));
+
+    return objects;
+}
+
+// Tube of the given radius around a (p, q) torus knot of about 3 * scale in diameter, segments rings of
+// sides vertices each with smooth normals. The rings wrap around in both directions without duplicated
+// vertices, so the surface is closed.
+inline MeshData TorusKnotMesh(int p, int q, float scale, float radius, uint32_t segments, uint32_t sides)
+{
+    auto curve = [&](float t)
+    {
+        float r = scale * (2.0f + std::cos(q * t));
+        return glm::vec3(r * std::cos(p * t), r * std::sin(p * t), scale * std::sin(q * t));
+    };
+
+    MeshData mesh;
+    mesh.positions.reserve((size_t)segments * sides);
+    mesh.normals.reserve((size_t)segments * sides);
+    for(uint32_t i = 0; i < segments; ++i)
+    {
+        float t            = 2.0f * glm::pi<float>() * i / segments;
+        glm::vec3 center   = curve(t);
+        glm::vec3 next     = curve(t + 0.01f);
+        glm::vec3 tangent  = next - center;
+        glm::vec3 binormal = glm::normalize(glm::cross(tangent, next + center));
+        glm::vec3 normal   = glm::normalize(glm::cross(binormal, tangent));
+        for(uint32_t j = 0; j < sides; ++j)
+        {
+            float angle         = 2.0f * glm::pi<float>() * j / sides;
+            glm::vec3 direction = -std::cos(angle) * normal + std::sin(angle) * binormal;
+            mesh.positions.push_back(center + radius * direction);
+            mesh.normals.push_back(direction);
+        }
+    }
+    mesh.indices.reserve((size_t)segments * sides * 6);
+    for(uint32_t i = 0; i < segments; ++i)
+    {
+        for(uint32_t j = 0; j < sides; ++j)
+        {
+            uint32_t a = i * sides + j;
+            uint32_t b = (i + 1) % segments * sides + j;
+            uint32_t c = (i + 1) % segments * sides + (j + 1) % sides;
+            uint32_t d = i * sides + (j + 1) % sides;
+            mesh.indices.insert(mesh.indices.end(), {a, b, d, b, c, d});
+        }
+    }
+    return mesh;
+}
+
+// The Cornell box with a torus knot mesh of 2 * MESH_SCENE_SEGMENTS * MESH_SCENE_SIDES triangles in it, or
+// the mesh of meshFile standing on the floor if given. Returns false if the file couldn't be loaded.
+inline bool MeshScene(const std::string& meshFile, bool compressMesh, HittableList& objects)
+{
+    auto* red   = g_materialCache.Get<Lambertian>(glm::vec3(.65, .05, .05));
+    auto* white = g_materialCache.Get<Lambertian>(glm::vec3(.73, .73, .73));
+    auto* green = g_materialCache.Get<Lambertian>(glm::vec3(.12, .45, .15));
+    auto* light = g_materialCache.Get<Emissive>(7.0f * glm::vec3(1));
+
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), glm::vec3(0, 0, 555), green));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(0, 555, 0), glm::vec3(0, 0, 555), red));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(555, 0, 0), glm::vec3(0, 0, 555), white));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(555, 555, 555), glm::vec3(-555, 0, 0), glm::vec3(0, 0, -555), white));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 555), glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), white));
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(213, 554, 227), glm::vec3(130, 0, 0), glm::vec3(0, 0, 105), light));
+
+    auto* material = g_materialCache.Get<Metal>(glm::vec3(0.8f, 0.6f, 0.3f), 0.2f);
+    if(!meshFile.empty())
+    {
+        TriangleMesh* mesh = LoadMesh(meshFile, material, compressMesh);
+        AABB box;
+        if(!mesh || !mesh->BoundingBox(box))
+            return false;
+        glm::vec3 size = box.GetMax() - box.GetMin();
+        float scale    = MESH_SCENE_FILE_SIZE / std::max(size.x, std::max(size.y, size.z));
+        glm::vec3 base = glm::vec3(box.GetMin().x + box.GetMax().x, 2.0f * box.GetMin().y, box.GetMin().z + box.GetMax().z) * 0.5f;
+        std::cout << meshFile << ": " << mesh->GetTriangleCount() << " triangles, " << mesh->GetNodeCount() << " BVH nodes, "
+                  << mesh->GetBytes() / (1024 * 1024) << " MiB" << std::endl;
+        objects.Add(g_shapeAllocator.Allocate<Translate>(g_shapeAllocator.Allocate<Scale>(mesh, scale), glm::vec3(278, 0, 278) - base * scale));
+        return true;
+    }
+
+    MeshData knot = TorusKnotMesh(2, 3, 50.0f, 28.0f, MESH_SCENE_SEGMENTS, MESH_SCENE_SIDES);
+    for(glm::vec3& position : knot.positions)
+        position = glm::vec3(position.x, position.z, position.y) + glm::vec3(278, 230, 278);
+    for(glm::vec3& normal : knot.normals)
+        normal = glm::vec3(normal.x, normal.z, normal.y);
+    // the swap of y and z mirrored the mesh, turn the triangles back to counter-clockwise
+    for(size_t i = 0; i < knot.indices.size(); i += 3)
+        std::swap(knot.indices[i + 1], knot.indices[i + 2]);
+    auto* mesh = g_shapeAllocator.Allocate<TriangleMesh>(knot, material, compressMesh);
+    std::cout << "Torus knot: " << mesh->GetTriangleCount() << " triangles, " << mesh->GetNodeCount() << " BVH nodes, "
+              << mesh->GetBytes() / (1024 * 1024) << " MiB" << std::endl;
+    objects.Add(mesh);
+    return true;
+}
+inline HittableList MeshSceneLights()
+{
+    HittableList objects;
+    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(213, 554, 227), glm::vec3(130, 0, 0), glm::vec3(0, 0, 105), nullptr));
+    return objects;
+}
+
+struct Scene
+{
+    HittableList world;
+    HittableList lights;
+    glm::vec3 camPos;
+    glm::vec3 lookAt;
+    float vFOV;
+    float focusDist;
+    float aperture;
+    glm::vec3 background;
+};
+
+// Names accepted by BuildScene(), in the order of their 1-based index
+inline const char* const g_sceneNames[] = {"random", "earth", "emission", "cornell", "perlin", "smoke", "final", "mesh"};
+
+// name is one of g_sceneNames or its 1-based index, returns false for unknown scenes. meshFile replaces the
+// torus knot of the mesh scene, compressMesh stores its mesh compressed.
+inline bool BuildScene(const std::string& name, Scene& scene, const std::string& meshFile = "", bool compressMesh = false)
+{
+    PROFILE_SCOPE("BuildScene");
+    Emissive::ResetLightCount();
+    int index = 0;
+    for(size_t i = 0; i < std::size(g_sceneNames); ++i)
+    {
+        if(name == g_sceneNames[i] || name == std::to_string(i + 1))
+            index = (int)i + 1;
+    }
+
+    switch(index)
+    {
+    case 1:
+        scene.world      = RandomScene();
+        // scene.lights =
+        scene.camPos     = glm::vec3(13, 2, 3);
+        scene.lookAt     = glm::vec3(0, 0, 0);
+        scene.vFOV       = 20.f;
+        scene.focusDist  = 10.f;
+        scene.aperture   = 0.0f;
+        scene.background = glm::vec3(0.7f, 0.8f, 1.0f);
+        break;
+    case 2:
+        scene.world      = Earth();
+        // scene.lights =
+        scene.camPos     = glm::vec3(0, 2, 20);
+        scene.lookAt     = glm::vec3(0, 0, 0);
+        scene.vFOV       = 20.f;
+        scene.focusDist  = 10.f;
+        scene.aperture   = 0.0f;
+        scene.background = glm::vec3(0.7f, 0.8f, 1.0f);
+        break;
+    case 3:
+        scene.world      = EmissionScene();
+        // scene.lights =
+        scene.camPos     = glm::vec3(26, 3, 6);
+        scene.lookAt     = glm::vec3(0, 2, 0);
+        scene.vFOV       = 20.f;
+        scene.focusDist  = 10.f;
+        scene.aperture   = 0.0f;
+        scene.background = glm::vec3(0.01f);
+        break;
+    case 4:
+        scene.world      = CornellBox();
+        scene.lights     = CornellBoxLights();
+        scene.camPos     = glm::vec3(278, 278, -800);
+        scene.lookAt     = glm::vec3(278, 278, 1);
+        scene.vFOV       = 40.f;
+        scene.focusDist  = 10.f;
+        scene.aperture   = 0.0f;
+        scene.background = glm::vec3(0.00f);
+        break;
+    case 5:
+        scene.world      = Perlin();
+        // scene.lights =
+        scene.camPos     = glm::vec3(0, 2, 20);
+        scene.lookAt     = glm::vec3(0, 0, 0);
+        scene.vFOV       = 20.f;
+        scene.focusDist  = 10.f;
+        scene.aperture   = 0.0f;
+        scene.background = glm::vec3(0.7f, 0.8f, 1.0f);
+        break;
+    case 6:
+        scene.world      = SmokeCornellBox();
+        // scene.lights =
+        scene.camPos     = glm::vec3(278, 278, -800);
+        scene.lookAt     = glm::vec3(278, 278, 1);
+        scene.vFOV       = 40.f;
+        scene.focusDist  = 10.f;
+        scene.aperture   = 0.0f;
+        scene.background = glm::vec3(0.00f);
+        break;
+    case 7:
+        scene.world      = FinalScene();
+        // scene.lights =
+        scene.camPos     = glm::vec3(478, 278, -600);
+        scene.lookAt     = glm::vec3(278, 278, 0);
+        scene.vFOV       = 40.f;
+        scene.focusDist  = 10.f;
+        scene.aperture   = 0.0f;
+        scene.background = glm::vec3(0.f);
+        break;
+    case 8:
+        if(!MeshScene(meshFile, compressMesh, scene.world))
+            return false;
+        scene.lights     = MeshSceneLights();
+        scene.camPos     = glm::vec3(278, 278, -800);
+        scene.lookAt     = glm::vec3(278, 278, 1);
+        scene.vFOV       = 40.f;
+        scene.focusDist  = 10.f;
+        scene.aperture   = 0.0f;
+        scene.background = glm::vec3(0.00f);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
@@ -6,6 +6,7 @@
 #include "AABB.h"
 #include "Hittable.h"
 #include "ONB.hpp"
+#include "Stats.hpp"
 #include "glm/ext/scalar_constants.hpp"
 #include "3DMath/Random.h"
 
@@ -39,10 +40,22 @@ public:
     }
 
 private:
+    friend class SphereLeaf;  // copies the spheres into its lanes and shades their hits
+
     glm::vec3 m_center;
     float m_radius;
     Material* m_material;
 
+    void SetHitRecord(const Ray& r, float t, HitRecord& outRecord) const
+    {
+        outRecord.t      = t;
+        outRecord.point  = r.At(outRecord.t);
+        glm::vec3 normal = (outRecord.point - m_center) / m_radius;
+        outRecord.SetNormal(r, normal);
+        outRecord.material = m_material;
+        outRecord.uv       = Sphere::GetUV(normal);
+    }
+
     static glm::vec2 GetUV(const glm::vec3& point)
     {
         float theta = acos(-point.y);
@@ -68,12 +81,15 @@ private:
 
 bool Sphere::Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const
 {
+    STATS_COUNT(primitiveTests[PRIMITIVE_SPHERE]);
     glm::vec3 oc = r.GetOrigin() - m_center;
     float a      = glm::length2(r.GetDir());
     float half_b = glm::dot(r.GetDir(), oc);  // we can simplify the 2 in the return value calculation
-    float c      = glm::length2(oc) - m_radius * m_radius;
 
-    float delta = half_b * half_b - a * c;  // actually delta / 4 but doesn't matter
+    // actually delta / 4 but doesn't matter. half_b * half_b - a * c written with the closest point of the
+    // ray to the center, which doesn't cancel out for small spheres far away (Ray Tracing Gems, chapter 7)
+    glm::vec3 f = oc - (half_b / a) * r.GetDir();
+    float delta = a * (m_radius * m_radius - glm::length2(f));
 
     if(delta < 0.0)
         return false;
@@ -87,12 +103,7 @@ bool Sphere::Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) con
             return false;
     }
 
-    outRecord.t      = root;
-    outRecord.point  = r.At(outRecord.t);
-    glm::vec3 normal = (outRecord.point - m_center) / m_radius;
-    outRecord.SetNormal(r, normal);
-    outRecord.material = m_material;
-    outRecord.uv       = Sphere::GetUV(normal);
+    SetHitRecord(r, root, outRecord);
     return true;
 }
 bool Sphere::BoundingBox(AABB& outAABB) const
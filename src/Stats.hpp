@@ -0,0 +1,153 @@
+#pragma once
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Traversal statistics, only compiled in when RAYTRACER_STATS is defined (the RAYTRACER_STATS CMake option).
+// Every thread counts into its own RayStats, CollectStats() sums them up between passes. Without
+// RAYTRACER_STATS the STATS_ macros expand to nothing and the hot paths are untouched.
+
+enum PrimitiveType
+{
+    PRIMITIVE_SPHERE,
+    PRIMITIVE_QUAD,
+    PRIMITIVE_BOX,
+    PRIMITIVE_MEDIUM,
+    PRIMITIVE_TRANSLATE,
+    PRIMITIVE_ROTATE_Y,
+    PRIMITIVE_SCALE,
+    PRIMITIVE_TRIANGLE,
+    PRIMITIVE_TYPE_COUNT,
+};
+inline const char* const g_primitiveNames[] = {"sphere", "quad", "box", "medium", "translate", "rotateY", "scale", "triangle"};
+
+#define STATS_PATH_LENGTH_BUCKETS 65  // 0 to 63 segments, the last bucket has the longer paths
+#define STATS_RAY_COST_BUCKETS    24  // powers of two
+
+struct RayStats
+{
+    uint64_t rays                                   = 0;
+    uint64_t bvhNodes                               = 0;   // visited
+    uint64_t aabbTests                              = 0;
+    uint64_t primitiveTests[PRIMITIVE_TYPE_COUNT]   = {};
+    uint64_t pathLengths[STATS_PATH_LENGTH_BUCKETS] = {};  // camera paths by number of traced segments
+    uint64_t rayCosts[STATS_RAY_COST_BUCKETS]       = {};  // rays by traversal cost, bucket i has costs in [2^i - 1, 2^(i+1) - 1)
+
+    // BVH nodes visited plus primitives tested so far, what a ray costs is the difference before and after it
+    uint64_t GetTraversalCost() const
+    {
+        uint64_t cost = bvhNodes;
+        for(uint64_t tests : primitiveTests)
+            cost += tests;
+        return cost;
+    }
+    void AddRay(uint64_t cost)
+    {
+        int bucket = 0;
+        while(bucket + 1 < STATS_RAY_COST_BUCKETS && cost + 1 >= (2ull << bucket))
+            bucket++;
+        rays++;
+        rayCosts[bucket]++;
+    }
+    void AddPath(uint64_t segments)
+    {
+        pathLengths[segments < STATS_PATH_LENGTH_BUCKETS ? segments : STATS_PATH_LENGTH_BUCKETS - 1]++;
+    }
+
+    void Add(const RayStats& other)
+    {
+        rays      += other.rays;
+        bvhNodes  += other.bvhNodes;
+        aabbTests += other.aabbTests;
+        for(int i = 0; i < PRIMITIVE_TYPE_COUNT; ++i)
+            primitiveTests[i] += other.primitiveTests[i];
+        for(int i = 0; i < STATS_PATH_LENGTH_BUCKETS; ++i)
+            pathLengths[i] += other.pathLengths[i];
+        for(int i = 0; i < STATS_RAY_COST_BUCKETS; ++i)
+            rayCosts[i] += other.rayCosts[i];
+    }
+
+    void Print(const char* title) const
+    {
+        auto perRay = [&](uint64_t count)
+        { return rays == 0 ? 0.0 : (double)count / rays; };
+        std::cout << "Traversal stats of " << title << ": " << rays << " rays" << std::endl
+                  << std::fixed << std::setprecision(2)
+                  << "    BVH nodes: " << perRay(bvhNodes) << " per ray" << std::endl
+                  << "    AABB tests: " << perRay(aabbTests) << " per ray" << std::endl;
+        for(int i = 0; i < PRIMITIVE_TYPE_COUNT; ++i)
+        {
+            if(primitiveTests[i] > 0)
+                std::cout << "    " << g_primitiveNames[i] << " tests: " << perRay(primitiveTests[i]) << " per ray" << std::endl;
+        }
+
+        uint64_t paths = 0;
+        for(uint64_t count : pathLengths)
+            paths += count;
+        std::cout << "    path lengths (segments: % of paths):";
+        for(int i = 0; i < STATS_PATH_LENGTH_BUCKETS; ++i)
+        {
+            if(pathLengths[i] > 0)
+                std::cout << " " << i << (i == STATS_PATH_LENGTH_BUCKETS - 1 ? "+" : "") << ": " << 100.0 * pathLengths[i] / paths;
+        }
+        std::cout << std::endl
+                  << "    traversal cost (nodes + primitives: % of rays):";
+        for(int i = 0; i < STATS_RAY_COST_BUCKETS; ++i)
+        {
+            if(rayCosts[i] > 0)
+                std::cout << " " << (1ull << i) - 1 << "-" << (2ull << i) - 2 << ": " << 100.0 * rayCosts[i] / rays;
+        }
+        std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+};
+
+#ifdef RAYTRACER_STATS
+
+// Owns the counters of every thread that ever counted something, they outlive the threads
+struct StatsRegistry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<RayStats>> threads;
+};
+inline StatsRegistry g_statsRegistry;
+
+inline RayStats& GetThreadStats()
+{
+    thread_local RayStats* stats = []
+    {
+        std::lock_guard lock(g_statsRegistry.mutex);
+        return g_statsRegistry.threads.emplace_back(std::make_unique<RayStats>()).get();
+    }();
+    return *stats;
+}
+
+// Both have to be called while no thread is tracing
+inline RayStats CollectStats()
+{
+    std::lock_guard lock(g_statsRegistry.mutex);
+    RayStats total;
+    for(const auto& stats : g_statsRegistry.threads)
+        total.Add(*stats);
+    return total;
+}
+inline void ResetStats()
+{
+    std::lock_guard lock(g_statsRegistry.mutex);
+    for(auto& stats : g_statsRegistry.threads)
+        *stats = RayStats();
+}
+
+#define STATS_COUNT(counter)      (GetThreadStats().counter++)
+#define STATS_ADD(counter, count) (GetThreadStats().counter += (count))
+#define STATS_PATH(segments)      GetThreadStats().AddPath(segments)
+
+#else
+
+#define STATS_COUNT(counter)      ((void)0)
+#define STATS_ADD(counter, count) ((void)0)
+#define STATS_PATH(segments)      ((void)0)
+
+#endif
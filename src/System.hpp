@@ -0,0 +1,345 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <fcntl.h>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Thin platform layer for page allocation, NUMA topology and file mappings, everything degrades to a no-op
+// (single node, regular heap memory, no mappings) on platforms where it isn't implemented
+
+#define CACHE_LINE_SIZE 64
+#define SMALL_PAGE_SIZE 4096
+#define HUGE_PAGE_SIZE  (2 * 1024 * 1024)
+
+enum PageFlags : uint32_t
+{
+    PAGES_DEFAULT          = 0,
+    PAGES_HUGE             = 1 << 0,  // back the allocation with 2 MiB pages when the OS allows it
+    PAGES_NUMA_INTERLEAVED = 1 << 1,  // spread the pages round robin over all NUMA nodes
+};
+
+inline size_t RoundUpToPages(size_t size, uint32_t flags)
+{
+    size_t pageSize = (flags & PAGES_HUGE) ? HUGE_PAGE_SIZE : SMALL_PAGE_SIZE;
+    return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+inline int GetNumaNodeCount()
+{
+    static const int count = []
+    {
+#if defined(_WIN32)
+        ULONG highest = 0;
+        if(!GetNumaHighestNodeNumber(&highest))
+            return 1;
+        return (int)highest + 1;
+#elif defined(__linux__)
+        int nodes = 0;
+        while(std::ifstream("/sys/devices/system/node/node" + std::to_string(nodes) + "/cpulist").good())
+            nodes++;
+        return nodes > 0 ? nodes : 1;
+#else
+        return 1;
+#endif
+    }();
+    return count;
+}
+
+// Memory is left untouched so its physical placement is decided by whichever thread writes it first.
+// size should come from RoundUpToPages()
+inline void* AllocatePages(size_t size, uint32_t flags)
+{
+#if defined(_WIN32)
+    void* ptr = nullptr;
+    if(flags & PAGES_HUGE)  // needs the SeLockMemoryPrivilege, fall back to small pages without it
+        ptr = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if(!ptr)
+        ptr = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if(!ptr)
+        throw std::bad_alloc();
+    return ptr;
+#elif defined(__linux__)
+    // over-allocate so the mapping can be trimmed to start on a huge page boundary
+    size_t alignment = (flags & PAGES_HUGE) ? HUGE_PAGE_SIZE : SMALL_PAGE_SIZE;
+    size_t mapped    = size + alignment - SMALL_PAGE_SIZE;
+    char* raw        = (char*)mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(raw == MAP_FAILED)
+        throw std::bad_alloc();
+    char* ptr   = (char*)(((uintptr_t)raw + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    size_t head = ptr - raw;
+    size_t tail = mapped - head - size;
+    if(head)
+        munmap(raw, head);
+    if(tail)
+        munmap(ptr + size, tail);
+
+    if(flags & PAGES_HUGE)
+        madvise(ptr, size, MADV_HUGEPAGE);  // transparent huge pages, only a hint
+    int numNodes = GetNumaNodeCount();
+    if((flags & PAGES_NUMA_INTERLEAVED) && numNodes > 1)
+    {
+        constexpr int MPOL_INTERLEAVE_ = 3;  // from <numaif.h>, avoids depending on libnuma
+        std::vector<unsigned long> nodeMask((numNodes + 63) / 64, 0);
+        for(int i = 0; i < numNodes; ++i)
+            nodeMask[i / 64] |= 1ul << (i % 64);
+        syscall(SYS_mbind, ptr, size, MPOL_INTERLEAVE_, nodeMask.data(), nodeMask.size() * 64 + 1, 0);
+    }
+    return ptr;
+#else
+    return ::operator new(size, std::align_val_t(SMALL_PAGE_SIZE));
+#endif
+}
+
+inline void FreePages(void* ptr, size_t size)
+{
+    if(!ptr)
+        return;
+#if defined(_WIN32)
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#elif defined(__linux__)
+    munmap(ptr, size);
+#else
+    ::operator delete(ptr, std::align_val_t(SMALL_PAGE_SIZE));
+#endif
+}
+
+// Restricts the calling thread to the CPUs of the given NUMA node, returns false if that isn't possible
+inline bool PinCurrentThreadToNumaNode(int node)
+{
+#if defined(_WIN32)
+    GROUP_AFFINITY affinity = {};
+    if(!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity))
+        return false;
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+#elif defined(__linux__)
+    // cpulist has the form "0-15,32-47"
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list;
+    if(!std::getline(file, list) || list.empty())
+        return false;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    size_t pos = 0;
+    while(pos < list.size())
+    {
+        size_t end        = list.find(',', pos);
+        std::string range = list.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        size_t dash       = range.find('-');
+        int first         = std::stoi(range.substr(0, dash));
+        int last          = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for(int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+            CPU_SET(cpu, &cpus);
+        if(end == std::string::npos)
+            break;
+        pos = end + 1;
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+    return false;
+#endif
+}
+
+// Peak resident memory of the process in bytes, 0 where it isn't known
+inline size_t GetPeakMemoryUsage()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if(!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#elif defined(__linux__)
+    std::ifstream file("/proc/self/status");
+    std::string line;
+    while(std::getline(file, line))
+    {
+        if(line.rfind("VmHWM:", 0) == 0)
+            return std::stoull(line.substr(6)) * 1024;  // in kB
+    }
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+// Lowers the peak reported by GetPeakMemoryUsage() to the current usage, returns false if that isn't possible
+inline bool ResetPeakMemoryUsage()
+{
+#if defined(__linux__)
+    std::ofstream file("/proc/self/clear_refs");
+    file << "5";
+    file.flush();
+    return file.good();
+#else
+    return false;
+#endif
+}
+
+// Fixed size array backed by whole pages, the elements are NOT initialized
+template<typename T>
+class PageArray
+{
+public:
+    PageArray(size_t count, uint32_t flags = PAGES_DEFAULT)
+        : m_size(count), m_bytes(RoundUpToPages(count * sizeof(T), flags))
+    {
+        m_data = static_cast<T*>(AllocatePages(m_bytes, flags));
+    }
+    ~PageArray()
+    {
+        FreePages(m_data, m_bytes);
+    }
+    PageArray(const PageArray&)            = delete;
+    PageArray& operator=(const PageArray&) = delete;
+
+    T& operator[](size_t i) { return m_data[i]; }
+    const T& operator[](size_t i) const { return m_data[i]; }
+    T* Data() { return m_data; }
+    const T* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    T* m_data;
+    size_t m_size;
+    size_t m_bytes;
+};
+
+// Shared mapping of a whole file, writes go straight to the page cache and Flush() forces them to disk
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile()
+    {
+        Close();
+    }
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // size > 0 creates (or truncates) the file with that size and maps it writable,
+    // size == 0 maps an existing file read only
+    bool Open(const std::string& path, size_t size)
+    {
+        Close();
+        bool writable = size > 0;
+#if defined(_WIN32)
+        m_file = CreateFileA(path.c_str(), GENERIC_READ | (writable ? GENERIC_WRITE : 0), FILE_SHARE_READ, nullptr,
+                             writable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(m_file == INVALID_HANDLE_VALUE)
+            return false;
+        if(!writable)
+        {
+            LARGE_INTEGER fileSize;
+            if(!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0)
+            {
+                Close();
+                return false;
+            }
+            size = (size_t)fileSize.QuadPart;
+        }
+        m_mapping = CreateFileMappingA(m_file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                       (DWORD)((uint64_t)size >> 32), (DWORD)size, nullptr);
+        if(m_mapping)
+            m_data = MapViewOfFile(m_mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+#elif defined(__linux__)
+        m_fd = open(path.c_str(), writable ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+        if(m_fd < 0)
+            return false;
+        if(writable)
+        {
+            if(ftruncate(m_fd, size) != 0)
+            {
+                Close();
+                return false;
+            }
+        }
+        else
+        {
+            struct stat info;
+            if(fstat(m_fd, &info) != 0 || info.st_size == 0)
+            {
+                Close();
+                return false;
+            }
+            size = (size_t)info.st_size;
+        }
+        void* data = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m_fd, 0);
+        m_data     = data == MAP_FAILED ? nullptr : data;
+#endif
+        if(!m_data)
+        {
+            Close();
+            return false;
+        }
+        m_size = size;
+        return true;
+    }
+
+    bool Flush()
+    {
+        if(!m_data)
+            return false;
+#if defined(_WIN32)
+        return FlushViewOfFile(m_data, m_size) && FlushFileBuffers(m_file);
+#elif defined(__linux__)
+        return msync(m_data, m_size, MS_SYNC) == 0;
+#else
+        return false;
+#endif
+    }
+
+    void Close()
+    {
+#if defined(_WIN32)
+        if(m_data)
+            UnmapViewOfFile(m_data);
+        if(m_mapping)
+            CloseHandle(m_mapping);
+        if(m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+        m_mapping = nullptr;
+        m_file    = INVALID_HANDLE_VALUE;
+#elif defined(__linux__)
+        if(m_data)
+            munmap(m_data, m_size);
+        if(m_fd >= 0)
+            close(m_fd);
+        m_fd = -1;
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    void* Data() { return m_data; }
+    const void* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    void* m_data  = nullptr;
+    size_t m_size = 0;
+#if defined(_WIN32)
+    HANDLE m_file    = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#elif defined(__linux__)
+    int m_fd = -1;
+#endif
+};
@@ -1,14 +1,18 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <filesystem>
 #include <memory>
 #include <iostream>
+#include <string>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_PERLIN_IMPLEMENTATION
 #include "stb_perlin.h"
 #include "glm/glm.hpp"
 #include "Allocator.hpp"
+#include "Profiler.hpp"
+#include "ResourceCache.hpp"
 
 class Texture
 {
@@ -38,7 +42,7 @@ class CheckerTexture : public Texture
 public:
     CheckerTexture() {}
     CheckerTexture(Texture* odd, Texture* even) : m_odd(odd), m_even(even) {}
-    CheckerTexture(const glm::vec3& c1, const glm::vec3& c2) : m_odd(g_materialAllocator.Allocate<SolidColor>(c1)), m_even(g_materialAllocator.Allocate<SolidColor>(c2)) {}
+    CheckerTexture(const glm::vec3& c1, const glm::vec3& c2) : m_odd(g_materialCache.Get<SolidColor>(c1)), m_even(g_materialCache.Get<SolidColor>(c2)) {}
 
     virtual glm::vec3 Sample(const glm::vec2& uv, const glm::vec3& point) const override
     {
@@ -55,12 +59,27 @@ private:
 };
 
 
+// Image files are looked up in the working directory and then in its parent (the repository root when run
+// from build/). Returns the canonical path, which is what image textures are cached by, so an image is
+// decoded once however the scenes spell its path.
+inline std::string AssetPath(const std::string& filename)
+{
+    std::error_code error;
+    for(const std::filesystem::path& candidate : {std::filesystem::path(filename), std::filesystem::path("..") / filename})
+    {
+        if(std::filesystem::exists(candidate, error))
+            return std::filesystem::weakly_canonical(candidate, error).string();
+    }
+    return filename;  // reported as missing by the texture
+}
+
 class ImageTexture : public Texture
 {
 public:
     ImageTexture() {}
     ImageTexture(const std::string& filename) : m_channels(3)
     {
+        PROFILE_SCOPE("ImageTexture decode");
         m_data = stbi_load(filename.c_str(), &m_width, &m_height, &m_channels, m_channels);
         if(!m_data)
         {
@@ -68,6 +87,12 @@ public:
             m_width = m_height = 0;
         }
     }
+    ImageTexture(const ImageTexture&)            = delete;
+    ImageTexture& operator=(const ImageTexture&) = delete;
+    ~ImageTexture()
+    {
+        stbi_image_free(m_data);
+    }
     virtual glm::vec3 Sample(const glm::vec2& uv, const glm::vec3& point) const override
     {
         if(m_data == nullptr || m_width == 0 || m_height == 0)
@@ -91,8 +116,8 @@ public:
     }
 
 private:
-    unsigned char* m_data;
-    int m_width, m_height;
+    unsigned char* m_data = nullptr;
+    int m_width = 0, m_height = 0;
     int m_channels;
 };
 
@@ -2,12 +2,14 @@
 
 #include "Hittable.h"
 #include "AABB.h"
+#include "Stats.hpp"
 class Translate : public Hittable
 {
 public:
     Translate(Hittable* obj, const glm::vec3& offset) : m_obj(obj), m_offset(offset) {}
     bool Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const override
     {
+        STATS_COUNT(primitiveTests[PRIMITIVE_TRANSLATE]);
         Ray movedR(r.GetOrigin() - m_offset, r.GetDir());
         if(!m_obj->Hit(movedR, tMin, tMax, outRecord))
             return false;
@@ -28,6 +30,36 @@ private:
     glm::vec3 m_offset;
 };
 
+// Uniform scale around the origin, the normals stay the same
+class Scale : public Hittable
+{
+public:
+    Scale(Hittable* obj, float scale) : m_obj(obj), m_scale(scale) {}
+    bool Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const override
+    {
+        STATS_COUNT(primitiveTests[PRIMITIVE_SCALE]);
+        // rays are normalized, distances along the scaled ray are scaled too
+        Ray scaledR(r.GetOrigin() / m_scale, r.GetDir());
+        if(!m_obj->Hit(scaledR, tMin / m_scale, tMax / m_scale, outRecord))
+            return false;
+
+        outRecord.t     *= m_scale;
+        outRecord.point *= m_scale;
+        return true;
+    }
+    bool BoundingBox(AABB& outAABB) const override
+    {
+        if(!m_obj->BoundingBox(outAABB))
+            return false;
+        outAABB = AABB(outAABB.GetMin() * m_scale, outAABB.GetMax() * m_scale);
+        return true;
+    }
+
+private:
+    Hittable* m_obj;
+    float m_scale;
+};
+
 class RotateY : public Hittable
 {
 public:
@@ -63,6 +95,7 @@ public:
     }
     bool Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const override
     {
+        STATS_COUNT(primitiveTests[PRIMITIVE_ROTATE_Y]);
         glm::vec3 origin    = r.GetOrigin();
         glm::vec3 direction = r.GetDir();
 
@@ -0,0 +1,658 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <vector>
+#include "glm/glm.hpp"
+#include "3DMath/Half.h"
+#include "3DMath/Octahedral.h"
+#include "AABB.h"
+#include "Allocator.hpp"
+#include "Hittable.h"
+#include "Profiler.hpp"
+#include "Stats.hpp"
+#include "System.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#define MESH_BLOCK_WIDTH    8                          // triangles intersected at once, leaves have up to this many
+#define MESH_BVH_MAX_DEPTH  64                         // deeper nodes become leaves unless they have over UINT16_MAX triangles
+#define MESH_BVH_STACK_SIZE (MESH_BVH_MAX_DEPTH + 16)  // halving those gets them under UINT16_MAX in 16 more levels
+#define MESH_SAH_BINS       12
+
+// Triangles of a mesh as it is loaded or generated. Vertices are shared between triangles through the
+// index buffer, normals and UVs are optional and, if present, have one entry per position.
+struct MeshData
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<uint32_t> indices;  // three per triangle, counter-clockwise seen from the outside
+};
+
+// Node of the BVH inside a TriangleMesh, 32 bytes. The first child of an inner node directly follows it.
+struct MeshNode
+{
+    glm::vec3 min;
+    uint32_t offset;  // the first TriangleBlock (triangle for compressed meshes) of a leaf, the second child of an inner node
+    glm::vec3 max;
+    uint16_t count;   // triangles of a leaf, in consecutive blocks, 0 for an inner node
+    uint16_t axis;    // split axis of an inner node, the first child is the one towards the lower coordinates
+};
+static_assert(sizeof(MeshNode) == 32, "two nodes per cache line");
+
+// The triangles of a leaf as a structure of arrays, a SIMD register holds one coordinate of all of them
+struct alignas(32) TriangleBlock
+{
+    float vertices[3][3][MESH_BLOCK_WIDTH];  // vertex, axis, lane
+    uint32_t triangles[MESH_BLOCK_WIDTH];    // the triangle in the index buffer of every lane
+};
+static_assert(sizeof(TriangleBlock) == 320, "five cache lines");
+
+// Per ray setup of the watertight intersection test (Woop, Benthin, Wald: Watertight Ray/Triangle
+// Intersection, JCGT 2013): the ray is turned into +z by a shear, after which the test is 2D and edges
+// shared by two triangles give both the same result, so rays can't slip through between them.
+struct ShearedRay
+{
+    ShearedRay(const Ray& r)
+    {
+        glm::vec3 dir = r.GetDir();
+        glm::vec3 abs = glm::abs(dir);
+        kz            = abs.x > abs.y ? (abs.x > abs.z ? 0 : 2) : (abs.y > abs.z ? 1 : 2);
+        kx            = (kz + 1) % 3;
+        ky            = (kx + 1) % 3;
+        // keep the winding of the triangles
+        if(dir[kz] < 0.0f)
+            std::swap(kx, ky);
+        shear  = glm::vec3(dir[kx] / dir[kz], dir[ky] / dir[kz], 1.0f / dir[kz]);
+        origin = r.GetOrigin();
+    }
+    int kx, ky, kz;
+    glm::vec3 shear;
+    glm::vec3 origin;
+};
+
+// Tests the triangle of one lane, returns the distance and the barycentric weights of its three vertices in t and uvw
+inline bool IntersectTriangleLane(const ShearedRay& ray, const TriangleBlock& block, uint32_t lane, float tMin, float tMax, float& t, glm::vec3& uvw)
+{
+    float x[3], y[3], z[3];
+    for(int i = 0; i < 3; ++i)
+    {
+        z[i] = block.vertices[i][ray.kz][lane] - ray.origin[ray.kz];
+        x[i] = block.vertices[i][ray.kx][lane] - ray.origin[ray.kx] - ray.shear.x * z[i];
+        y[i] = block.vertices[i][ray.ky][lane] - ray.origin[ray.ky] - ray.shear.y * z[i];
+    }
+    float u = x[2] * y[1] - y[2] * x[1];
+    float v = x[0] * y[2] - y[0] * x[2];
+    float w = x[1] * y[0] - y[1] * x[0];
+    // exactly on an edge the float products can't decide, redo them in double
+    if(u == 0.0f || v == 0.0f || w == 0.0f)
+    {
+        u = (float)((double)x[2] * y[1] - (double)y[2] * x[1]);
+        v = (float)((double)x[0] * y[2] - (double)y[0] * x[2]);
+        w = (float)((double)x[1] * y[0] - (double)y[1] * x[0]);
+    }
+    if((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f))
+        return false;
+    float determinant = u + v + w;
+    if(determinant == 0.0f)
+        return false;
+
+    float distance = ray.shear.z * (u * z[0] + v * z[1] + w * z[2]) / determinant;
+    if(distance < tMin || distance > tMax)
+        return false;
+    t   = distance;
+    uvw = glm::vec3(u, v, w) / determinant;
+    return true;
+}
+
+// Tests the first count triangles of the block one by one, returns the lane of the closest hit closer than tMax
+// (which becomes its distance) or -1
+inline int IntersectTriangleBlockScalar(const ShearedRay& ray, const TriangleBlock& block, uint32_t count, float tMin, float& tMax, glm::vec3& uvw)
+{
+    int closest = -1;
+    for(uint32_t lane = 0; lane < count; ++lane)
+    {
+        if(IntersectTriangleLane(ray, block, lane, tMin, tMax, tMax, uvw))
+            closest = (int)lane;
+    }
+    return closest;
+}
+
+#ifdef __AVX2__
+// The same test on all lanes at once. Lanes with a ray exactly on an edge are left to the scalar test, which
+// redoes them in double.
+inline int IntersectTriangleBlockAvx2(const ShearedRay& ray, const TriangleBlock& block, uint32_t count, float tMin, float& tMax, glm::vec3& uvw)
+{
+    __m256 originX = _mm256_set1_ps(ray.origin[ray.kx]);
+    __m256 originY = _mm256_set1_ps(ray.origin[ray.ky]);
+    __m256 originZ = _mm256_set1_ps(ray.origin[ray.kz]);
+    __m256 shearX  = _mm256_set1_ps(ray.shear.x);
+    __m256 shearY  = _mm256_set1_ps(ray.shear.y);
+    __m256 x[3], y[3], z[3];
+    for(int i = 0; i < 3; ++i)
+    {
+        z[i] = _mm256_sub_ps(_mm256_load_ps(block.vertices[i][ray.kz]), originZ);
+        x[i] = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(block.vertices[i][ray.kx]), originX), _mm256_mul_ps(shearX, z[i]));
+        y[i] = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(block.vertices[i][ray.ky]), originY), _mm256_mul_ps(shearY, z[i]));
+    }
+    __m256 u = _mm256_sub_ps(_mm256_mul_ps(x[2], y[1]), _mm256_mul_ps(y[2], x[1]));
+    __m256 v = _mm256_sub_ps(_mm256_mul_ps(x[0], y[2]), _mm256_mul_ps(y[0], x[2]));
+    __m256 w = _mm256_sub_ps(_mm256_mul_ps(x[1], y[0]), _mm256_mul_ps(y[1], x[0]));
+
+    __m256 zero     = _mm256_setzero_ps();
+    __m256 used     = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32((int)count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+    __m256 onEdge   = _mm256_and_ps(used, _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_EQ_OQ), _mm256_cmp_ps(v, zero, _CMP_EQ_OQ)),
+                                                      _mm256_cmp_ps(w, zero, _CMP_EQ_OQ)));
+    __m256 negative = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_LT_OQ), _mm256_cmp_ps(v, zero, _CMP_LT_OQ)), _mm256_cmp_ps(w, zero, _CMP_LT_OQ));
+    __m256 positive = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_GT_OQ), _mm256_cmp_ps(v, zero, _CMP_GT_OQ)), _mm256_cmp_ps(w, zero, _CMP_GT_OQ));
+    __m256 determinant = _mm256_add_ps(_mm256_add_ps(u, v), w);
+    __m256 distance    = _mm256_div_ps(_mm256_mul_ps(_mm256_set1_ps(ray.shear.z),
+                                                     _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(u, z[0]), _mm256_mul_ps(v, z[1])), _mm256_mul_ps(w, z[2]))),
+                                       determinant);
+    __m256 hit         = _mm256_andnot_ps(onEdge, used);
+    hit                = _mm256_andnot_ps(_mm256_and_ps(negative, positive), hit);
+    hit                = _mm256_and_ps(hit, _mm256_cmp_ps(determinant, zero, _CMP_NEQ_OQ));
+    hit                = _mm256_and_ps(hit, _mm256_cmp_ps(distance, _mm256_set1_ps(tMin), _CMP_GE_OQ));
+    hit                = _mm256_and_ps(hit, _mm256_cmp_ps(distance, _mm256_set1_ps(tMax), _CMP_LE_OQ));
+
+    int closest  = -1;
+    int hitLanes = _mm256_movemask_ps(hit);
+    if(hitLanes != 0)
+    {
+        // the smallest distance of the lanes that hit in every lane, then the first lane that has it
+        __m256 nearest = _mm256_blendv_ps(_mm256_set1_ps(std::numeric_limits<float>::infinity()), distance, hit);
+        __m256 minimum = _mm256_min_ps(nearest, _mm256_permute_ps(nearest, _MM_SHUFFLE(2, 3, 0, 1)));
+        minimum        = _mm256_min_ps(minimum, _mm256_permute_ps(minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+        minimum        = _mm256_min_ps(minimum, _mm256_permute2f128_ps(minimum, minimum, 1));
+        closest        = std::countr_zero((unsigned)(_mm256_movemask_ps(_mm256_cmp_ps(nearest, minimum, _CMP_EQ_OQ)) & hitLanes));
+        alignas(32) float lanes[5][MESH_BLOCK_WIDTH];
+        _mm256_store_ps(lanes[0], u);
+        _mm256_store_ps(lanes[1], v);
+        _mm256_store_ps(lanes[2], w);
+        _mm256_store_ps(lanes[3], determinant);
+        _mm256_store_ps(lanes[4], distance);
+        tMax = lanes[4][closest];
+        uvw  = glm::vec3(lanes[0][closest], lanes[1][closest], lanes[2][closest]) / lanes[3][closest];
+    }
+    for(unsigned edgeLanes = (unsigned)_mm256_movemask_ps(onEdge); edgeLanes != 0; edgeLanes &= edgeLanes - 1)
+    {
+        int lane = std::countr_zero(edgeLanes);
+        if(IntersectTriangleLane(ray, block, lane, tMin, tMax, tMax, uvw))
+            closest = lane;
+    }
+    return closest;
+}
+#endif
+
+inline int IntersectTriangleBlock(const ShearedRay& ray, const TriangleBlock& block, uint32_t count, float tMin, float& tMax, glm::vec3& uvw)
+{
+#ifdef __AVX2__
+    return IntersectTriangleBlockAvx2(ray, block, count, tMin, tMax, uvw);
+#else
+    return IntersectTriangleBlockScalar(ray, block, count, tMin, tMax, uvw);
+#endif
+}
+
+// The arrays a TriangleMesh renders from, after the BVH build
+struct MeshArrays
+{
+    uint32_t vertexCount               = 0;
+    uint32_t triangleCount             = 0;
+    uint32_t nodeCount                 = 0;
+    uint32_t blockCount                = 0;
+    const glm::vec3* positions         = nullptr;
+    const glm::vec3* normals           = nullptr;
+    const glm::vec2* uvs               = nullptr;
+    const uint32_t* indices            = nullptr;
+    const MeshNode* nodes              = nullptr;
+    const TriangleBlock* blocks        = nullptr;
+    // compressed meshes have these instead of the positions, normals, UVs and blocks
+    const uint16_t* quantizedPositions = nullptr;
+    const uint32_t* octahedralNormals  = nullptr;
+    const uint32_t* halfUVs            = nullptr;
+    glm::vec3 quantizationMin          = glm::vec3(0.0f);
+    glm::vec3 quantizationScale        = glm::vec3(0.0f);
+};
+
+// A whole mesh as a single Hittable: the vertex attributes and 32-bit indices are stored once in the shape
+// arena and the mesh brings its own BVH over the triangles. Its leaves hold up to MESH_BLOCK_WIDTH triangles
+// whose vertices are copied into a TriangleBlock, so a leaf is tested with one SIMD kernel and without
+// going through the index buffer; the indices and vertex attributes are only read for the closest hit. A
+// triangle then costs 12 bytes of indices plus about 50 of BVH and blocks instead of a polymorphic object
+// and a node of the scene BVH.
+//
+// Compressed meshes trade some intersection speed for memory, for meshes that wouldn't fit otherwise: the
+// positions are quantized to 16 bits per coordinate within the bounds of the mesh, normals are octahedral
+// and UVs half floats, and the leaves are ranges of the index buffer (the build reorders the triangles)
+// that are decoded into a TriangleBlock for every test. That is about 25 bytes per triangle. The BVH is
+// built from the decoded positions, so its bounds hold exactly the geometry the rays are tested against.
+class TriangleMesh : public Hittable
+{
+public:
+    TriangleMesh(const MeshData& mesh, Material* mat, bool compressed = false)
+        : m_vertexCount((uint32_t)mesh.positions.size()), m_triangleCount((uint32_t)(mesh.indices.size() / 3)), m_material(mat)
+    {
+        bool hasNormals = mesh.normals.size() == mesh.positions.size();
+        bool hasUVs     = mesh.uvs.size() == mesh.positions.size();
+        if(compressed)
+            Compress(mesh, hasNormals, hasUVs);
+        else
+        {
+            m_positions = CopyToArena(mesh.positions);
+            m_normals   = hasNormals ? CopyToArena(mesh.normals) : nullptr;
+            m_uvs       = hasUVs ? CopyToArena(mesh.uvs) : nullptr;
+        }
+        uint32_t* indices = CopyToArena(mesh.indices);
+        m_indices         = indices;
+        BuildBVH(indices);
+    }
+    // Renders from arrays that already have their BVH, in place, e.g. from a mapped mesh file that the mesh keeps open
+    TriangleMesh(const MeshArrays& arrays, std::unique_ptr<MappedFile> file, Material* mat)
+        : m_vertexCount(arrays.vertexCount), m_triangleCount(arrays.triangleCount), m_nodeCount(arrays.nodeCount), m_blockCount(arrays.blockCount),
+          m_positions(arrays.positions), m_normals(arrays.normals), m_uvs(arrays.uvs), m_indices(arrays.indices), m_nodes(arrays.nodes),
+          m_blocks(arrays.blocks), m_quantizedPositions(arrays.quantizedPositions), m_octahedralNormals(arrays.octahedralNormals),
+          m_halfUVs(arrays.halfUVs), m_quantizationMin(arrays.quantizationMin), m_quantizationScale(arrays.quantizationScale), m_material(mat),
+          m_file(std::move(file))
+    {
+    }
+
+    virtual bool Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const override;
+
+    virtual bool BoundingBox(AABB& outAABB) const override
+    {
+        if(m_triangleCount == 0)
+            return false;
+        outAABB = AABB(m_nodes[0].min, m_nodes[0].max);
+        outAABB.Pad();
+        return true;
+    }
+
+    MeshArrays GetArrays() const
+    {
+        return {m_vertexCount, m_triangleCount,      m_nodeCount,         m_blockCount, m_positions,       m_normals,          m_uvs, m_indices,
+                m_nodes,       m_blocks,             m_quantizedPositions, m_octahedralNormals, m_halfUVs, m_quantizationMin, m_quantizationScale};
+    }
+    uint32_t GetTriangleCount() const { return m_triangleCount; }
+    uint32_t GetNodeCount() const { return m_nodeCount; }
+    bool IsCompressed() const { return m_quantizedPositions != nullptr; }
+    size_t GetBytes() const
+    {
+        size_t vertexBytes = (m_positions ? sizeof(glm::vec3) : 4 * sizeof(uint16_t)) +
+                             (m_normals ? sizeof(glm::vec3) : 0) + (m_octahedralNormals ? sizeof(uint32_t) : 0) +
+                             (m_uvs ? sizeof(glm::vec2) : 0) + (m_halfUVs ? sizeof(uint32_t) : 0);
+        return m_vertexCount * vertexBytes + m_triangleCount * 3 * sizeof(uint32_t) + m_nodeCount * sizeof(MeshNode) +
+               m_blockCount * sizeof(TriangleBlock);
+    }
+
+private:
+    static bool HitNode(const MeshNode& node, const Ray& r, float tMin, float tMax)
+    {
+        STATS_COUNT(aabbTests);
+        glm::vec3 invDir = r.GetInvDir();
+        glm::vec3 origin = r.GetOrigin();
+        for(int i = 0; i < 3; ++i)
+        {
+            float t0 = ((r.GetSign(i) ? node.max : node.min)[i] - origin[i]) * invDir[i];
+            float t1 = ((r.GetSign(i) ? node.min : node.max)[i] - origin[i]) * invDir[i];
+            tMin     = t0 > tMin ? t0 : tMin;
+            tMax     = t1 < tMax ? t1 : tMax;
+            // the boxes aren't padded, a leaf of triangles in an axis aligned plane has no thickness
+            if(tMax < tMin)
+                return false;
+        }
+        return true;
+    }
+
+    glm::vec3 GetPosition(uint32_t vertex) const
+    {
+        if(m_positions)
+            return m_positions[vertex];
+        // std::fma rounds like the SIMD decode, the BVH is built from these exact values
+        const uint16_t* q = &m_quantizedPositions[4 * vertex];
+        return glm::vec3(std::fma((float)q[0], m_quantizationScale.x, m_quantizationMin.x), std::fma((float)q[1], m_quantizationScale.y, m_quantizationMin.y),
+                         std::fma((float)q[2], m_quantizationScale.z, m_quantizationMin.z));
+    }
+    glm::vec3 GetNormal(uint32_t vertex) const { return m_normals ? m_normals[vertex] : math::DecodeOctahedral(m_octahedralNormals[vertex]); }
+    glm::vec2 GetUV(uint32_t vertex) const
+    {
+        return m_uvs ? m_uvs[vertex] : glm::vec2(math::HalfToFloat(m_halfUVs[vertex] & 0xFFFF), math::HalfToFloat(m_halfUVs[vertex] >> 16));
+    }
+
+    // The triangles [first, first + count) of the index buffer of a compressed mesh, the other lanes are ignored by the tests
+    void DecodeBlock(uint32_t first, uint32_t count, TriangleBlock& block) const
+    {
+#if defined(__AVX2__) && defined(__FMA__)
+        __m256i lanes    = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i used     = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)count), lanes);
+        __m256i low      = _mm256_set1_epi32(0xFFFF);
+        const int* index = reinterpret_cast<const int*>(m_indices + 3 * (size_t)first);
+        const int* xy    = reinterpret_cast<const int*>(m_quantizedPositions);
+        for(int vertex = 0; vertex < 3; ++vertex)
+        {
+            // gather the vertex indices, then the 8 byte vertices (x and y, z and padding)
+            __m256i offset   = _mm256_add_epi32(_mm256_mullo_epi32(lanes, _mm256_set1_epi32(3)), _mm256_set1_epi32(vertex));
+            __m256i vertices = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), index, offset, used, 4);
+            __m256i packedXY = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), xy, vertices, used, 8);
+            __m256i packedZ  = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), xy + 1, vertices, used, 8);
+            __m256 x         = _mm256_cvtepi32_ps(_mm256_and_si256(packedXY, low));
+            __m256 y         = _mm256_cvtepi32_ps(_mm256_srli_epi32(packedXY, 16));
+            __m256 z         = _mm256_cvtepi32_ps(_mm256_and_si256(packedZ, low));
+            _mm256_store_ps(block.vertices[vertex][0], _mm256_fmadd_ps(x, _mm256_set1_ps(m_quantizationScale.x), _mm256_set1_ps(m_quantizationMin.x)));
+            _mm256_store_ps(block.vertices[vertex][1], _mm256_fmadd_ps(y, _mm256_set1_ps(m_quantizationScale.y), _mm256_set1_ps(m_quantizationMin.y)));
+            _mm256_store_ps(block.vertices[vertex][2], _mm256_fmadd_ps(z, _mm256_set1_ps(m_quantizationScale.z), _mm256_set1_ps(m_quantizationMin.z)));
+        }
+#else
+        for(uint32_t lane = 0; lane < MESH_BLOCK_WIDTH; ++lane)
+        {
+            for(int vertex = 0; vertex < 3; ++vertex)
+            {
+                glm::vec3 position = lane < count ? GetPosition(m_indices[3 * ((size_t)first + lane) + vertex]) : glm::vec3(0.0f);
+                for(int coordinate = 0; coordinate < 3; ++coordinate)
+                    block.vertices[vertex][coordinate][lane] = position[coordinate];
+            }
+        }
+#endif
+    }
+
+    void Compress(const MeshData& mesh, bool hasNormals, bool hasUVs)
+    {
+        glm::vec3 min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max());
+        for(const glm::vec3& position : mesh.positions)
+        {
+            min = glm::min(min, position);
+            max = glm::max(max, position);
+        }
+        m_quantizationMin   = min;
+        m_quantizationScale = glm::max(max - min, glm::vec3(std::numeric_limits<float>::min())) / 65535.0f;
+
+        uint16_t* positions = g_shapeAllocator.AllocateArray<uint16_t>(4 * (size_t)m_vertexCount, CACHE_LINE_SIZE);
+        for(uint32_t i = 0; i < m_vertexCount; ++i)
+        {
+            glm::vec3 q = glm::clamp(glm::round((mesh.positions[i] - min) / m_quantizationScale), glm::vec3(0.0f), glm::vec3(65535.0f));
+            for(int coordinate = 0; coordinate < 3; ++coordinate)
+                positions[4 * i + coordinate] = (uint16_t)q[coordinate];
+            positions[4 * i + 3] = 0;
+        }
+        m_quantizedPositions = positions;
+        if(hasNormals)
+        {
+            uint32_t* normals = g_shapeAllocator.AllocateArray<uint32_t>(m_vertexCount, CACHE_LINE_SIZE);
+            for(uint32_t i = 0; i < m_vertexCount; ++i)
+                normals[i] = math::EncodeOctahedral(mesh.normals[i]);
+            m_octahedralNormals = normals;
+        }
+        if(hasUVs)
+        {
+            uint32_t* uvs = g_shapeAllocator.AllocateArray<uint32_t>(m_vertexCount, CACHE_LINE_SIZE);
+            for(uint32_t i = 0; i < m_vertexCount; ++i)
+                uvs[i] = math::FloatToHalf(mesh.uvs[i].x) | ((uint32_t)math::FloatToHalf(mesh.uvs[i].y) << 16);
+            m_halfUVs = uvs;
+        }
+    }
+
+    template<typename T>
+    static T* CopyToArena(const std::vector<T>& source)
+    {
+        T* copy = g_shapeAllocator.AllocateArray<T>(source.size(), CACHE_LINE_SIZE);
+        std::memcpy(copy, source.data(), source.size() * sizeof(T));
+        return copy;
+    }
+
+    void BuildBVH(uint32_t* indices);
+
+    uint32_t m_vertexCount;
+    uint32_t m_triangleCount;
+    uint32_t m_nodeCount  = 0;
+    uint32_t m_blockCount = 0;
+    const glm::vec3* m_positions = nullptr;
+    const glm::vec3* m_normals   = nullptr;  // null without normals, the geometric normal is used then
+    const glm::vec2* m_uvs       = nullptr;  // null without UVs, the barycentric coordinates are used then
+    const uint32_t* m_indices;
+    const MeshNode* m_nodes;
+    const TriangleBlock* m_blocks        = nullptr;  // null for compressed meshes
+    const uint16_t* m_quantizedPositions = nullptr;  // x, y, z and padding per vertex, compressed meshes only
+    const uint32_t* m_octahedralNormals  = nullptr;
+    const uint32_t* m_halfUVs            = nullptr;
+    glm::vec3 m_quantizationMin          = glm::vec3(0.0f);
+    glm::vec3 m_quantizationScale        = glm::vec3(0.0f);
+    Material* m_material;
+    std::unique_ptr<MappedFile> m_file;  // the arrays point into it if the mesh was mapped
+};
+
+inline bool TriangleMesh::Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const
+{
+    if(m_triangleCount == 0)
+        return false;
+    ShearedRay ray(r);
+    uint32_t stack[MESH_BVH_STACK_SIZE];
+    int stackSize    = 0;
+    uint32_t node    = 0;
+    uint32_t closest = UINT32_MAX;
+    glm::vec3 uvw;
+    while(true)
+    {
+        STATS_COUNT(bvhNodes);
+        const MeshNode& current = m_nodes[node];
+        if(HitNode(current, r, tMin, tMax))
+        {
+            if(current.count == 0)
+            {
+                // the child on the side the ray comes from first, the other one later
+                bool reversed      = r.GetSign(current.axis);
+                stack[stackSize++] = reversed ? node + 1 : current.offset;
+                node               = reversed ? current.offset : node + 1;
+                continue;
+            }
+            STATS_ADD(primitiveTests[PRIMITIVE_TRIANGLE], current.count);
+            for(uint32_t first = 0; first < current.count; first += MESH_BLOCK_WIDTH)
+            {
+                uint32_t count = std::min<uint32_t>(current.count - first, MESH_BLOCK_WIDTH);
+                if(m_blocks)
+                {
+                    const TriangleBlock& block = m_blocks[current.offset + first / MESH_BLOCK_WIDTH];
+                    int lane                   = IntersectTriangleBlock(ray, block, count, tMin, tMax, uvw);
+                    if(lane >= 0)
+                        closest = block.triangles[lane];
+                }
+                else
+                {
+                    TriangleBlock block;
+                    DecodeBlock(current.offset + first, count, block);
+                    int lane = IntersectTriangleBlock(ray, block, count, tMin, tMax, uvw);
+                    if(lane >= 0)
+                        closest = current.offset + first + lane;
+                }
+            }
+        }
+        if(stackSize == 0)
+            break;
+        node = stack[--stackSize];
+    }
+    if(closest == UINT32_MAX)
+        return false;
+
+    const uint32_t* index = &m_indices[3 * closest];
+    glm::vec3 p0          = GetPosition(index[0]);
+    glm::vec3 p1          = GetPosition(index[1]);
+    glm::vec3 p2          = GetPosition(index[2]);
+    glm::vec3 geometric   = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+
+    outRecord.t         = tMax;
+    outRecord.point     = r.At(tMax);
+    outRecord.material  = m_material;
+    outRecord.uv        = m_uvs || m_halfUVs ? uvw.x * GetUV(index[0]) + uvw.y * GetUV(index[1]) + uvw.z * GetUV(index[2]) : glm::vec2(uvw.y, uvw.z);
+    outRecord.frontFace = glm::dot(r.GetDir(), geometric) < 0;
+    glm::vec3 normal    = geometric;
+    if(m_normals || m_octahedralNormals)
+    {
+        // interpolated normals, turned to the side of the geometric one
+        normal = glm::normalize(uvw.x * GetNormal(index[0]) + uvw.y * GetNormal(index[1]) + uvw.z * GetNormal(index[2]));
+        if(glm::dot(normal, geometric) < 0)
+            normal = -normal;
+    }
+    outRecord.normal = outRecord.frontFace ? normal : -normal;
+    return true;
+}
+
+// Top-down binned SAH build (Wald: On fast Construction of SAH-based Bounding Volume Hierarchies, 2007)
+// over the triangle centroids. Falls back to a median split where the binning finds no split.
+inline void TriangleMesh::BuildBVH(uint32_t* indices)
+{
+    PROFILE_SCOPE("Mesh BVH build");
+    std::vector<AABB> bounds(m_triangleCount);
+    std::vector<glm::vec3> centroids(m_triangleCount);
+    for(uint32_t i = 0; i < m_triangleCount; ++i)
+    {
+        glm::vec3 p0 = GetPosition(indices[3 * i]);
+        glm::vec3 p1 = GetPosition(indices[3 * i + 1]);
+        glm::vec3 p2 = GetPosition(indices[3 * i + 2]);
+        bounds[i]    = AABB(glm::min(p0, glm::min(p1, p2)), glm::max(p0, glm::max(p1, p2)));
+        centroids[i] = (bounds[i].GetMin() + bounds[i].GetMax()) * 0.5f;
+    }
+    std::vector<uint32_t> order(m_triangleCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<MeshNode> nodes;
+    nodes.reserve(2 * m_triangleCount / MESH_BLOCK_WIDTH + 1);
+    std::vector<TriangleBlock> blocks;
+
+    auto area = [](const glm::vec3& min, const glm::vec3& max)
+    {
+        glm::vec3 d = glm::max(max - min, glm::vec3(0));
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    };
+    // returns the index of the node built over order[begin, end)
+    auto build = [&](auto&& self, uint32_t begin, uint32_t end, int depth) -> uint32_t
+    {
+        uint32_t index = (uint32_t)nodes.size();
+        nodes.emplace_back();
+        glm::vec3 min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max());
+        glm::vec3 centroidMin = min, centroidMax = max;
+        for(uint32_t i = begin; i < end; ++i)
+        {
+            min         = glm::min(min, bounds[order[i]].GetMin());
+            max         = glm::max(max, bounds[order[i]].GetMax());
+            centroidMin = glm::min(centroidMin, centroids[order[i]]);
+            centroidMax = glm::max(centroidMax, centroids[order[i]]);
+        }
+        nodes[index].min = min;
+        nodes[index].max = max;
+
+        uint32_t count   = end - begin;
+        glm::vec3 extent = centroidMax - centroidMin;
+        int axis         = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        auto split = [&](uint32_t mid)
+        {
+            self(self, begin, mid, depth + 1);
+            uint32_t second     = self(self, mid, end, depth + 1);
+            nodes[index].offset = second;
+            nodes[index].count  = 0;
+            nodes[index].axis   = (uint16_t)axis;
+            return index;
+        };
+        // the median of the centroids along the axis, in any order if they all lie in a plane across it
+        auto medianSplit = [&]
+        {
+            uint32_t mid = begin + count / 2;
+            std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](uint32_t a, uint32_t b)
+                             { return centroids[a][axis] < centroids[b][axis]; });
+            return split(mid);
+        };
+        if(count <= MESH_BLOCK_WIDTH || depth + 1 >= MESH_BVH_MAX_DEPTH || extent[axis] <= 0.0f)
+        {
+            // the count of a node has 16 bits, bigger leaves are split anyway
+            if(count > UINT16_MAX)
+                return medianSplit();
+            nodes[index].offset = IsCompressed() ? begin : (uint32_t)blocks.size();
+            nodes[index].count  = (uint16_t)count;
+            for(uint32_t i = 0; i < count && !IsCompressed(); ++i)
+            {
+                uint32_t lane = i % MESH_BLOCK_WIDTH;
+                if(lane == 0)
+                    blocks.emplace_back();  // the unused lanes stay zero
+                TriangleBlock& block  = blocks.back();
+                uint32_t triangle     = order[begin + i];
+                block.triangles[lane] = triangle;
+                for(int vertex = 0; vertex < 3; ++vertex)
+                {
+                    glm::vec3 position = m_positions[indices[3 * triangle + vertex]];
+                    for(int coordinate = 0; coordinate < 3; ++coordinate)
+                        block.vertices[vertex][coordinate][lane] = position[coordinate];
+                }
+            }
+            return index;
+        }
+
+        struct Bin
+        {
+            glm::vec3 min  = glm::vec3(std::numeric_limits<float>::max());
+            glm::vec3 max  = glm::vec3(-std::numeric_limits<float>::max());
+            uint32_t count = 0;
+        };
+        Bin bins[MESH_SAH_BINS];
+        float scale = MESH_SAH_BINS / extent[axis];
+        auto binOf  = [&](uint32_t triangle)
+        { return std::min((int)((centroids[triangle][axis] - centroidMin[axis]) * scale), MESH_SAH_BINS - 1); };
+        for(uint32_t i = begin; i < end; ++i)
+        {
+            Bin& bin = bins[binOf(order[i])];
+            bin.min  = glm::min(bin.min, bounds[order[i]].GetMin());
+            bin.max  = glm::max(bin.max, bounds[order[i]].GetMax());
+            bin.count++;
+        }
+        // cost of splitting after bin i: the area times the triangle count of both sides
+        float rightCosts[MESH_SAH_BINS];
+        Bin right;
+        for(int i = MESH_SAH_BINS - 1; i > 0; --i)
+        {
+            right.min          = glm::min(right.min, bins[i].min);
+            right.max          = glm::max(right.max, bins[i].max);
+            right.count       += bins[i].count;
+            rightCosts[i - 1]  = right.count * area(right.min, right.max);
+        }
+        Bin left;
+        int bestSplit  = -1;
+        float bestCost = count * area(min, max);  // of not splitting
+        for(int i = 0; i < MESH_SAH_BINS - 1; ++i)
+        {
+            left.min    = glm::min(left.min, bins[i].min);
+            left.max    = glm::max(left.max, bins[i].max);
+            left.count += bins[i].count;
+            float cost  = left.count * area(left.min, left.max) + rightCosts[i];
+            if(left.count > 0 && left.count < count && cost < bestCost)
+            {
+                bestSplit = i;
+                bestCost  = cost;
+            }
+        }
+
+        if(bestSplit < 0)
+            return medianSplit();
+        return split((uint32_t)(std::partition(order.begin() + begin, order.begin() + end, [&](uint32_t triangle)
+                                               { return binOf(triangle) <= bestSplit; }) -
+                                order.begin()));
+    };
+    if(m_triangleCount > 0)
+        build(build, 0, m_triangleCount, 0);
+
+    m_nodeCount  = (uint32_t)nodes.size();
+    m_nodes      = CopyToArena(nodes);
+    if(IsCompressed())
+    {
+        // the leaves are ranges of the index buffer
+        std::vector<uint32_t> original(indices, indices + 3 * (size_t)m_triangleCount);
+        for(uint32_t i = 0; i < m_triangleCount; ++i)
+            std::memcpy(&indices[3 * i], &original[3 * (size_t)order[i]], 3 * sizeof(uint32_t));
+        return;
+    }
+    m_blockCount = (uint32_t)blocks.size();
+    m_blocks     = CopyToArena(blocks);
+}
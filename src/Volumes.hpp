@@ -5,6 +5,8 @@
 #include "Texture.h"
 #include "Material.h"
 #include "Allocator.hpp"
+#include "ResourceCache.hpp"
+#include "Stats.hpp"
 #include "3DMath/Random.h"
 #include <limits>
 #define GLM_ENABLE_EXPERIMENTAL
@@ -15,14 +17,15 @@ class ConstantMedium : public Hittable
 public:
     ConstantMedium(Hittable* boundary, float density, Texture* albedo) : m_boundary(boundary), m_negInvDensity(-1 / density)
     {
-        m_phaseFunction = g_materialAllocator.Allocate<Isotropic>(albedo);
+        m_phaseFunction = g_materialCache.Get<Isotropic>(albedo);
     }
     ConstantMedium(Hittable* boundary, float density, const glm::vec3& color) : m_boundary(boundary), m_negInvDensity(-1 / density)
     {
-        m_phaseFunction = g_materialAllocator.Allocate<Isotropic>(color);
+        m_phaseFunction = g_materialCache.Get<Isotropic>(color);
     }
     bool Hit(const Ray& r, float tMin, float tMax, HitRecord& outRecord) const override
     {
+        STATS_COUNT(primitiveTests[PRIMITIVE_MEDIUM]);
         HitRecord inHit, outHit;
         if(!m_boundary->Hit(r, -std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), inHit))
             return false;
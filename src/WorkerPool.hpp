@@ -0,0 +1,151 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Profiler.hpp"
+#include "System.hpp"
+
+// Persistent render threads, split evenly over the NUMA nodes and pinned to them.
+// ParallelFor() hands every node a contiguous block of the index range, so as long as a buffer is
+// first touched by a ParallelFor over the same range, each node mostly writes memory local to it.
+class WorkerPool
+{
+public:
+    // numThreads == 0 uses every hardware thread
+    WorkerPool(int numThreads = 0)
+    {
+        if(numThreads <= 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+        m_numNodes = std::min(GetNumaNodeCount(), numThreads);
+        m_nodes    = std::make_unique<NodeQueue[]>(m_numNodes);
+        m_loads    = std::make_unique<WorkerLoad[]>(numThreads);
+
+        for(int i = 0; i < numThreads; ++i)
+            m_threads.emplace_back(&WorkerPool::WorkerLoop, this, i, i * m_numNodes / numThreads);
+    }
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_quit = true;
+        }
+        m_startCondition.notify_all();
+        for(auto& thread : m_threads)
+            thread.join();
+    }
+    WorkerPool(const WorkerPool&)            = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Calls func(i) for every i in [0, count) on the workers and blocks until all of them returned
+    void ParallelFor(size_t count, const std::function<void(size_t)>& func)
+    {
+        std::unique_lock lock(m_mutex);
+        for(int n = 0; n < m_numNodes; ++n)
+        {
+            m_nodes[n].next = count * n / m_numNodes;
+            m_nodes[n].end  = count * (n + 1) / m_numNodes;
+        }
+        m_func    = &func;
+        m_running = (int)m_threads.size();
+        m_generation++;
+        m_startCondition.notify_all();
+        m_doneCondition.wait(lock, [this]
+                             { return m_running == 0; });
+        m_func = nullptr;
+    }
+
+    int GetNumThreads() const { return (int)m_threads.size(); }
+    int GetNumNodes() const { return m_numNodes; }
+
+    // Index of the calling worker thread in [0, GetNumThreads()), -1 outside of the pool
+    static int GetCurrentWorkerIndex() { return t_workerIndex; }
+
+    // Time a worker spent in ParallelFor() bodies and how many indices it ran since the last ResetLoads(),
+    // for the --scaling report. Only valid between ParallelFor() calls.
+    double GetBusySeconds(int worker) const { return m_loads[worker].busyNanoseconds / 1e9; }
+    uint64_t GetItemCount(int worker) const { return m_loads[worker].items; }
+    void ResetLoads()
+    {
+        for(int i = 0; i < GetNumThreads(); ++i)
+            m_loads[i] = WorkerLoad();
+    }
+
+private:
+    struct alignas(CACHE_LINE_SIZE) NodeQueue
+    {
+        std::atomic<size_t> next = 0;
+        size_t end               = 0;
+    };
+    // written by its worker only, read under the mutex once all of them are done
+    struct alignas(CACHE_LINE_SIZE) WorkerLoad
+    {
+        uint64_t busyNanoseconds = 0;
+        uint64_t items           = 0;
+    };
+
+    void WorkerLoop(int workerIndex, int node)
+    {
+        t_workerIndex = workerIndex;
+        PROFILE_THREAD_NAME("Worker " + std::to_string(workerIndex));
+        if(m_numNodes > 1)
+            PinCurrentThreadToNumaNode(node);
+
+        uint64_t generation = 0;
+        while(true)
+        {
+            const std::function<void(size_t)>* func;
+            {
+                std::unique_lock lock(m_mutex);
+                m_startCondition.wait(lock, [&]
+                                      { return m_quit || m_generation != generation; });
+                if(m_quit)
+                    return;
+                generation = m_generation;
+                func       = m_func;
+            }
+
+            // drain the own node's block first, then help the other nodes
+            {
+                PROFILE_SCOPE("ParallelFor");
+                auto start     = std::chrono::steady_clock::now();
+                uint64_t items = 0;
+                for(int i = 0; i < m_numNodes; ++i)
+                {
+                    NodeQueue& queue = m_nodes[(node + i) % m_numNodes];
+                    for(size_t index = queue.next++; index < queue.end; index = queue.next++, ++items)
+                        (*func)(index);
+                }
+                WorkerLoad& load      = m_loads[workerIndex];
+                load.busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                load.items           += items;
+            }
+
+            std::lock_guard lock(m_mutex);
+            if(--m_running == 0)
+                m_doneCondition.notify_one();
+        }
+    }
+
+    static inline thread_local int t_workerIndex = -1;
+
+    std::vector<std::thread> m_threads;
+    int m_numNodes;
+    std::unique_ptr<NodeQueue[]> m_nodes;
+    std::unique_ptr<WorkerLoad[]> m_loads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_startCondition;
+    std::condition_variable m_doneCondition;
+    const std::function<void(size_t)>* m_func = nullptr;
+    uint64_t m_generation                     = 0;
+    int m_running                             = 0;
+    bool m_quit                               = false;
+};
@@ -1,543 +1,991 @@
-#include "Box.hpp"
-#include "Transformations.hpp"
-#include "Volumes.hpp"
 #define GLM_FORCE_MESSAGES
 #define GLM_ENABLE_EXPERIMENTAL
 // #define GLM_FORCE_SIMD_AVX2
 #define GLM_FORCE_SIMD_AVX512
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
 #include <stdint.h>
-#include <execution>
+#ifndef RAYTRACER_HEADLESS
 #include "MiniFB_cpp.h"
+#endif
 #include "glm/glm.hpp"
 #include "glm/gtx/norm.hpp"
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
-
 #include "3DMath/Random.h"
-#include "Quad.hpp"
-#include "BVH.h"
 #include "Camera.h"
+#include "CameraController.hpp"
 #include "HittableList.h"
 #include "Material.h"
 #include "Ray.h"
-#include "Sphere.h"
-#include "Texture.h"
 #include "Allocator.hpp"
+#include "Aov.hpp"
+#include "BVH.h"
+#include "Benchmark.hpp"
+#include "Checkpoint.hpp"
+#include "Denoiser.hpp"
+#include "DisplayBuffers.hpp"
+#include "Exr.hpp"
+#include "Framebuffer.hpp"
+#include "FrameScheduler.hpp"
+#include "ImageWriter.hpp"
+#include "Options.hpp"
+#include "Profiler.hpp"
+#include "Quality.hpp"
+#include "Reprojection.hpp"
+#include "ResourceCache.hpp"
+#include "Scenes.hpp"
+#include "Stats.hpp"
+#include "WorkerPool.hpp"
+
+
+#define SHAPE_ALLOCATOR_CHUNK_SIZE    HUGE_PAGE_SIZE
+#define MATERIAL_ALLOCATOR_CHUNK_SIZE HUGE_PAGE_SIZE
+// The scene is read by every worker: huge pages cut the TLB misses of BVH traversal and interleaving
+// spreads the reads over the memory controllers of all NUMA nodes
+#define SCENE_PAGE_FLAGS              (PAGES_HUGE | PAGES_NUMA_INTERLEAVED)
+LinearAllocator g_shapeAllocator("Shape", SHAPE_ALLOCATOR_CHUNK_SIZE, SCENE_PAGE_FLAGS);
+LinearAllocator g_materialAllocator("Material", MATERIAL_ALLOCATOR_CHUNK_SIZE, SCENE_PAGE_FLAGS);
+ResourceCache g_materialCache(g_materialAllocator);
+
+// Scenes with random content are built from a fixed seed so every run, and every machine, renders
+// the same scene and their checkpoints can be resumed and merged
+#define SCENE_SEED 0
+
+// Rays the calling thread traced so far, for the benchmark
+thread_local uint64_t t_raysTraced = 0;
+
+#define CAMERA_MOVE_SPEED   0.5f  // scene camera distances per second
+#define CAMERA_ROTATE_SPEED 0.2f  // degrees per pixel of mouse movement
+
+// Rows are seeded in chunks of this many pixels, so that a chunk traces the same samples whether it is
+// traced on its own or as part of its row
+#define TRACE_CHUNK_WIDTH 64
+
+
+// What a camera ray hit first, for reprojection and the denoiser. The denoiser looks through mirrors and
+// glass: albedo and normal are the ones of the first surface that isn't specular, tinted by the specular
+// ones in front of it, so that reflections keep their detail.
+struct PrimaryHit
+{
+    float distance   = std::numeric_limits<float>::infinity();  // along the camera ray
+    glm::vec3 albedo = glm::vec3(1);                            // 1 for lights and the background
+    glm::vec3 normal = glm::vec3(0);                            // 0 for the background
+    bool isSpecular  = false;                                   // the ray being traced was reflected or refracted
+};
+
+// One segment of a path, counted for the benchmark and the traversal stats
+bool TraceRay(const Hittable& world, const Ray& r, HitRecord& rec)
+{
+    t_raysTraced++;
+#ifdef RAYTRACER_STATS
+    RayStats& stats = GetThreadStats();
+    uint64_t cost   = stats.GetTraversalCost();
+    bool hit        = world.Hit(r, 0.001f, std::numeric_limits<float>::infinity(), rec);
+    stats.AddRay(stats.GetTraversalCost() - cost);
+    return hit;
+#else
+    return world.Hit(r, 0.001f, std::numeric_limits<float>::infinity(), rec);
+#endif
+}
 
-
-#define SHAPE_ALLOCATOR_SIZE    1024 * 512
-#define MATERIAL_ALLOCATOR_SIZE 1024 * 1024
-LinearAllocator g_shapeAllocator(SHAPE_ALLOCATOR_SIZE);
-LinearAllocator g_materialAllocator(MATERIAL_ALLOCATOR_SIZE);
-
-
-glm::vec3 RayColor(const Ray& r, const glm::vec3& background,
-                   const Hittable& world, const Hittable& lights, int depth)
+// What --heatmap shows instead of the image: the BVH nodes the camera ray visits plus the primitives it
+// tests. Always 0 without RAYTRACER_STATS.
+float TraversalCost(const Hittable& world, const Ray& r, PrimaryHit& primary)
 {
-    if(depth <= 0)
-        return glm::vec3(1);
     HitRecord rec;
+#ifdef RAYTRACER_STATS
+    uint64_t cost = GetThreadStats().GetTraversalCost();
+#endif
+    if(TraceRay(world, r, rec))
+    {
+        primary.distance = rec.t;
+        primary.normal   = rec.normal;
+    }
+#ifdef RAYTRACER_STATS
+    return (float)(GetThreadStats().GetTraversalCost() - cost);
+#else
+    return 0.0f;
+#endif
+}
 
-    if(!world.Hit(r, 0.001f, std::numeric_limits<float>::infinity(), rec))
-        return background;
-
-    ScatterRecord scatterRec;
-    glm::vec3 emitted = rec.material->Emitted(rec, rec.uv, rec.point);
-    if(!rec.material->Scatter(r, rec, scatterRec))
-        return emitted;
+// Follows the path of a camera ray and returns the light reaching the camera along it: the emission of
+// every vertex times the throughput of the bounces in front of it. paths, if given, also gets each
+// emission added to the light AOVs it belongs to.
+glm::vec3 RayColor(const Ray& cameraRay, const glm::vec3& background, const Hittable& world, const HittableList& lights, int maxDepth,
+                   PrimaryHit* primary = nullptr, LightPaths* paths = nullptr)
+{
+    glm::vec3 color(0);
+    glm::vec3 throughput(1);
+    Ray r = cameraRay;
+    auto addEmission = [&](const glm::vec3& emitted, int bounce, int source)
+    {
+        glm::vec3 radiance = throughput * emitted;
+        color += radiance;
+        if(paths)
+            paths->Add(radiance, bounce, source);
+    };
 
-    if(scatterRec.pdf == nullptr)
+    for(int bounce = 0;; ++bounce)
     {
-        return emitted + scatterRec.attenuation * RayColor(scatterRec.skipPDFRay, background, world, lights, depth - 1);
-    }
+        if(bounce >= maxDepth)
+        {
+            addEmission(glm::vec3(1), bounce, LightPaths::None);
+            return color;
+        }
+        HitRecord rec;
 
+        if(!TraceRay(world, r, rec))
+        {
+            if(primary)
+                primary->normal = glm::vec3(0);
+            addEmission(background, bounce, LightPaths::Background);
+            return color;
+        }
 
-    HittablePDF lightPDF(rec.point, lights);
+        ScatterRecord scatterRec;
+        glm::vec3 emitted = rec.material->Emitted(rec, rec.uv, rec.point);
+        bool scatters     = rec.material->Scatter(r, rec, scatterRec);
+        if(primary)
+        {
+            if(!primary->isSpecular)
+                primary->distance = rec.t;
+            if(scatters)
+                primary->albedo *= scatterRec.attenuation;
+            primary->normal = rec.normal;
+        }
+        addEmission(emitted, bounce, paths ? LightPaths::LightSlot(rec.material->GetLightIndex()) : LightPaths::None);
+        if(!scatters)
+            return color;
 
-    MixturePDF mixturePDF(&lightPDF, scatterRec.pdf.get());
-    Ray scattered(rec.point, mixturePDF.Generate());
-    float pdfValue = mixturePDF.Value(scattered.GetDir());
+        if(scatterRec.pdf == nullptr)
+        {
+            if(primary)
+                primary->isSpecular = true;
+            throughput *= scatterRec.attenuation;
+            r           = scatterRec.skipPDFRay;
+            continue;
+        }
+        // the primary hit is only followed through specular bounces
+        primary = nullptr;
 
-    float scatteringPDF   = rec.material->ScatteringPDF(r, rec, scattered);
-    // if(pdfValue == 0)
-    // {
-    //     std::cout << "NaN\n";
-    //     return glm::vec3(1);
-    // }
-    glm::vec3 sampleColor = RayColor(scattered, background, world, lights, depth - 1);
 
-    glm::vec3 scatterColor = scatterRec.attenuation * sampleColor * scatteringPDF / pdfValue;
+        HittablePDF lightPDF(rec.point, lights);
 
+        MixturePDF mixturePDF(&lightPDF, scatterRec.pdf);
+        // scenes without a light list can only sample the material
+        PDF* pdf = lights.IsEmpty() ? scatterRec.pdf : &mixturePDF;
+        Ray scattered(rec.point, pdf->Generate());
+        float pdfValue = pdf->Value(scattered.GetDir());
 
-    return emitted + scatterColor;
+        float scatteringPDF = rec.material->ScatteringPDF(r, rec, scattered);
+        throughput *= scatterRec.attenuation * scatteringPDF / pdfValue;
+        r = scattered;
+    }
 }
 
-std::string GetCurrentFilename(const std::string& base,
-                               const std::string& ext, int numSamples)
+// Adds pass.samples samples to the pixels of image row y that are part of the pass, stored in row
+// targetRow of target, and of targetAovs if the AOVs are rendered. Rows are numbered from the top of the image.
+// Only the chunks [firstChunk, endChunk) of TRACE_CHUNK_WIDTH pixels of the row are traced.
+void TraceRow(const Scene& scene, const Camera& cam, const RenderOptions& options, uint64_t seed, const RenderPass& pass, uint32_t y,
+              Framebuffer& target, AovBuffer* targetAovs, uint32_t targetRow, uint32_t firstChunk = 0, uint32_t endChunk = UINT32_MAX)
 {
-    std::filesystem::path p = std::filesystem::current_path() / ".." / "images";
+    PROFILE_SCOPE_INDEX("TraceRow", y);
+    LinearAllocator& scratch = GetScratchAllocator();
+    uint32_t endX            = (uint32_t)std::min<uint64_t>((uint64_t)endChunk * TRACE_CHUNK_WIDTH, options.width);
+    for(uint32_t x = firstChunk * TRACE_CHUNK_WIDTH; x < endX; ++x)
+    {
+        // the samples of a chunk only depend on the seed, not on the worker tracing it
+        if(x % TRACE_CHUNK_WIDTH == 0)
+            math::SeedRandom(math::MixSeed(math::MixSeed(math::MixSeed(seed, pass.index), y), x / TRACE_CHUNK_WIDTH));
+        if(!pass.Contains(x, y))
+            continue;
+        glm::vec3 color(0);
+        glm::vec3 albedo(0);
+        glm::vec3 normal(0);
+        float depth;
+        // the sums are only zeroed when the AOVs are rendered
+        std::optional<LightPaths> paths;
+        if(targetAovs)
+            paths.emplace();
+        for(uint32_t s = 0; s < pass.samples; ++s)
+        {
+            float u = (x + math::RandomReal<float>()) / (options.width - 1);
+            float v = (options.height - 1 - y + math::RandomReal<float>()) / (options.height - 1);
+
+            PrimaryHit primary;
+            [[maybe_unused]] uint64_t segments = t_raysTraced;
+            if(options.heatmap)
+                color += glm::vec3(TraversalCost(scene.world, cam.GetRay(u, v), primary));
+            else
+                color += RayColor(cam.GetRay(u, v), scene.background, scene.world, scene.lights, options.maxDepth, &primary, paths ? &*paths : nullptr);
+            STATS_PATH(t_raysTraced - segments);
+            albedo += primary.albedo;
+            normal += primary.normal;
+            // the depth of the first sample stands for the pixel when reprojecting
+            if(s == 0)
+                depth = primary.distance;
+            scratch.Reset();
+        }
+        target.AddSamples(x, targetRow, color, pass.samples);
+        target.SetDepth(x, targetRow, depth);
+        target.AddFeatures(x, targetRow, albedo, normal, pass.samples);
+        if(targetAovs)
+            targetAovs->AddSamples(x, targetRow, *paths, pass.samples);
+    }
+}
 
-    int i = 0;
-    for(const auto& entry : std::filesystem::directory_iterator(p))
+// Out of core rendering for images that don't fit in memory: bands of options.tileRows rows are rendered
+// to the full sample count one after the other and appended to the EXR as soon as they are done, so
+// memory use only depends on the width and the band height. The samples are the same as the ones a
+// full frame render with the same seed would take.
+int RenderTiled(const Scene& scene, const Camera& cam, const RenderOptions& options, uint64_t seed, WorkerPool& workers,
+                const std::string& filename)
+{
+    const uint32_t width    = options.width;
+    const uint32_t height   = options.height;
+    const uint32_t bandRows = std::min(options.tileRows, height);
+    const uint32_t passes   = (options.samplesPerPixel + options.samplesPerPass - 1) / options.samplesPerPass;
+    const uint32_t chunks   = (width + TRACE_CHUNK_WIDTH - 1) / TRACE_CHUNK_WIDTH;  // per row
+
+    Framebuffer band(width, bandRows);
+    std::unique_ptr<AovBuffer> bandAovs;
+    std::vector<std::string> names = {"R", "G", "B"};
+    if(!options.aovs.empty())
     {
-        if(entry.path().filename().string().find(base) == 0 && entry.path().extension().string() == ext)
-            i++;
+        bandAovs                      = std::make_unique<AovBuffer>(width, bandRows, options.aovs, Emissive::GetLightCount());
+        std::vector<std::string> aovs = bandAovs->GetChannelNames();
+        names.insert(names.end(), aovs.begin(), aovs.end());
     }
 
+    // half floats keep a 32k x 32k image at 6 GB
+    ExrWriter exr;
+    if(!exr.Open(filename, width, height, names, ExrPixelType::Half))
+        return 1;
 
-    return (p / (base + std::to_string(i) + "_" + std::to_string(numSamples) + ext)).string();
-}
+    std::vector<float> rows(width * names.size());
+    std::vector<const float*> channels(names.size());
+    for(size_t c = 0; c < names.size(); ++c)
+        channels[c] = &rows[c * width];
 
-void SaveImage(std::vector<uint8_t>& pixels, int width, int height, int numSamples)
-{
-    std::string filename = GetCurrentFilename("image", ".png", numSamples);
-    stbi_write_png(filename.c_str(), width, height, 4, pixels.data(),
-                   width * 4);
-    std::cout << "\nDone.\n"
-              << "Wrote to: " << filename << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t bandStart = 0; bandStart < height; bandStart += bandRows)
+    {
+        uint32_t rowCount = std::min(bandRows, height - bandStart);
+        workers.ParallelFor(rowCount, [&](size_t row)
+                            {
+            band.ClearRow(row);
+            if(bandAovs)
+                bandAovs->ClearRow(row); });
+        for(uint32_t index = 0; index < passes; ++index)
+        {
+            RenderPass pass;
+            pass.index   = index;
+            pass.samples = std::min(options.samplesPerPass, options.samplesPerPixel - index * options.samplesPerPass);
+            // chunks of rows rather than rows keep every worker busy in bands of fewer rows than workers
+            workers.ParallelFor(rowCount * chunks, [&](size_t item)
+                                {
+                uint32_t row   = (uint32_t)(item / chunks);
+                uint32_t chunk = (uint32_t)(item % chunks);
+                TraceRow(scene, cam, options, seed, pass, bandStart + row, band, bandAovs.get(), row, chunk, chunk + 1); });
+        }
+
+        for(uint32_t row = 0; row < rowCount; ++row)
+        {
+            for(uint32_t x = 0; x < width; ++x)
+            {
+                glm::vec3 color     = band.GetAverage(x, row) * options.resolve.exposure;
+                rows[x]             = color.r;
+                rows[width + x]     = color.g;
+                rows[2 * width + x] = color.b;
+            }
+            if(bandAovs)
+                bandAovs->ResolveRow(row, band, row, options.resolve.exposure, &rows[3 * width]);
+            exr.WriteScanline(channels.data());
+        }
+        std::cout << "\rRows " << bandStart + rowCount << "/" << height << std::flush;
+    }
+    std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "\nRendered in " << elapsed.count() << " s" << std::endl;
+#ifdef RAYTRACER_STATS
+    CollectStats().Print(options.scene.c_str());
+#endif
+
+    if(!exr.Close())
+        return 1;
+    std::cout << "Wrote to: " << filename << std::endl;
+    return 0;
 }
 
-HittableList RandomScene()
+// Renders every built-in scene without AOVs at the settings of the options, which default to the fixed
+// BENCHMARK_ ones: an untimed warmup, then options.benchmarkRepeats timed renders of the same samples.
+// The report goes to the JSON file options.benchmark.
+int RunBenchmark(const RenderOptions& options, WorkerPool& workers)
 {
-    // Materials
-    auto* sphereMat = g_materialAllocator.Allocate<Lambertian>(glm::vec3(0.8f, 0.f, 0.2f));
-    auto* groundMat = g_materialAllocator.Allocate<Lambertian>(
-        g_shapeAllocator.Allocate<CheckerTexture>(glm::vec3(0.f), glm::vec3(1.f)));
-    auto* sphereLeft = g_materialAllocator.Allocate<Dielectric>(1.5f);
-    auto* metalRight = g_materialAllocator.Allocate<Metal>(glm::vec3(0.8f, 0.6f, 0.2f), 1.f);
-    // world
-    HittableList world;
-
-    constexpr int gridSize = 11;
-    for(int a = -gridSize; a < gridSize; a++)
+    BenchmarkSettings settings;
+    settings.width           = options.width;
+    settings.height          = options.height;
+    settings.samplesPerPixel = options.samplesPerPixel;
+    settings.maxDepth        = options.maxDepth;
+    settings.seed            = *options.seed;
+    settings.threads         = workers.GetNumThreads();
+    settings.numaNodes       = workers.GetNumNodes();
+    std::cout << "Benchmarking " << options.width << "x" << options.height << " at " << options.samplesPerPixel << " spp with "
+              << settings.threads << " threads" << std::endl;
+
+    Framebuffer framebuffer(options.width, options.height);
+    std::vector<BenchmarkResult> results;
+    for(const char* name : g_sceneNames)
     {
-        for(int b = -gridSize; b < gridSize; b++)
+        BenchmarkResult result;
+        result.scene = name;
+        ResetPeakMemoryUsage();
         {
-            auto matChoice = math::RandomReal<float>();
-            glm::vec3 center(a + 0.9f * math::RandomReal<float>(), 0.2f,
-                             b + 0.9f * math::RandomReal<float>());
-            if(glm::length2(center - glm::vec3(4.f, 0.2f, 0.f)) > 0.9f * 0.9f)
+            math::SeedRandom(SCENE_SEED);
+            Scene scene;
+            double bvhSeconds = BVHNode::GetBuildSeconds();
+            auto start        = std::chrono::steady_clock::now();
+            BuildScene(name, scene);
+            result.buildSeconds    = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            result.bvhBuildSeconds = BVHNode::GetBuildSeconds() - bvhSeconds;
+            result.sceneBytes      = g_shapeAllocator.GetBytesUsed() + g_materialAllocator.GetBytesUsed();
+            Camera cam             = CameraController(scene, (float)options.width / options.height).GetCamera();
+
+            // the passes restart at index 0 every time, so every render traces the same rays
+            std::atomic<uint64_t> rays = 0;
+            auto render                = [&](uint32_t samplesPerPixel)
             {
-                Material* mat;
-                if(matChoice < 0.6f)
-                {
-                    // diffuse
-                    auto albedo = math::RandomInUnitSphere<float>() * math::RandomInUnitSphere<float>();  // random color
-                    mat         = g_materialAllocator.Allocate<Lambertian>(albedo);
-                }
-                else if(matChoice < 0.85f)
-                {
-                    // metal
-                    auto albedo = glm::vec3(math::RandomReal<float>(0.5f, 1.0f),
-                                            math::RandomReal<float>(0.5f, 1.0f),
-                                            math::RandomReal<float>(0.5f, 1.0f));
-                    auto fuzz   = math::RandomReal<float>(0.f, 0.5f);
-                    mat         = g_materialAllocator.Allocate<Metal>(albedo, fuzz);
-                }
-                else
+                framebuffer.Clear(workers);
+                rays = 0;
+                RenderPass pass;
+                for(uint32_t done = 0; done < samplesPerPixel; done += pass.samples)
                 {
-                    // glass
-                    mat = g_materialAllocator.Allocate<Dielectric>(1.5f);
+                    pass.samples = std::min(options.samplesPerPass, samplesPerPixel - done);
+                    workers.ParallelFor(options.height, [&](size_t y)
+                                        {
+                        uint64_t before = t_raysTraced;
+                        TraceRow(scene, cam, options, settings.seed, pass, y, framebuffer, nullptr, y);
+                        rays += t_raysTraced - before; });
+                    pass.index++;
                 }
-                world.Add(g_shapeAllocator.Allocate<Sphere>(center, 0.2f, mat));
+            };
+
+            render(BENCHMARK_WARMUP_SPP);
+#ifdef RAYTRACER_STATS
+            ResetStats();
+#endif
+            for(uint32_t i = 0; i < options.benchmarkRepeats; ++i)
+            {
+                auto renderStart = std::chrono::steady_clock::now();
+                render(options.samplesPerPixel);
+                result.renderSeconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count());
             }
+            result.rays = rays;
+#ifdef RAYTRACER_STATS
+            CollectStats().Print(name);
+#endif
         }
+        result.peakMemoryBytes = GetPeakMemoryUsage();
+        std::cout << name << ": " << result.rays / result.GetBestSeconds() / 1e6 << " Mrays/s, best of " << options.benchmarkRepeats
+                  << " " << result.GetBestSeconds() << " s, built in " << result.buildSeconds * 1000.0 << " ms" << std::endl;
+        results.push_back(result);
+
+        g_materialCache.Clear();
+        g_materialAllocator.Reset();
+        g_shapeAllocator.Reset();
     }
-    auto* mat1 = g_materialAllocator.Allocate<Dielectric>(1.5f);
-    world.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(0, 1, 0), 1.f, mat1));
 
-    auto* mat2 = g_materialAllocator.Allocate<Lambertian>(glm::vec3(0.4f, 0.2f, 0.1f));
-    world.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(-4, 1, 0), 1.f, mat2));
+    if(!WriteBenchmarkJson(options.benchmark, settings, results))
+    {
+        std::cerr << "ERROR: Couldn't write " << options.benchmark << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote to: " << options.benchmark << std::endl;
+    return 0;
+}
 
-    auto* mat3 = g_materialAllocator.Allocate<Metal>(glm::vec3(0.7f, 0.6f, 0.5f), 0.f);
-    world.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(4, 1, 0), 1.f, mat3));
-    // Render into a PPM image
-    //
+// Image quality check of --quality: every scene is traced to options.samplesPerPixel and compared against
+// a reference in the options.quality directory after every doubling of the samples, which gives the error
+// over the tracing time. Missing references, or ones of other settings, are rendered first. Fails if the
+// final error of a scene grew by more than QUALITY_TOLERANCE over the baseline of an earlier run.
+int RunQuality(const RenderOptions& options, WorkerPool& workers)
+{
+    const uint32_t width  = options.width;
+    const uint32_t height = options.height;
+    std::filesystem::path directory(options.quality);
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    std::cout << "Checking image quality at " << width << "x" << height << " and " << options.samplesPerPixel << " spp against "
+              << directory.string() << std::endl;
+
+    Framebuffer framebuffer(width, height);
+    Framebuffer reference(width, height);
+    std::vector<glm::vec3> image((size_t)width * height);
+    std::vector<glm::vec3> referenceImage((size_t)width * height);
+    auto average = [&](const Framebuffer& source, std::vector<glm::vec3>& out)
+    {
+        for(uint32_t y = 0; y < height; ++y)
+            for(uint32_t x = 0; x < width; ++x)
+                out[(size_t)y * width + x] = source.GetAverage(x, y);
+    };
 
-    BVHNode worldBVH(world);
+    std::vector<QualitySample> samples;
+    for(const char* name : g_sceneNames)
+    {
+        math::SeedRandom(SCENE_SEED);
+        Scene scene;
+        BuildScene(name, scene);
+        Camera cam = CameraController(scene, (float)width / height).GetCamera();
 
-    HittableList objects;
-    objects.Add(g_shapeAllocator.Allocate<BVHNode>(worldBVH));
-    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(0, -1000, 0), 1000.f,
-                                                  groundMat));  // "ground"
+        // continues the passes of target from done to samplesPerPixel samples
+        auto trace = [&](Framebuffer& target, uint64_t seed, RenderPass& pass, uint32_t done, uint32_t samplesPerPixel)
+        {
+            for(; done < samplesPerPixel; done += pass.samples)
+            {
+                pass.samples = std::min(options.samplesPerPass, samplesPerPixel - done);
+                workers.ParallelFor(height, [&](size_t y)
+                                    { TraceRow(scene, cam, options, seed, pass, y, target, nullptr, y); });
+                pass.index++;
+            }
+        };
 
-    return objects;
-}
+        std::string referencePath = (directory / (std::string(name) + "_reference.ckpt")).string();
+        CheckpointInfo info;
+        reference.Clear(workers);
+        if(!std::filesystem::exists(referencePath) || !ReadCheckpointInfo(referencePath, info) || info.scene != name || info.width != width ||
+           info.height != height || info.maxDepth != options.maxDepth || !AccumulateCheckpoint(referencePath, reference))
+        {
+            std::cout << "Rendering the " << name << " reference at " << QUALITY_REFERENCE_SPP << " spp" << std::endl;
+            reference.Clear(workers);
+            RenderPass pass;
+            trace(reference, QUALITY_REFERENCE_SEED, pass, 0, QUALITY_REFERENCE_SPP);
+            info = {name, width, height, options.maxDepth, QUALITY_REFERENCE_SPP, QUALITY_REFERENCE_SEED, pass.index};
+            if(!WriteCheckpoint(referencePath, reference, info))
+                return 1;
+        }
+        average(reference, referenceImage);
 
-HittableList Earth()
-{
-    auto* texture = g_materialAllocator.Allocate<ImageTexture>("../earthmap.jpg");
-    auto* mat     = g_materialAllocator.Allocate<Lambertian>(texture);
-    auto* globe   = g_shapeAllocator.Allocate<Sphere>(glm::vec3(0), 2.f, mat);
+        framebuffer.Clear(workers);
+        RenderPass pass;
+        double seconds = 0.0;
+        for(uint32_t done = 0, next = 1; done < options.samplesPerPixel; next = std::min(2 * next, options.samplesPerPixel))
+        {
+            auto start = std::chrono::steady_clock::now();
+            trace(framebuffer, *options.seed, pass, done, next);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            done     = next;
+            average(framebuffer, image);
+            samples.push_back({name, done, seconds, CompareImages(image, referenceImage, width, height)});
+        }
+        const ImageError& last = samples.back().error;
+        std::cout << name << ": relMSE " << last.relMse << ", RMSE " << last.rmse << ", FLIP " << last.flip << " after " << seconds << " s"
+                  << std::endl;
 
-    HittableList objects;
-    objects.Add(globe);
-    return objects;
-}
-HittableList EmissionScene()
-{
-    auto* texture = g_materialAllocator.Allocate<ImageTexture>("earthmap.jpg");
-    auto* mat1    = g_materialAllocator.Allocate<Lambertian>(texture);
-    auto* mat2    = g_materialAllocator.Allocate<Emissive>(4.0f * glm::vec3(1, 1, 1));
-
-    auto* sphere1 = g_shapeAllocator.Allocate<Sphere>(glm::vec3(0, 2, 0), 2.0f, mat1);
-    auto* light   = g_shapeAllocator.Allocate<Quad>(glm::vec3(3, 1, -2), glm::vec3(2, 0, 0), glm::vec3(0, 2, 0), mat2);
-
-    HittableList objects;
-    objects.Add(sphere1);
-    objects.Add(light);
-
-    auto* groundMat = g_materialAllocator.Allocate<Lambertian>(
-        g_shapeAllocator.Allocate<SolidColor>(glm::vec3(1, 1, 0)));
-    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(0, -1000, 0), 1000.f,
-                                                  groundMat));  // "ground"
-    // 10), -5, groundMat));
-    return objects;
-}
-HittableList CornellBox()
-{
-    HittableList objects;
-
-    auto* red   = g_materialAllocator.Allocate<Lambertian>(glm::vec3(.65, .05, .05));
-    auto* white = g_materialAllocator.Allocate<Lambertian>(glm::vec3(.73, .73, .73));
-    auto* green = g_materialAllocator.Allocate<Lambertian>(glm::vec3(.12, .45, .15));
-    auto* light = g_materialAllocator.Allocate<Emissive>(7.0f * glm::vec3(1));
-
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), glm::vec3(0, 0, 555), green));
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(0, 555, 0), glm::vec3(0, 0, 555), red));
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(555, 0, 0), glm::vec3(0, 0, 555), white));
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(555, 555, 555), glm::vec3(-555, 0, 0), glm::vec3(0, 0, -555), white));
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 555), glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), white));
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(213, 554, 227), glm::vec3(130, 0, 0), glm::vec3(0, 0, 105), light));
-    // objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), white));
-
-    Hittable* box1 = g_shapeAllocator.Allocate<Box>(glm::vec3(0, 0, 0), glm::vec3(165, 330, 165), white);
-    box1           = g_shapeAllocator.Allocate<RotateY>(box1, 15);
-    box1           = g_shapeAllocator.Allocate<Translate>(box1, glm::vec3(265, 0, 295));
-    objects.Add(box1);
-
-    // Hittable* box2 = g_shapeAllocator.Allocate<Box>(glm::vec3(0, 0, 0), glm::vec3(165, 165, 165), white);
-    // box2           = g_shapeAllocator.Allocate<RotateY>(box2, -18);
-    // box2           = g_shapeAllocator.Allocate<Translate>(box2, glm::vec3(130, 0, 65));
-    // objects.Add(box2);
-    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(190, 90, 190), 90.f, g_materialAllocator.Allocate<Dielectric>(1.5f)));
-    return objects;
-}
-HittableList CornellBoxLights()
-{
-    HittableList objects;
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(113, 554, 127), glm::vec3(330, 0, 0), glm::vec3(0, 0, 305), nullptr));
-    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(190, 90, 190), 90.f, nullptr));
-    return objects;
-}
+        g_materialCache.Clear();
+        g_materialAllocator.Reset();
+        g_shapeAllocator.Reset();
+    }
 
+    std::string reportPath   = (directory / "quality.csv").string();
+    std::string baselinePath = (directory / "quality_baseline.csv").string();
+    std::vector<QualitySample> baseline;
+    bool failed = false;
+    if(options.qualityUpdate || !std::filesystem::exists(baselinePath))
+    {
+        if(!WriteQualityCsv(baselinePath, samples))
+        {
+            std::cerr << "ERROR: Couldn't write " << baselinePath << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote the baseline to: " << baselinePath << std::endl;
+    }
+    else if(!ReadQualityCsv(baselinePath, baseline))
+    {
+        std::cerr << "ERROR: Couldn't read " << baselinePath << std::endl;
+        return 1;
+    }
+    else
+    {
+        // the final sample of every scene against the baseline sample with the same count
+        for(size_t i = 0; i < samples.size(); ++i)
+        {
+            const QualitySample& sample = samples[i];
+            if(i + 1 < samples.size() && samples[i + 1].scene == sample.scene)
+                continue;
+            auto base = std::find_if(baseline.begin(), baseline.end(), [&](const QualitySample& b)
+                                     { return b.scene == sample.scene && b.samplesPerPixel == sample.samplesPerPixel; });
+            if(base == baseline.end())
+            {
+                std::cout << sample.scene << ": no baseline at " << sample.samplesPerPixel << " spp" << std::endl;
+                continue;
+            }
+            auto check = [&](const char* metric, double value, double baseValue)
+            {
+                if(value <= baseValue * (1.0 + QUALITY_TOLERANCE))
+                    return;
+                std::cout << "FAILED " << sample.scene << ": " << metric << " " << value << " is over the baseline " << baseValue << std::endl;
+                failed = true;
+            };
+            check("relMSE", sample.error.relMse, base->error.relMse);
+            check("RMSE", sample.error.rmse, base->error.rmse);
+            check("FLIP", sample.error.flip, base->error.flip);
+            // informational, the time depends on the machine: how much faster the same error is reached
+            std::cout << sample.scene << ": " << base->error.relMse * base->seconds / (sample.error.relMse * sample.seconds)
+                      << "x the efficiency of the baseline" << std::endl;
+        }
+    }
 
-HittableList SmokeCornellBox()
-{
-    HittableList objects;
-
-    auto* red   = g_materialAllocator.Allocate<Lambertian>(glm::vec3(.65, .05, .05));
-    auto* white = g_materialAllocator.Allocate<Lambertian>(glm::vec3(.73, .73, .73));
-    auto* green = g_materialAllocator.Allocate<Lambertian>(glm::vec3(.12, .45, .15));
-    auto* light = g_materialAllocator.Allocate<Emissive>(7.0f * glm::vec3(1));
-
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), glm::vec3(0, 0, 555), green));
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(0, 555, 0), glm::vec3(0, 0, 555), red));
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(555, 0, 0), glm::vec3(0, 0, 555), white));
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(555, 555, 555), glm::vec3(-555, 0, 0), glm::vec3(0, 0, -555), white));
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 555), glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), white));
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(113, 554, 127), glm::vec3(330, 0, 0), glm::vec3(0, 0, 305), light));
-    // objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(0, 0, 0), glm::vec3(555, 0, 0), glm::vec3(0, 555, 0), white));
-
-    Hittable* box1 = g_shapeAllocator.Allocate<Box>(glm::vec3(0, 0, 0), glm::vec3(165, 330, 165), white);
-    box1           = g_shapeAllocator.Allocate<RotateY>(box1, 15);
-    box1           = g_shapeAllocator.Allocate<Translate>(box1, glm::vec3(265, 0, 295));
-    objects.Add(g_shapeAllocator.Allocate<ConstantMedium>(box1, 0.002f, glm::vec3(0, 0, 0)));
-
-    Hittable* box2 = g_shapeAllocator.Allocate<Box>(glm::vec3(0, 0, 0), glm::vec3(165, 165, 165), white);
-    box2           = g_shapeAllocator.Allocate<RotateY>(box2, -18);
-    box2           = g_shapeAllocator.Allocate<Translate>(box2, glm::vec3(130, 0, 65));
-    objects.Add(g_shapeAllocator.Allocate<ConstantMedium>(box2, 0.002f, glm::vec3(1, 1, 1)));
-    // objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(190, 90, 400), 90.f,
-    //                                               g_materialAllocator.Allocate<Dielectric>(1.5f)));
-    // objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(400, 90, 300), 85.f,
-    //                                               g_materialAllocator.Allocate<Metal>(glm::vec3(0.8f, 0.8f, 0.8f), 0.1f)));
-
-    return objects;
+    if(!WriteQualityCsv(reportPath, samples) || !WriteQualitySvg((directory / "quality.svg").string(), samples, baseline))
+    {
+        std::cerr << "ERROR: Couldn't write the report to " << directory.string() << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote to: " << reportPath << std::endl;
+    std::cout << (failed ? "Image quality check FAILED" : "Image quality check passed") << std::endl;
+    return failed ? 1 : 0;
 }
-HittableList Perlin()
+
+// Thread scaling report of --scaling: renders options.scene with 1, 2, 4... up to options.numThreads workers
+// (every hardware thread by default) at the benchmark settings and reports the speedup and parallel
+// efficiency, how busy every worker was and how uneven the rows are. More CPU time for the same work at
+// higher thread counts points at memory bandwidth or contention, idle workers at imbalance.
+int RunScaling(const RenderOptions& options)
 {
-    auto* texture = g_materialAllocator.Allocate<PerlinNoise>(6);
-    auto* mat     = g_materialAllocator.Allocate<Lambertian>(texture);
-    auto* globe   = g_shapeAllocator.Allocate<Sphere>(glm::vec3(0), 2.f, mat);
+    const int maxThreads = options.numThreads > 0 ? options.numThreads : (int)std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> threadCounts;
+    for(int threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    math::SeedRandom(SCENE_SEED);
+    Scene scene;
+    if(!BuildScene(options.scene, scene, options.mesh, options.compressMesh))
+    {
+        std::cerr << "ERROR: Couldn't build scene " << options.scene << std::endl;
+        return 1;
+    }
+    Camera cam = CameraController(scene, (float)options.width / options.height).GetCamera();
+    Framebuffer framebuffer(options.width, options.height);
+    std::vector<uint64_t> rowNanoseconds(options.height);
+    std::cout << "Scaling of " << options.scene << " " << options.width << "x" << options.height << " at " << options.samplesPerPixel
+              << " spp up to " << maxThreads << " threads" << std::endl
+              << "threads   seconds  speedup  efficiency  idle %  imbalance  work   row skew" << std::endl;
+
+    double baseSeconds = 0.0, baseWork = 0.0;
+    double speedup = 1.0, idle = 0.0, work = 1.0;
+    for(int threads : threadCounts)
+    {
+        WorkerPool workers(threads);
+        auto render = [&](uint32_t samplesPerPixel)
+        {
+            framebuffer.Clear(workers);
+            RenderPass pass;
+            for(uint32_t done = 0; done < samplesPerPixel; done += pass.samples)
+            {
+                pass.samples = std::min(options.samplesPerPass, samplesPerPixel - done);
+                workers.ParallelFor(options.height, [&](size_t y)
+                                    {
+                    auto start = std::chrono::steady_clock::now();
+                    TraceRow(scene, cam, options, *options.seed, pass, y, framebuffer, nullptr, y);
+                    rowNanoseconds[y] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(); });
+                pass.index++;
+            }
+        };
+        render(BENCHMARK_WARMUP_SPP);
+        std::fill(rowNanoseconds.begin(), rowNanoseconds.end(), 0);
+        workers.ResetLoads();
+        auto start = std::chrono::steady_clock::now();
+        render(options.samplesPerPixel);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // busy time summed over the workers is the CPU time the work took, clearing included
+        double busy = 0.0, maxBusy = 0.0;
+        for(int i = 0; i < threads; ++i)
+        {
+            busy    += workers.GetBusySeconds(i);
+            maxBusy  = std::max(maxBusy, workers.GetBusySeconds(i));
+        }
+        if(threads == 1)
+        {
+            baseSeconds = seconds;
+            baseWork    = busy;
+        }
+        speedup = baseSeconds / seconds;
+        idle    = 1.0 - busy / (seconds * threads);
+        work    = busy / baseWork;
+        // how much longer the slowest row takes than the average one
+        uint64_t rowSum = 0, rowMax = 0;
+        for(uint64_t row : rowNanoseconds)
+        {
+            rowSum += row;
+            rowMax  = std::max(rowMax, row);
+        }
+        std::cout << std::fixed << std::setprecision(2) << std::setw(7) << threads << std::setw(10) << seconds << std::setw(9) << speedup
+                  << std::setw(12) << speedup / threads << std::setw(8) << 100.0 * idle << std::setw(11) << maxBusy * threads / busy
+                  << std::setw(6) << work << std::setw(11) << (double)rowMax * options.height / rowSum << std::endl;
 
-    HittableList objects;
-    objects.Add(globe);
-    return objects;
-}
+        if(threads == maxThreads)
+        {
+            std::cout << "worker  busy s  idle s  rows" << std::endl;
+            for(int i = 0; i < threads; ++i)
+                std::cout << std::setw(6) << i << std::setw(8) << workers.GetBusySeconds(i) << std::setw(8) << seconds - workers.GetBusySeconds(i)
+                          << std::setw(6) << workers.GetItemCount(i) << std::endl;
+        }
+        std::cout << std::defaultfloat << std::setprecision(6);
+    }
 
+    // imbalance shows up as idle workers, contention and bandwidth limits as work that got more expensive
+    if(speedup / maxThreads >= 0.9)
+        std::cout << "Scales well: " << 100.0 * speedup / maxThreads << "% parallel efficiency" << std::endl;
+    else if(work > 1.2)
+        std::cout << "The same work took " << 100.0 * (work - 1.0) << "% more CPU time on " << maxThreads
+                  << " threads: limited by memory bandwidth, shared state contention or SMT siblings" << std::endl;
+    else if(idle > 0.1)
+        std::cout << "The workers were idle " << 100.0 * idle << "% of the time: limited by load imbalance or synchronization" << std::endl;
+    else
+        std::cout << "Parallel efficiency is " << 100.0 * speedup / maxThreads << "%, from both more work and idle workers" << std::endl;
+    return 0;
+}
 
-HittableList FinalScene()
+int main(int argc, char** argv)
 {
-    HittableList boxes1;
-    auto* ground = g_materialAllocator.Allocate<Lambertian>(glm::vec3(0.48, 0.83, 0.53));
-
-    constexpr int boxesPerSide = 20;
-    for(int i = 0; i < boxesPerSide; ++i)
+    RenderOptions options;
+    if(!ParseOptions(argc, argv, options))
+        return 1;
+    PROFILE_THREAD_NAME("Main");
+#ifdef RAYTRACER_PROFILE
+    if(!options.profile.empty())
+        g_profiler.SetOutput(options.profile);
+#endif
+    if(!options.convertMesh.empty())
     {
-        for(int j = 0; j < boxesPerSide; ++j)
-        {
-            float w  = 100.0f;
-            float x0 = -1000.0f + i * w;
-            float z0 = -1000.0f + j * w;
-            float y0 = 0.0f;
-            float x1 = x0 + w;
-            float y1 = math::RandomReal<float>(1, 101);
-            float z1 = z0 + w;
-
-            boxes1.Add(g_shapeAllocator.Allocate<Box>(glm::vec3(x0, y0, z0), glm::vec3(x1, y1, z1), ground));
-        }
+        std::string output = options.output.empty() ? std::filesystem::path(options.convertMesh).replace_extension(".rmesh").string() : options.output;
+        return ConvertMesh(options.convertMesh, output, options.compressMesh) ? 0 : 1;
+    }
+    if(!options.benchmark.empty())
+    {
+        WorkerPool workers(options.numThreads);
+        return RunBenchmark(options, workers);
+    }
+    if(!options.quality.empty())
+    {
+        WorkerPool workers(options.numThreads);
+        return RunQuality(options, workers);
     }
+    if(options.scaling)
+        return RunScaling(options);
 
-    HittableList objects;
-    objects.Add(g_shapeAllocator.Allocate<BVHNode>(boxes1));
+    // Resuming takes the render settings from the checkpoints
+    CheckpointInfo resumed;
+    for(size_t i = 0; i < options.resume.size(); ++i)
+    {
+        CheckpointInfo info;
+        if(!ReadCheckpointInfo(options.resume[i], info))
+            return 1;
+        if(i == 0)
+            resumed = info;
+        else if(!MergeCheckpointInfo(resumed, info, options.resume[i]))
+            return 1;
+    }
+    if(!options.resume.empty())
+    {
+        options.scene    = resumed.scene;
+        options.width    = resumed.width;
+        options.height   = resumed.height;
+        options.maxDepth = resumed.maxDepth;
+        options.seed     = resumed.seed;
+        std::cout << "Resuming " << resumed.scene << " " << resumed.width << "x" << resumed.height << " at " << resumed.samplesPerPixel
+                  << " spp from " << options.resume.size() << " checkpoint(s)" << std::endl;
+    }
+    const uint64_t seed = options.seed ? *options.seed : ((uint64_t)std::random_device()() << 32) | std::random_device()();
 
-    objects.Add(g_shapeAllocator.Allocate<Quad>(glm::vec3(123, 554, 147), glm::vec3(300, 0, 0), glm::vec3(0, 0, 265),
-                                                g_materialAllocator.Allocate<Emissive>(glm::vec3(7.0f))));
+    math::SeedRandom(SCENE_SEED);
+    Scene scene;
+    if(!BuildScene(options.scene, scene, options.mesh, options.compressMesh))
+    {
+        std::cerr << "ERROR: Couldn't build scene " << options.scene << std::endl;
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if(std::find(options.aovs.begin(), options.aovs.end(), Aov::Lights) != options.aovs.end() && Emissive::GetLightCount() > AOV_MAX_LIGHTS)
+        std::cout << "The scene has " << Emissive::GetLightCount() << " lights, only the first " << AOV_MAX_LIGHTS << " get an AOV" << std::endl;
+    g_materialCache.PrintReport();
+    g_shapeAllocator.PrintStats();
+    g_materialAllocator.PrintStats();
 
-    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(260, 150, 45), 50, g_materialAllocator.Allocate<Dielectric>(1.5f)));
-    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(0, 150, 145), 50, g_materialAllocator.Allocate<Metal>(glm::vec3(0.8, 0.8, 0.9), 1.0)));
+    const int maxDepth         = options.maxDepth;
+    const uint32_t imageWidth  = options.width;
+    const uint32_t imageHeight = options.height;
+    const float aspectRatio    = (float)imageWidth / imageHeight;
 
-    auto* boundary = g_shapeAllocator.Allocate<Sphere>(glm::vec3(360, 150, 145), 70, g_materialAllocator.Allocate<Dielectric>(1.5f));
-    objects.Add(boundary);
-    objects.Add(g_shapeAllocator.Allocate<ConstantMedium>(boundary, 0.2f, glm::vec3(0.2, 0.4, 0.9)));
-    auto* boundary2 = g_shapeAllocator.Allocate<Sphere>(glm::vec3(0), 5000, g_materialAllocator.Allocate<Dielectric>(1.5f));
-    objects.Add(g_shapeAllocator.Allocate<ConstantMedium>(boundary2, 0.0001f, glm::vec3(1)));
+    // Camera
+    // only the render thread of the windowed mode ever changes it, between passes
+    CameraController cameraController(scene, aspectRatio);
+    Camera cam = cameraController.GetCamera();
 
-    auto* emat = g_materialAllocator.Allocate<Lambertian>(g_materialAllocator.Allocate<ImageTexture>("../earthmap.jpg"));
-    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(400, 200, 400), 100, emat));
+    WorkerPool workers(options.numThreads);
+    std::cout << "Rendering with " << workers.GetNumThreads() << " threads on " << workers.GetNumNodes() << " NUMA node(s)" << std::endl;
 
-    auto* pertext = g_materialAllocator.Allocate<PerlinNoise>(2);
-    objects.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(220, 280, 300), 80, g_materialAllocator.Allocate<Lambertian>(pertext)));
+    // saves only snapshot the framebuffer, encoding happens on the writer's own thread
+    ImageWriter imageWriter;
 
-    HittableList boxes2;
-    auto* white = g_materialAllocator.Allocate<Lambertian>(glm::vec3(0.73, 0.73, 0.73));
-    int ns      = 1000;
-    for(int j = 0; j < ns; j++)
+    if(options.tileRows > 0)
     {
-        float x = math::RandomReal<float>(0, 165);
-        float y = math::RandomReal<float>(0, 165);
-        float z = math::RandomReal<float>(0, 165);
-        boxes2.Add(g_shapeAllocator.Allocate<Sphere>(glm::vec3(x, y, z), 10, white));
+        std::string filename = options.output.empty() ? imageWriter.NextFilename("image", ".exr", options.samplesPerPixel) : options.output;
+        return RenderTiled(scene, cam, options, seed, workers, filename);
     }
 
-    objects.Add(g_shapeAllocator.Allocate<Translate>(g_shapeAllocator.Allocate<RotateY>(g_shapeAllocator.Allocate<BVHNode>(boxes2), 15), glm::vec3(-100, 270, 395)));
+    // The framebuffer stays on small pages and is first touched with the same row split as the render loop,
+    // so the rows each NUMA node writes end up in its local memory
+    Framebuffer framebuffer(imageWidth, imageHeight);
+    framebuffer.Clear(workers);
+    std::unique_ptr<AovBuffer> aovs;
+    if(!options.aovs.empty())
+    {
+        aovs = std::make_unique<AovBuffer>(imageWidth, imageHeight, options.aovs, Emissive::GetLightCount());
+        aovs->Clear(workers);
+    }
+    for(const std::string& path : options.resume)
+    {
+        if(!AccumulateCheckpoint(path, framebuffer))
+            return 1;
+    }
 
-    return objects;
-}
+    uint32_t frameIndex  = resumed.passes;
+    uint32_t samplesDone = resumed.samplesPerPixel;
+    auto renderPass      = [&](RenderPass pass)
+    {
+        pass.index = frameIndex++;
+        workers.ParallelFor(imageHeight, [&](size_t y)
+                            { TraceRow(scene, cam, options, seed, pass, y, framebuffer, aovs.get(), y); });
+        // partial passes only count once the last one finishes the pass
+        if(pass.IsComplete())
+            samplesDone += pass.samples;
+    };
+    RenderPass fullPass;
+    fullPass.samples = options.samplesPerPass;
+    auto outputFilename = [&]()
+    {
+        return options.output.empty() ? imageWriter.NextFilename("image", ".png", samplesDone) : options.output;
+    };
+    const std::string autosaveFilename = options.output.empty() ? (ImageWriter::GetImageDirectory() / "autosave.png").string() : options.output;
+    auto checkpointInfo = [&]()
+    {
+        CheckpointInfo info;
+        info.scene           = options.scene;
+        info.width           = imageWidth;
+        info.height          = imageHeight;
+        info.maxDepth        = maxDepth;
+        info.samplesPerPixel = samplesDone;
+        info.seed            = seed;
+        info.passes          = frameIndex;
+        return info;
+    };
+
+    // Called between passes, both only cost the render loop a copy of the framebuffer
+    auto lastAutosave   = std::chrono::steady_clock::now();
+    auto lastCheckpoint = lastAutosave;
+    auto periodicSaves  = [&]()
+    {
+        auto now = std::chrono::steady_clock::now();
+        if(options.autosaveInterval > 0.0f && std::chrono::duration<float>(now - lastAutosave).count() >= options.autosaveInterval)
+        {
+            imageWriter.Save(framebuffer, aovs.get(), options.resolve, autosaveFilename);
+            lastAutosave = now;
+        }
+        if(!options.checkpoint.empty() && std::chrono::duration<float>(now - lastCheckpoint).count() >= options.checkpointInterval)
+        {
+            imageWriter.SaveCheckpoint(framebuffer, checkpointInfo(), options.checkpoint);
+            lastCheckpoint = now;
+        }
+    };
 
-int main()
-{
-    // Scene
-    HittableList world;
-    HittableList lights;
-    glm::vec3 camPos;
-    glm::vec3 lookAt;
-    float vFOV;
-    float focusDist;
-    float aperture;
-    glm::vec3 background;
-
-    switch(4)
+    if(options.headless)
     {
-    case 1:
-        world      = RandomScene();
-        // lights =
-        camPos     = glm::vec3(13, 2, 3);
-        lookAt     = glm::vec3(0, 0, 0);
-        vFOV       = 20.f;
-        focusDist  = 10.f;
-        aperture   = 0.0f;
-        background = glm::vec3(0.7f, 0.8f, 1.0f);
-        break;
-    case 2:
-        world      = Earth();
-        // lights =
-        camPos     = glm::vec3(0, 2, 20);
-        lookAt     = glm::vec3(0, 0, 0);
-        vFOV       = 20.f;
-        focusDist  = 10.f;
-        aperture   = 0.0f;
-        background = glm::vec3(0.7f, 0.8f, 1.0f);
-        break;
-    case 3:
-        world      = EmissionScene();
-        // lights =
-        camPos     = glm::vec3(26, 3, 6);
-        lookAt     = glm::vec3(0, 2, 0);
-        vFOV       = 20.f;
-        focusDist  = 10.f;
-        aperture   = 0.0f;
-        background = glm::vec3(0.01f);
-        break;
-    case 4:
-        world      = CornellBox();
-        lights     = CornellBoxLights();
-        camPos     = glm::vec3(278, 278, -800);
-        lookAt     = glm::vec3(278, 278, 1);
-        vFOV       = 40.f;
-        focusDist  = 10.f;
-        aperture   = 0.0f;
-        background = glm::vec3(0.00f);
-        break;
-    case 5:
-        world      = Perlin();
-        // lights =
-        camPos     = glm::vec3(0, 2, 20);
-        lookAt     = glm::vec3(0, 0, 0);
-        vFOV       = 20.f;
-        focusDist  = 10.f;
-        aperture   = 0.0f;
-        background = glm::vec3(0.7f, 0.8f, 1.0f);
-        break;
-    case 6:
-        world      = SmokeCornellBox();
-        // lights =
-        camPos     = glm::vec3(278, 278, -800);
-        lookAt     = glm::vec3(278, 278, 1);
-        vFOV       = 40.f;
-        focusDist  = 10.f;
-        aperture   = 0.0f;
-        background = glm::vec3(0.00f);
-        break;
-    case 7:
-        world      = FinalScene();
-        // lights =
-        camPos     = glm::vec3(478, 278, -600);
-        lookAt     = glm::vec3(278, 278, 0);
-        vFOV       = 40.f;
-        focusDist  = 10.f;
-        aperture   = 0.0f;
-        background = glm::vec3(0.f);
-        break;
+        auto start = std::chrono::steady_clock::now();
+        while(samplesDone < options.samplesPerPixel)
+        {
+            // the last pass only takes the samples that are left
+            fullPass.samples = std::min(options.samplesPerPass, options.samplesPerPixel - samplesDone);
+            renderPass(fullPass);
+            periodicSaves();
+            std::cout << "\rPass " << frameIndex << ", " << samplesDone << "/" << options.samplesPerPixel << " spp" << std::flush;
+        }
+        std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "\nRendered in " << elapsed.count() << " s" << std::endl;
+
+        if(options.benchmarkResolve)
+            BenchmarkResolve(framebuffer, 20);
     }
-    constexpr uint32_t numSamples = 1;
-    constexpr int maxDepth        = 50;
-    constexpr float aspectRatio   = 1.f;
-    16.0f / 9.0f;
+#ifndef RAYTRACER_HEADLESS
+    else
+    {
+        mfb_window* window = mfb_open("Raytracer", imageWidth, imageHeight);
+        if(!window)
+            return 0;
+        mfb_set_target_fps(60);
+
+        // The window belongs to this thread, which only presents frames and handles input. Tracing runs
+        // on its own thread so the workers never wait for vsync and the window stays responsive however
+        // long a pass takes. Everything that touches the framebuffer happens on the render thread
+        // between passes, input only posts requests to it.
+        DisplayBuffers display(imageWidth * imageHeight);
+        std::atomic<bool> stopRendering = false;
+        std::atomic<bool> saveRequested = false;
+        std::mutex cameraInputMutex;
+        CameraInput cameraInput;
+
+        mfb_set_keyboard_callback([&](mfb_window* window, mfb_key key, mfb_key_mod mod, bool isPressed)
+                                  {
+                                        if(key == KB_KEY_ESCAPE && isPressed)
+                                            mfb_close(window);
+                                        if(key == KB_KEY_S && (mod & KB_MOD_CONTROL) && isPressed)
+                                            saveRequested = true; },
+                                  window);
+
+        // WASD moves, Q and E go down and up, shift moves faster and dragging with the left mouse
+        // button looks around. Polled once per displayed frame.
+        auto lastPoll        = std::chrono::steady_clock::now();
+        int lastMouseX       = mfb_get_mouse_x(window);
+        int lastMouseY       = mfb_get_mouse_y(window);
+        auto pollCameraInput = [&]()
+        {
+            auto now      = std::chrono::steady_clock::now();
+            float seconds = std::chrono::duration<float>(now - lastPoll).count();
+            lastPoll      = now;
 
-    constexpr uint32_t imageHeight = 600;
-    constexpr uint32_t imageWidth  = static_cast<uint32_t>(imageHeight * aspectRatio);
+            const uint8_t* keys = mfb_get_key_buffer(window);
+            CameraInput input;
+            if(!keys[KB_KEY_LEFT_CONTROL])
+            {
+                float speed  = CAMERA_MOVE_SPEED * seconds * (keys[KB_KEY_LEFT_SHIFT] ? 4.0f : 1.0f);
+                input.move.x = speed * (keys[KB_KEY_D] - keys[KB_KEY_A]);
+                input.move.y = speed * (keys[KB_KEY_E] - keys[KB_KEY_Q]);
+                input.move.z = speed * (keys[KB_KEY_W] - keys[KB_KEY_S]);
+            }
+            int mouseX = mfb_get_mouse_x(window);
+            int mouseY = mfb_get_mouse_y(window);
+            if(mfb_get_mouse_button_buffer(window)[MOUSE_LEFT])
+                input.rotate = CAMERA_ROTATE_SPEED * glm::vec2(mouseX - lastMouseX, lastMouseY - mouseY);
+            lastMouseX = mouseX;
+            lastMouseY = mouseY;
+
+            if(!input.IsZero())
+            {
+                std::lock_guard lock(cameraInputMutex);
+                cameraInput.Add(input);
+            }
+        };
+        Reprojector reprojector(imageWidth, imageHeight);
+        std::unique_ptr<Denoiser> denoiser;
+        if(options.resolve.denoise)
+            denoiser = std::make_unique<Denoiser>(imageWidth, imageHeight);
+
+        // with a frame time budget every frame traces as much as fits in it, possibly only part of a pass
+        FrameScheduler scheduler(imageWidth * imageHeight, options.frameTime, MAX_SAMPLES_PER_FRAME);
+
+        std::thread renderThread([&]()
+                                 {
+            PROFILE_THREAD_NAME("Render");
+            bool hasUnresolvedSamples = false;
+            while(!stopRendering)
+            {
+                if(saveRequested.exchange(false))
+                    imageWriter.Save(framebuffer, aovs.get(), options.resolve, outputFilename());
 
-    // Camera
-    Camera cam(camPos, lookAt, glm::vec3(0, 1, 0), vFOV, aspectRatio, aperture,
-               focusDist);
-
-    std::vector<uint32_t> imageData(imageWidth * imageHeight);
-    // stb expects the bytes to be in the other order as minifb, so need to keep a separate buffer
-    std::vector<uint8_t> stbImageData(imageWidth * imageHeight * 4);
-    std::vector<glm::vec3> accumulatedColor(imageWidth * imageHeight, glm::vec3(0));
-    int index = 0;
-
-    std::vector<int> lines;
-    lines.reserve(imageHeight);
-    for(int i = imageHeight - 1; i >= 0; --i)
-        lines.push_back(i);
-
-    mfb_window* window = mfb_open("Raytracer", imageWidth, imageHeight);
-    mfb_set_target_fps(60);
-    if(!window)
-        return 0;
-    mfb_set_target_fps(60);
-    uint32_t frameIndex = 0;
-
-
-    auto* timer     = mfb_timer_create();
-    float timer_res = 1000.0f;
-    int state       = 0;
-    mfb_set_keyboard_callback([&](mfb_window* window, mfb_key key, mfb_key_mod mod, bool isPressed)
-                              {
-                                    if(key == KB_KEY_ESCAPE && isPressed)
-                                        mfb_close(window);
-                                    if(key == KB_KEY_S && isPressed)
-                                    {
-                                        SaveImage(stbImageData, imageWidth, imageHeight, frameIndex * numSamples);
-                                    } },
-                              window);
+                CameraInput input;
+                {
+                    std::lock_guard lock(cameraInputMutex);
+                    std::swap(input, cameraInput);
+                }
+                if(!input.IsZero())
+                {
+                    Camera oldCam = cam;
+                    cameraController.Apply(input);
+                    cam = cameraController.GetCamera();
+                    reprojector.Apply(framebuffer, oldCam, cam, workers, options.historySamples);
+                    if(aovs)
+                        aovs->Clear(workers);
+                    scheduler.Reset();
+                    samplesDone          = 0;
+                    hasUnresolvedSamples = true;
+                    if(!options.checkpoint.empty())
+                    {
+                        // checkpoints are resumed with the scene's camera
+                        std::cout << "Camera moved, checkpointing stops" << std::endl;
+                        options.checkpoint.clear();
+                    }
+                }
 
+                // stop tracing once the requested sample count is reached but keep the window open
+                bool done = options.samplesPerPixel != 0 && samplesDone >= options.samplesPerPixel;
+                if(!done)
+                {
+                    RenderPass pass = options.frameTime > 0.0f ? scheduler.Next() : fullPass;
+                    if(options.samplesPerPixel != 0)
+                        pass.samples = std::min(pass.samples, options.samplesPerPixel - samplesDone);
+
+                    auto start = std::chrono::steady_clock::now();
+                    renderPass(pass);
+                    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+                    scheduler.Finished(pass, elapsed.count());
+                    periodicSaves();
+                    hasUnresolvedSamples = true;
+                    std::cout << "Frametime: " << elapsed.count() << " ms, Frame #" << frameIndex << ", " << pass.samples << " spp over "
+                              << pass.endRank - pass.firstRank << "/" << PASS_RANKS << " of the pixels" << std::endl;
+                }
+                // passes faster than the display rate only get resolved once the last frame was shown
+                if(hasUnresolvedSamples && !display.IsFramePending())
+                {
+                    if(denoiser)
+                        denoiser->Resolve(framebuffer, &workers, PixelFormat::ARGB, display.GetBackBuffer(), options.resolve);
+                    else
+                        framebuffer.Resolve(workers, PixelFormat::ARGB, display.GetBackBuffer(), options.resolve);
+                    if(!scheduler.IsImageCovered())
+                        framebuffer.FillUnsampledPixels(workers, display.GetBackBuffer(), PASS_BLOCK_SIZE);
+                    display.Publish();
+                    hasUnresolvedSamples = false;
+                }
+                else if(done)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            } });
 
-    do
-    {
-        frameIndex++;
-        mfb_timer_now(timer);
-        std::for_each(std::execution::par, lines.begin(), lines.end(),
-                      [=, &imageData, &accumulatedColor, &stbImageData](int y)
-                      {
-                          for(int x = 0; x < imageWidth; ++x)
-                          {
-                              glm::vec3 color(0);
-                              for(int s = 0; s < numSamples; ++s)
-                              {
-                                  float u = (x + math::RandomReal<float>()) / (imageWidth - 1);
-                                  float v = (y + math::RandomReal<float>()) / (imageHeight - 1);
-
-                                  color += RayColor(cam.GetRay(u, v), background, world, lights, maxDepth);
-                              }
-                              float r = glm::max(color.r, 0.0f);
-                              float g = glm::max(color.g, 0.0f);
-                              float b = glm::max(color.b, 0.0f);
-
-                              // NaN check
-                              if(r != r)
-                                  r = 0;
-                              if(g != g)
-                                  g = 0;
-                              if(b != b)
-                                  b = 0;
-
-
-                              // gamma correct for gamma = 2
-                              constexpr float scale = 1.0f / numSamples;
-
-                              r = r * scale;
-                              g = g * scale;
-                              b = b * scale;
-
-                              y            = imageHeight - 1 - y;
-                              auto& pixel  = accumulatedColor[y * imageWidth + x];
-                              pixel.r     += r;
-                              pixel.g     += g;
-                              pixel.b     += b;
-
-                              glm::vec3 gammaCorrectedColor(glm::sqrt(pixel / (float)frameIndex));
-
-                              uint8_t image_r = 256 * glm::clamp(gammaCorrectedColor.r, 0.0f, 0.999f);
-                              uint8_t image_g = 256 * glm::clamp(gammaCorrectedColor.g, 0.0f, 0.999f);
-                              uint8_t image_b = 256 * glm::clamp(gammaCorrectedColor.b, 0.0f, 0.999f);
-
-                              imageData[y * imageWidth + x]              = MFB_ARGB(0xFF, image_r, image_g, image_b);
-                              stbImageData[(y * imageWidth + x) * 4 + 0] = image_r;
-                              stbImageData[(y * imageWidth + x) * 4 + 1] = image_g;
-                              stbImageData[(y * imageWidth + x) * 4 + 2] = image_b;
-                              stbImageData[(y * imageWidth + x) * 4 + 3] = 0xFF;
-
-                              // WriteColor(std::cout, color, numSamples);
-                          }
-                      });
-
-        state = mfb_update_ex(window, imageData.data(), imageWidth, imageHeight);
-
-        std::cout << "Frametime: " << mfb_timer_delta(timer) * timer_res << " ms, Frame #" << frameIndex << std::endl;
-        if(state < 0)
+        do
         {
-            window = nullptr;
-            break;
-        }
-    } while(mfb_wait_sync(window));
-    SaveImage(stbImageData, imageWidth, imageHeight, frameIndex * numSamples);
+            pollCameraInput();
+            mfb_update_state state;
+            {
+                PROFILE_SCOPE("mfb_update_ex");
+                state = mfb_update_ex(window, (void*)display.GetFrontBuffer(), imageWidth, imageHeight);
+            }
+            if(state < 0)
+            {
+                window = nullptr;
+                break;
+            }
+        } while(mfb_wait_sync(window));
+
+        // the pass in flight is finished before the final save below
+        stopRendering = true;
+        renderThread.join();
+    }
+#endif
+#ifdef RAYTRACER_STATS
+    CollectStats().Print(options.scene.c_str());
+#endif
+    imageWriter.Save(framebuffer, aovs.get(), options.resolve, outputFilename());
+    if(!options.checkpoint.empty())
+        imageWriter.SaveCheckpoint(framebuffer, checkpointInfo(), options.checkpoint);
+    imageWriter.Flush();
+    g_materialCache.Clear();
     g_materialAllocator.Reset();
     g_shapeAllocator.Reset();
 }